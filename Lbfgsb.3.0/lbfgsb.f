@@ -44,16 +44,19 @@ c                        March  2011
 c
 c=============================================================================
       subroutine setulb(n, m, x, l, u, nbd, f, g, factr, pgtol, wa, iwa,
-     +                 task, iprint, csave, lsave, isave, dsave)
+     +                 task, iprint, csave, lsave, isave, dsave, iopt,
+     +                 dopt)
 
-      character*60     task, csave
-      logical          lsave(4)
-      integer          n, m, iprint,
-     +                 nbd(n), iwa(3*n), isave(44)
+      use iso_c_binding, only: c_bool
+      logical(c_bool)  lsave(4)
+      integer          n, m, iprint, task, csave,
+     +                 nbd(n), iwa(3*n), isave(44), iopt(8)
       double precision f, factr, pgtol, x(n), l(n), u(n), g(n),
 c
 c-jlm-jn
-     +                 wa(2*m*n + 5*n + 11*m*m + 8*m), dsave(29)
+     +                 wa(2*m*n + 5*n + 11*m*m + 8*m), dsave(29),
+     +                 dopt(8)
+      include 'lbfgsb_codes.inc'
 
 c     ************
 c
@@ -128,8 +131,11 @@ c       (2mmax + 5)nmax + 12mmax^2 + 12mmax.
 c
 c     iwa is an integer working array of length 3nmax.
 c
-c     task is a working string of characters of length 60 indicating
-c       the current job when entering and quitting this subroutine.
+c     task is an integer variable indicating the current job when
+c       entering and quitting this subroutine (see lbfgsb_codes.inc).
+c       On initial entry task is task_start, or task_warm_start to
+c       reuse the limited memory BFGS matrix stored in wa, isave and
+c       dsave by a previous run with the same n and m.
 c
 c     iprint is an integer variable that must be set by the user.
 c       It controls the frequency and type of output generated:
@@ -142,9 +148,9 @@ c        iprint>100  print details of every iteration including x and g;
 c       When iprint > 0, the file iterate.dat will be created to
 c                        summarize the iteration.
 c
-c     csave is a working string of characters of length 60.
+c     csave is an integer working variable (see lbfgsb_codes.inc).
 c
-c     lsave is a logical working array of dimension 4.
+c     lsave is a logical(c_bool) working array of dimension 4.
 c       On exit with 'task' = NEW_X, the following information is
 c                                                             available:
 c         If lsave(1) = .true.  then  the initial X has been replaced by
@@ -204,6 +210,14 @@ c                                 the starting point of the line search;
 c         dsave(16) = the square of the 2-norm of the line search
 c                                                      direction vector.
 c
+c     iopt is an integer array of dimension 8 of options, indexed by
+c       the opt_* codes of lbfgsb_codes.inc. It must not change during
+c       a run. A zero array selects the original algorithm.
+c
+c     dopt is a double precision array of dimension 8 of real options,
+c       indexed by the dopt_* codes of lbfgsb_codes.inc. A zero entry
+c       selects the default value of the option.
+c
 c     Subprograms called:
 c
 c       L-BFGS-B Library ... mainlb.
@@ -238,7 +252,7 @@ c-jlm-jn
       integer   lws,lr,lz,lt,ld,lxp,lwa,
      +          lwy,lsy,lss,lwt,lwn,lsnd
 
-      if (task .eq. 'START') then
+      if (task .eq. task_start .or. task .eq. task_warm_start) then
          isave(1)  = m*n
          isave(2)  = m**2
          isave(3)  = 4*m**2
@@ -275,7 +289,7 @@ c-jlm-jn
      +  wa(lwn),wa(lsnd),wa(lz),wa(lr),wa(ld),wa(lt),wa(lxp),
      +  wa(lwa),
      +  iwa(1),iwa(n+1),iwa(2*n+1),task,iprint,
-     +  csave,lsave,isave(22),dsave)
+     +  csave,lsave,isave(22),dsave,iopt,dopt)
 
       return
 
@@ -286,19 +300,22 @@ c======================= The end of setulb =============================
       subroutine mainlb(n, m, x, l, u, nbd, f, g, factr, pgtol, ws, wy,
      +                  sy, ss, wt, wn, snd, z, r, d, t, xp, wa,
      +                  index, iwhere, indx2, task,
-     +                  iprint, csave, lsave, isave, dsave)
+     +                  iprint, csave, lsave, isave, dsave, iopt, dopt)
+      use iso_c_binding, only: c_bool
       implicit none
-      character*60     task, csave
-      logical          lsave(4)
-      integer          n, m, iprint, nbd(n), index(n),
-     +                 iwhere(n), indx2(n), isave(23)
+      logical(c_bool)  lsave(4)
+      integer          n, m, iprint, task, csave, nbd(n), index(n),
+     +                 iwhere(n), indx2(n), isave(23), iopt(8)
       double precision f, factr, pgtol,
      +                 x(n), l(n), u(n), g(n), z(n), r(n), d(n), t(n),
 c-jlm-jn
      +                 xp(n),
      +                 wa(8*m),
      +                 ws(n, m), wy(n, m), sy(m, m), ss(m, m),
-     +                 wt(m, m), wn(2*m, 2*m), snd(2*m, 2*m), dsave(29)
+     +                 wt(m, m), wn(2*m, 2*m), snd(2*m, 2*m), dsave(29),
+     +                 dopt(8)
+      include 'lbfgsb_codes.inc'
+      include 'lbfgsb_parallel.inc'
 
 c     ************
 c
@@ -414,8 +431,8 @@ c       In subroutine freev, a list of variables entering and leaving
 c       the free set is stored in indx2, and it is passed on to
 c       subroutine formk with this information.
 c
-c     task is a working string of characters of length 60 indicating
-c       the current job when entering and leaving this subroutine.
+c     task is an integer variable indicating the current job when
+c       entering and leaving this subroutine.
 c
 c     iprint is an INTEGER variable that must be set by the user.
 c       It controls the frequency and type of output generated:
@@ -428,9 +445,9 @@ c        iprint>100  print details of every iteration including x and g;
 c       When iprint > 0, the file iterate.dat will be created to
 c                        summarize the iteration.
 c
-c     csave is a working string of characters of length 60.
+c     csave is an integer working variable.
 c
-c     lsave is a logical working array of dimension 4.
+c     lsave is a logical(c_bool) working array of dimension 4.
 c
 c     isave is an integer working array of dimension 23.
 c
@@ -443,7 +460,7 @@ c       L-BFGS-B Library ... cauchy, subsm, lnsrlb, formk,
 c
 c        errclb, prn1lb, prn2lb, prn3lb, active, projgr,
 c
-c        freev, cmprlb, matupd, formt.
+c        freev, cmprlb, matupd, formt, formw1.
 c
 c       Minpack2 Library ... timer
 c
@@ -483,17 +500,17 @@ c     ************
       logical          prjctd,cnstnd,boxed,updatd,wrk
       character*3      word
       integer          i,k,nintol,itfile,iback,nskip,
-     +                 head,col,iter,itail,iupdat,
+     +                 head,col,iter,itail,iupdat,iwarm,itls,
      +                 nseg,nfgv,info,ifun,
-     +                 iword,nfree,nact,ileave,nenter
+     +                 iword,nfree,nact,ileave,nenter,nchg
       double precision theta,fold,ddot,dr,rr,tol,
      +                 xstep,sbgnrm,ddum,dnorm,dtd,epsmch,
      +                 cpu1,cpu2,cachyt,sbtime,lnscht,time1,time2,
-     +                 gd,gdold,stp,stpmx,time
-      double precision one,zero
-      parameter        (one=1.0d0,zero=0.0d0)
+     +                 gd,gdold,stp,stpmx,time,sytol
+      double precision one,zero,p9
+      parameter        (one=1.0d0,zero=0.0d0,p9=0.9d0)
 
-      if (task .eq. 'START') then
+      if (task .eq. task_start .or. task .eq. task_warm_start) then
 
          epsmch = epsilon(one)
 
@@ -531,6 +548,7 @@ c           for operation counts:
          nskip  = 0
          nfree  = n
          ifun   = 0
+         nchg   = 0
 c           for stopping tolerance:
          tol = factr*epsmch
 
@@ -554,7 +572,8 @@ c                                open a summary file 'iterate.dat'
 c        Check the input arguments for errors.
 
          call errclb(n,m,factr,l,u,nbd,task,info,k)
-         if (task(1:5) .eq. 'ERROR') then
+         if (task .ge. task_error_n .and.
+     +       task .le. task_error_feasible) then
             call prn3lb(n,x,f,task,iprint,info,itfile,
      +                  iter,nfgv,nintol,nskip,nact,sbgnrm,
      +                  zero,nseg,word,iback,stp,xstep,k,
@@ -568,6 +587,19 @@ c        Initialize iwhere & project x onto the feasible set.
 
          call active(n,l,u,nbd,x,iwhere,iprint,prjctd,cnstnd,boxed)
 
+c        On a warm start, keep the corrections of the previous run. WN1
+c        is rebuilt in the first iteration for the new free variables.
+
+         iwarm = 0
+         if (task .eq. task_warm_start) then
+            head   = isave(6)
+            col    = isave(7)
+            itail  = isave(8)
+            iupdat = isave(10)
+            theta  = dsave(1)
+            if (col .gt. 0) iwarm = 1
+         endif
+
 c        The end of the initialization.
 
       else
@@ -579,6 +611,7 @@ c          restore local variables.
          updatd = lsave(4)
 
          nintol = isave(1)
+         iwarm  = isave(2)
          itfile = isave(3)
          iback  = isave(4)
          nskip  = isave(5)
@@ -587,6 +620,7 @@ c          restore local variables.
          itail  = isave(8)
          iter   = isave(9)
          iupdat = isave(10)
+         nchg   = isave(11)
          nseg   = isave(12)
          nfgv   = isave(13)
          info   = isave(14)
@@ -617,11 +651,11 @@ c          restore local variables.
 c        After returning from the driver go to the point where execution
 c        is to resume.
 
-         if (task(1:5) .eq. 'FG_LN') goto 666
-         if (task(1:5) .eq. 'NEW_X') goto 777
-         if (task(1:5) .eq. 'FG_ST') goto 111
-         if (task(1:4) .eq. 'STOP') then
-            if (task(7:9) .eq. 'CPU') then
+         if (task .eq. task_fg_lnsrch) goto 666
+         if (task .eq. task_new_x) goto 777
+         if (task .eq. task_fg_start) goto 111
+         if (task .eq. task_stop .or. task .eq. task_stop_cpu) then
+            if (task .eq. task_stop_cpu) then
 c                                          restore the previous iterate.
                call dcopy(n,t,1,x,1)
                call dcopy(n,r,1,g,1)
@@ -633,7 +667,7 @@ c                                          restore the previous iterate.
 
 c     Compute f0 and g0.
 
-      task = 'FG_START'
+      task = task_fg_start
 c          return to the driver to calculate f and g; reenter at 111.
       goto 1000
  111  continue
@@ -649,7 +683,7 @@ c     Compute the infinity norm of the (-) projected gradient.
       endif
       if (sbgnrm .le. pgtol) then
 c                                terminate the algorithm.
-         task = 'CONVERGENCE: NORM_OF_PROJECTED_GRADIENT_<=_PGTOL'
+         task = task_conv_pgtol
          goto 999
       endif
 
@@ -659,7 +693,20 @@ c ----------------- the beginning of the loop --------------------------
       if (iprint .ge. 99) write (6,1001) iter + 1
       iword = -1
 c
-      if (.not. cnstnd .and. col .gt. 0) then
+      if (.not. cnstnd .and. col .gt. 0 .and.
+     +    iopt(opt_direction) .eq. 1) then
+c          no bounds: z = x - Hg, with the inverse of the L-BFGS matrix
+c          applied by the two-loop recursion instead of the subspace
+c          minimization over the compact representation.
+         call timer(cpu1)
+         call twolp(n,m,ws,wy,sy,theta,col,head,x,g,z,wa)
+         call timer(cpu2)
+         sbtime = sbtime + cpu2 - cpu1
+         nseg = 0
+         goto 555
+      endif
+      if (.not. cnstnd .and. col .gt. 0 .and.
+     +    .not. (iwarm .eq. 1 .and. iter .eq. 0)) then
 c                                            skip the search for GCP.
          call dcopy(n,x,1,z,1)
          wrk = updatd
@@ -677,7 +724,7 @@ cccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccc
       call cauchy(n,x,l,u,nbd,g,indx2,iwhere,t,d,z,
      +            m,wy,ws,sy,wt,theta,col,head,
      +            wa(1),wa(2*m+1),wa(4*m+1),wa(6*m+1),nseg,
-     +            iprint, sbgnrm, info, epsmch)
+     +            iprint, sbgnrm, info, epsmch, iopt(opt_breakpoints))
       if (info .ne. 0) then
 c         singular triangular system detected; refresh the lbfgs memory.
          if(iprint .ge. 1) write (6, 1005)
@@ -723,8 +770,17 @@ c                     [L_a -R_z           theta*S'AA'S ]
 c       where     E = [-I  0]
 c                     [ 0  I]
 
+      if (iwarm .eq. 1 .and. iter .eq. 0) then
+c          first iteration of a warm start: form WN1 for the current
+c          free variables and factorize K from scratch.
+         call formw1(n,nfree,index,m,ws,wy,col,head,snd)
+         nenter = 0
+         ileave = n + 1
+         wrk = .true.
+      endif
       if (wrk) call formk(n,nfree,index,nenter,ileave,indx2,iupdat,
-     +                 updatd,wn,snd,m,ws,wy,sy,theta,col,head,info)
+     +                 updatd,wn,snd,m,ws,wy,sy,theta,col,head,nchg,
+     +                 info)
       if (info .ne. 0) then
 c          nonpositive definiteness in Cholesky factorization;
 c          refresh the lbfgs memory and restart the iteration.
@@ -778,14 +834,20 @@ cccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccccc
 
 c     Generate the search direction d:=z-x.
 
+!$omp parallel do if(n .gt. ompmin)
       do 40 i = 1, n
          d(i) = z(i) - x(i)
   40  continue
+!$omp end parallel do
       call timer(cpu1)
  666  continue
+c          the first step of a warm start uses the quasi-Newton length.
+      itls = iter
+      if (iwarm .eq. 1 .and. iter .eq. 0 .and. col .gt. 0) itls = 1
       call lnsrlb(n,l,u,nbd,x,f,fold,gd,gdold,g,d,r,t,z,stp,dnorm,
-     +            dtd,xstep,stpmx,iter,ifun,iback,nfgv,info,task,
-     +            boxed,cnstnd,csave,isave(22),dsave(17))
+     +            dtd,xstep,stpmx,itls,ifun,iback,nfgv,info,task,
+     +            boxed,cnstnd,csave,isave(22),dsave(17),
+     +            iopt(opt_line_search),dopt,iprint)
       if (info .ne. 0 .or. iback .ge. 20) then
 c          restore the previous iterate.
          call dcopy(n,t,1,x,1)
@@ -800,7 +862,7 @@ c                restore the actual number of f and g evaluations etc.
                ifun = ifun - 1
                iback = iback - 1
             endif
-            task = 'ABNORMAL_TERMINATION_IN_LNSRCH'
+            task = task_abnormal
             iter = iter + 1
             goto 999
          else
@@ -813,12 +875,12 @@ c             refresh the lbfgs memory and restart the iteration.
             theta  = one
             iupdat = 0
             updatd = .false.
-            task   = 'RESTART_FROM_LNSRCH'
+            task   = task_restart
             call timer(cpu2)
             lnscht = lnscht + cpu2 - cpu1
             goto 222
          endif
-      else if (task(1:5) .eq. 'FG_LN') then
+      else if (task .eq. task_fg_lnsrch) then
 c          return to the driver for calculating f and g; reenter at 666.
          goto 1000
       else
@@ -843,14 +905,14 @@ c     Test for termination.
 
       if (sbgnrm .le. pgtol) then
 c                                terminate the algorithm.
-         task = 'CONVERGENCE: NORM_OF_PROJECTED_GRADIENT_<=_PGTOL'
+         task = task_conv_pgtol
          goto 999
       endif
 
       ddum = max(abs(fold), abs(f), one)
       if ((fold - f) .le. tol*ddum) then
 c                                        terminate the algorithm.
-         task = 'CONVERGENCE: REL_REDUCTION_OF_F_<=_FACTR*EPSMCH'
+         task = task_conv_factr
          if (iback .ge. 10) info = -5
 c           i.e., to issue a warning if iback>10 in the line search.
          goto 999
@@ -858,9 +920,11 @@ c           i.e., to issue a warning if iback>10 in the line search.
 
 c     Compute d=newx-oldx, r=newg-oldg, rr=y'y and dr=y's.
 
+!$omp parallel do if(n .gt. ompmin)
       do 42 i = 1, n
          r(i) = g(i) - r(i)
   42  continue
+!$omp end parallel do
       rr = ddot(n,r,1,r,1)
       if (stp .eq. one) then
          dr = gd - gdold
@@ -871,7 +935,16 @@ c     Compute d=newx-oldx, r=newg-oldg, rr=y'y and dr=y's.
          ddum = -gdold*stp
       endif
 
-      if (dr .le. epsmch*ddum) then
+c     Backtracking steps may fail the curvature condition
+c       g(x+stp*d)'d >= gtol*g(x)'d; skip the pairs that fail it.
+
+      sytol = epsmch
+      if (iopt(opt_line_search) .eq. 1) then
+         sytol = one - p9
+         if (dopt(dopt_gtol) .gt. zero) sytol = one - dopt(dopt_gtol)
+      endif
+
+      if (dr .le. sytol*ddum) then
 c                            skip the L-BFGS update.
          nskip = nskip + 1
          updatd = .false.
@@ -940,6 +1013,7 @@ c     Save local variables.
       lsave(4)  = updatd
 
       isave(1)  = nintol
+      isave(2)  = iwarm
       isave(3)  = itfile
       isave(4)  = iback
       isave(5)  = nskip
@@ -948,6 +1022,7 @@ c     Save local variables.
       isave(8)  = itail
       isave(9)  = iter
       isave(10) = iupdat
+      isave(11) = nchg
       isave(12) = nseg
       isave(13) = nfgv
       isave(14) = info
@@ -1220,9 +1295,9 @@ c======================== The end of bmv ===============================
 
       subroutine cauchy(n, x, l, u, nbd, g, iorder, iwhere, t, d, xcp,
      +                  m, wy, ws, sy, wt, theta, col, head, p, c, wbp,
-     +                  v, nseg, iprint, sbgnrm, info, epsmch)
+     +                  v, nseg, iprint, sbgnrm, info, epsmch, ibrk)
       implicit none
-      integer          n, m, head, col, nseg, iprint, info,
+      integer          n, m, head, col, nseg, iprint, info, ibrk,
      +                 nbd(n), iorder(n), iwhere(n)
       double precision theta, epsmch,
      +                 x(n), l(n), u(n), g(n), t(n), d(n), xcp(n),
@@ -1373,9 +1448,16 @@ c       On exit info = 0       for normal return,
 c                    = nonzero for abnormal return when the the system
 c                              used in routine bmv is singular.
 c
+c     ibrk is an integer variable.
+c       On entry ibrk selects how the breakpoints are ordered:
+c         ibrk = 0 keeps all of them in a heap (hpsolb);
+c         ibrk = 1 selects them in batches of increasing size (bpsel)
+c                  and keeps only the current batch in a heap.
+c       On exit ibrk is unchanged.
+c
 c     Subprograms called:
 c
-c       L-BFGS-B Library ... hpsolb, bmv.
+c       L-BFGS-B Library ... hpsolb, bpsel, bmv.
 c
 c       Linpack ... dscal dcopy, daxpy.
 c
@@ -1408,12 +1490,13 @@ c     ************
 
       logical          xlower,xupper,bnded
       integer          i,j,col2,nfree,nbreak,pointr,
-     +                 ibp,nleft,ibkmin,iter
+     +                 ibp,nleft,ibkmin,iter,kbatch,nbatch,ibase,kbmin
       double precision f1,f2,dt,dtm,tsum,dibp,zibp,dibp2,bkmin,
      +                 tu,tl,wmc,wmp,wmw,ddot,tj,tj0,neggi,sbgnrm,
      +                 f2_org
       double precision one,zero
       parameter        (one=1.0d0,zero=0.0d0)
+      parameter        (kbmin=1024)
 
 c     Check the status of the variables, reset iwhere(i) if necessary;
 c       compute the Cauchy direction d and the breakpoints t; initialize
@@ -1433,14 +1516,8 @@ c       the derivative f1 and the vector p = W'd (for theta = 1).
       f1 = zero
       if (iprint .ge. 99) write (6,3010)
 
-c     We set p to zero and build it up as we determine d.
-
-      do 20 i = 1, col2
-         p(i) = zero
-  20  continue
-
 c     In the following loop we determine for each variable its bound
-c        status and its breakpoint, and update p accordingly.
+c        status and its breakpoint.
 c        Smallest breakpoint is identified.
 
       do 50 i = 1, n
@@ -1466,18 +1543,11 @@ c              reset iwhere(i).
                if (abs(neggi) .le. zero) iwhere(i) = -3
             endif
          endif
-         pointr = head
          if (iwhere(i) .ne. 0 .and. iwhere(i) .ne. -1) then
             d(i) = zero
          else
             d(i) = neggi
             f1 = f1 - neggi*neggi
-c             calculate p := p - W'e_i* (g_i).
-            do 40 j = 1, col
-               p(j) = p(j) +  wy(i,pointr)* neggi
-               p(col + j) = p(col + j) + ws(i,pointr)*neggi
-               pointr = mod(pointr,m) + 1
-  40        continue
             if (nbd(i) .le. 2 .and. nbd(i) .ne. 0
      +                        .and. neggi .lt. zero) then
 c                                 x(i) + d(i) is bounded; compute t(i).
@@ -1506,6 +1576,11 @@ c                x(i) + d(i) is not bounded.
          endif
   50  continue
 
+c     p := W'd, in a single pass over the corrections (d is zero for
+c       the variables at bound).
+
+      call wtprd(n,m,ws,wy,col,head,d,p,1,p(col+1),1)
+
 c     The indices of the nonzero components of d are now stored
 c       in iorder(1),...,iorder(nbreak) and iorder(nfree),...,iorder(n).
 c       The smallest of the nbreak breakpoints is in t(ibkmin)=bkmin.
@@ -1552,6 +1627,9 @@ c     If there are no breakpoints, locate the GCP and return.
 
       nleft = nbreak
       iter = 1
+      kbatch = 0
+      nbatch = 0
+      ibase = 1
 
 
       tj = zero
@@ -1581,7 +1659,25 @@ c             breakpoint numbered nbreak > nlast, before heapsort call.
 c        Update heap structure of breakpoints
 c           (if iter=2, initialize heap).
          endif
-         call hpsolb(nleft,t,iorder,iter-2)
+         if (ibrk .eq. 1) then
+c           Bulk selection: move the next kbatch smallest breakpoints
+c             to t(nleft-kbatch+1),...,t(nleft) and keep only them in
+c             the heap. The batches grow geometrically, so that only a
+c             few selections are needed when many intervals are
+c             explored.
+            if (nbatch .eq. 0) then
+               kbatch = min(max(2*kbatch,nleft/16,kbmin),nleft)
+               call bpsel(nleft,t,iorder,kbatch)
+               nbatch = kbatch
+               ibase = nleft - kbatch + 1
+               call hpsolb(nbatch,t(ibase),iorder(ibase),0)
+            else
+               call hpsolb(nbatch,t(ibase),iorder(ibase),1)
+            endif
+            nbatch = nbatch - 1
+         else
+            call hpsolb(nleft,t,iorder,iter-2)
+         endif
          tj = t(nleft)
          ibp = iorder(nleft)
       endif
@@ -1749,33 +1845,30 @@ c
 c
 c     ************
 
-      integer          i,j,k,pointr
-      double precision a1,a2
+      include 'lbfgsb_parallel.inc'
+
+      integer          i,k
 
       if (.not. cnstnd .and. col .gt. 0) then
+!$omp parallel do if(n .gt. ompmin)
          do 26 i = 1, n
             r(i) = -g(i)
   26     continue
+!$omp end parallel do
       else
+!$omp parallel do private(k) if(nfree .gt. ompmin)
          do 30 i = 1, nfree
             k = index(i)
             r(i) = -theta*(z(k) - x(k)) - g(k)
   30     continue
+!$omp end parallel do
          call bmv(m,sy,wt,col,wa(2*m+1),wa(1),info)
          if (info .ne. 0) then
             info = -8
             return
          endif
-         pointr = head
-         do 34 j = 1, col
-            a1 = wa(j)
-            a2 = theta*wa(col + j)
-            do 32 i = 1, nfree
-               k = index(i)
-               r(i) = r(i) + wy(k,pointr)*a1 + ws(k,pointr)*a2
-  32        continue
-            pointr = mod(pointr,m) + 1
-  34     continue
+         call dscal(col,theta,wa(col+1),1)
+         call wzprd(n,m,ws,wy,col,head,nfree,index,wa(1),wa(col+1),r)
       endif
 
       return
@@ -1786,9 +1879,9 @@ c======================= The end of cmprlb =============================
 
       subroutine errclb(n, m, factr, l, u, nbd, task, info, k)
 
-      character*60     task
-      integer          n, m, info, k, nbd(n)
+      integer          n, m, task, info, k, nbd(n)
       double precision factr, l(n), u(n)
+      include 'lbfgsb_codes.inc'
 
 c     ************
 c
@@ -1815,23 +1908,23 @@ c     ************
 
 c     Check the input arguments for errors.
 
-      if (n .le. 0) task = 'ERROR: N .LE. 0'
-      if (m .le. 0) task = 'ERROR: M .LE. 0'
-      if (factr .lt. zero) task = 'ERROR: FACTR .LT. 0'
+      if (n .le. 0) task = task_error_n
+      if (m .le. 0) task = task_error_m
+      if (factr .lt. zero) task = task_error_factr
 
 c     Check the validity of the arrays nbd(i), u(i), and l(i).
 
       do 10 i = 1, n
          if (nbd(i) .lt. 0 .or. nbd(i) .gt. 3) then
 c                                                   return
-            task = 'ERROR: INVALID NBD'
+            task = task_error_nbd
             info = -6
             k = i
          endif
          if (nbd(i) .eq. 2) then
             if (l(i) .gt. u(i)) then
 c                                    return
-               task = 'ERROR: NO FEASIBLE SOLUTION'
+               task = task_error_feasible
                info = -7
                k = i
             endif
@@ -1846,10 +1939,10 @@ c======================= The end of errclb =============================
 
       subroutine formk(n, nsub, ind, nenter, ileave, indx2, iupdat,
      +                 updatd, wn, wn1, m, ws, wy, sy, theta, col,
-     +                 head, info)
+     +                 head, nchg, info)
 
       integer          n, nsub, m, col, head, nenter, ileave, iupdat,
-     +                 info, ind(n), indx2(n)
+     +                 nchg, info, ind(n), indx2(n)
       double precision theta, wn(2*m, 2*m), wn1(2*m, 2*m),
      +                 ws(n, m), wy(n, m), sy(m, m)
       logical          updatd
@@ -1941,14 +2034,27 @@ c         col is the number of variable metric corrections stored;
 c         head is the location of the 1st s- (or y-) vector in S (or Y).
 c       On exit they are unchanged.
 c
+c     nchg is an integer variable.
+c       On entry nchg is the number of variables that have entered or
+c         left the free set since WN1 was last formed from scratch.
+c       On exit nchg is updated.
+c
 c     info is an integer variable.
 c       On entry info is unspecified.
 c       On exit info =  0 for normal return;
 c                    = -1 when the 1st Cholesky factorization failed;
 c                    = -2 when the 2st Cholesky factorization failed.
 c
+c     WN1 is updated with the products over the entering and leaving
+c       variables only (see wgram). The rounding errors of the updates
+c       accumulate, so WN1 is formed from scratch (formw1) once more
+c       than n variables have entered or left the free set, and before
+c       reporting a failed factorization of an updated WN1.
+c
 c     Subprograms called:
 c
+c       L-BFGS-B Library ... formw1, wgram.
+c
 c       Linpack ... dcopy, dpofa, dtrsl.
 c
 c
@@ -1977,9 +2083,10 @@ c
 c
 c     ************
 
+      logical          fresh
       integer          m2,ipntr,jpntr,iy,is,jy,js,is1,js1,k1,i,k,
      +                 col2,pbegin,pend,dbegin,dend,upcl
-      double precision ddot,temp1,temp2,temp3,temp4
+      double precision ddot,temp1,temp2,temp3
       double precision one,zero
       parameter        (one=1.0d0,zero=0.0d0)
 
@@ -1989,6 +2096,15 @@ c                     [L_a+R_z   S'AA'S   ]
 c        where L_a is the strictly lower triangular part of S'AA'Y
 c              R_z is the upper triangular part of S'ZZ'Y.
 
+      m2 = 2*m
+      nchg = nchg + nenter + n + 1 - ileave
+      fresh = nchg .gt. n
+      if (fresh) then
+         call formw1(n,nsub,ind,m,ws,wy,col,head,wn1)
+         nchg = 0
+         goto 62
+      endif
+
       if (updatd) then
          if (iupdat .gt. m) then
 c                                 shift old part of WN1.
@@ -2053,64 +2169,42 @@ c             compute element i of column 'col' of R_z
          upcl = col
       endif
 
-c       modify the old parts in blocks (1,1) and (2,2) due to changes
-c       in the set of free variables.
-      ipntr = head
-      do 45 iy = 1, upcl
-         is = m + iy
-         jpntr = head
-         do 40 jy = 1, iy
-            js = m + jy
-            temp1 = zero
-            temp2 = zero
-            temp3 = zero
-            temp4 = zero
-            do 35 k = 1, nenter
-               k1 = indx2(k)
-               temp1 = temp1 + wy(k1,ipntr)*wy(k1,jpntr)
-               temp2 = temp2 + ws(k1,ipntr)*ws(k1,jpntr)
+c       modify the old parts in blocks (1,1), (2,1) and (2,2) due to
+c       changes in the set of free variables. The products over the
+c       entering minus those over the leaving variables are formed in
+c       the lower triangle of wn, whose columns 1 to upcl hold Y and
+c       upcl+1 to 2*upcl hold S.
+      if (upcl .gt. 0 .and. (nenter .gt. 0 .or. ileave .le. n)) then
+         do 40 jy = 1, 2*upcl
+            do 35 iy = jy, 2*upcl
+               wn(iy,jy) = zero
   35        continue
-            do 36 k = ileave, n
-               k1 = indx2(k)
-               temp3 = temp3 + wy(k1,ipntr)*wy(k1,jpntr)
-               temp4 = temp4 + ws(k1,ipntr)*ws(k1,jpntr)
-  36        continue
-            wn1(iy,jy) = wn1(iy,jy) + temp1 - temp3
-            wn1(is,js) = wn1(is,js) - temp2 + temp4
-            jpntr = mod(jpntr,m) + 1
   40     continue
-         ipntr = mod(ipntr,m) + 1
-  45  continue
-
-c       modify the old parts in block (2,1).
-      ipntr = head
-      do 60 is = m + 1, m + upcl
-         jpntr = head
-         do 55 jy = 1, upcl
-            temp1 = zero
-            temp3 = zero
-            do 50 k = 1, nenter
-               k1 = indx2(k)
-               temp1 = temp1 + ws(k1,ipntr)*wy(k1,jpntr)
+         call wgram(n,m,ws,wy,upcl,head,nenter,indx2,one,wn,m2)
+         if (ileave .le. n) call wgram(n,m,ws,wy,upcl,head,
+     +                                 n+1-ileave,indx2(ileave),
+     +                                 -one,wn,m2)
+         do 55 iy = 1, upcl
+            is = m + iy
+            do 45 jy = 1, iy
+               js = m + jy
+               wn1(iy,jy) = wn1(iy,jy) + wn(iy,jy)
+               wn1(is,js) = wn1(is,js) - wn(upcl+iy,upcl+jy)
+  45        continue
+            do 50 jy = 1, upcl
+               if (iy .le. jy) then
+                  wn1(is,jy) = wn1(is,jy) + wn(upcl+iy,jy)
+               else
+                  wn1(is,jy) = wn1(is,jy) - wn(upcl+iy,jy)
+               endif
   50        continue
-            do 51 k = ileave, n
-               k1 = indx2(k)
-               temp3 = temp3 + ws(k1,ipntr)*wy(k1,jpntr)
-  51        continue
-         if (is .le. jy + m) then
-               wn1(is,jy) = wn1(is,jy) + temp1 - temp3
-            else
-               wn1(is,jy) = wn1(is,jy) - temp1 + temp3
-            endif
-            jpntr = mod(jpntr,m) + 1
   55     continue
-         ipntr = mod(ipntr,m) + 1
-  60  continue
+      endif
 
 c     Form the upper triangle of WN = [D+Y' ZZ'Y/theta   -L_a'+R_z' ]
 c                                     [-L_a +R_z        S'AA'S*theta]
 
-      m2 = 2*m
+  62  continue
       do 70 iy = 1, col
          is = col + iy
          is1 = m + iy
@@ -2136,6 +2230,7 @@ c        first Cholesky factor (1,1) block of wn to get LL'
 c                          with L' stored in the upper triangle of wn.
       call dpofa(wn,m2,col,info)
       if (info .ne. 0) then
+         if (.not. fresh) goto 80
          info = -1
          return
       endif
@@ -2159,16 +2254,151 @@ c     Cholesky factorization of (2,2) block of wn.
 
       call dpofa(wn(col+1,col+1),m2,col,info)
       if (info .ne. 0) then
+         if (.not. fresh) goto 80
          info = -2
          return
       endif
 
       return
 
+c     The factorization of the updated WN1 failed: form WN1 from
+c       scratch and try again.
+
+  80  continue
+      call formw1(n,nsub,ind,m,ws,wy,col,head,wn1)
+      nchg = 0
+      fresh = .true.
+      goto 62
+
       end
 
 c======================= The end of formk ==============================
 
+      subroutine formw1(n, nsub, ind, m, ws, wy, col, head, wn1)
+
+      integer          n, nsub, m, col, head, ind(n)
+      double precision wn1(2*m, 2*m), ws(n, m), wy(n, m)
+
+c     ************
+c
+c     Subroutine formw1
+c
+c     This subroutine forms from scratch the lower triangular part of
+c
+c               WN1 = [Y' ZZ'Y   L_a'+R_z']
+c                     [L_a+R_z   S'AA'S   ]
+c
+c       for the free variables ind(1),...,ind(nsub) and the active
+c       variables ind(nsub+1),...,ind(n). It is used in the first
+c       iteration of a warm start, when WN1 was formed by a previous
+c       run for a different set of free variables, and by formk when
+c       the updates of WN1 may have accumulated rounding errors.
+c
+c     The row and column formulas are those of subroutine formk.
+c
+c     ************
+
+      integer          iy,is,jy,js,col2
+      double precision one,zero
+      parameter        (one=1.0d0,zero=0.0d0)
+      double precision, allocatable :: gf(:,:), ga(:,:)
+
+      if (col .eq. 0) return
+      col2 = 2*col
+      allocate(gf(col2,col2), ga(col2,col2))
+      do 20 jy = 1, col2
+         do 10 iy = jy, col2
+            gf(iy,jy) = zero
+            ga(iy,jy) = zero
+  10     continue
+  20  continue
+
+c     Products over the free (Y'ZZ'Y and S'ZZ'Y) and over the active
+c       variables (S'AA'S and S'AA'Y).
+
+      call wgram(n,m,ws,wy,col,head,nsub,ind,one,gf,col2)
+      if (nsub .lt. n) call wgram(n,m,ws,wy,col,head,n-nsub,
+     +                            ind(nsub+1),one,ga,col2)
+
+      do 50 iy = 1, col
+         is = m + iy
+         do 30 jy = 1, iy
+            js = m + jy
+            wn1(iy,jy) = gf(iy,jy)
+            wn1(is,js) = ga(col+iy,col+jy)
+  30     continue
+         do 40 jy = 1, col
+            if (iy .le. jy) then
+               wn1(is,jy) = gf(col+iy,jy)
+            else
+               wn1(is,jy) = ga(col+iy,jy)
+            endif
+  40     continue
+  50  continue
+      deallocate(gf, ga)
+
+      return
+
+      end
+
+c======================= The end of formw1 =============================
+
+      subroutine wgram(n, m, ws, wy, ncol, head, nk, ind, sgn, g, ldg)
+
+      integer          n, m, ncol, head, nk, ldg, ind(nk)
+      double precision sgn, ws(n, m), wy(n, m), g(ldg, 2*ncol)
+
+c     ************
+c
+c     Subroutine wgram
+c
+c     This subroutine adds sgn times the products W_K'W_K to the lower
+c       triangle of the 2*ncol x 2*ncol matrix g, where W_K holds the
+c       rows ind(1),...,ind(nk) of
+c
+c               W = [wy(.,p(1)) ... wy(.,p(ncol)) ws(.,p(1)) ...]
+c
+c       with p(j) = mod(head+j-2,m)+1. Thus g holds Y'Y, S'Y and S'S
+c       for the selected rows in its blocks (1,1), (2,1) and (2,2).
+c
+c     The rows are gathered in blocks of nb into a contiguous buffer,
+c       so that each row of ws and wy is read once instead of once per
+c       product.
+c
+c     ************
+
+      integer          nb
+      parameter        (nb = 256)
+      integer          i,j,k,kb,len,pointr
+      double precision ddot
+      double precision, allocatable :: wb(:,:)
+
+      if (nk .le. 0 .or. ncol .le. 0) return
+      allocate(wb(nb,2*ncol))
+      do 40 kb = 1, nk, nb
+         len = min(nb, nk - kb + 1)
+         pointr = head
+         do 20 j = 1, ncol
+            do 10 k = 1, len
+               wb(k,j) = wy(ind(kb+k-1),pointr)
+               wb(k,ncol+j) = ws(ind(kb+k-1),pointr)
+  10        continue
+            pointr = mod(pointr,m) + 1
+  20     continue
+         do 35 j = 1, 2*ncol
+            do 30 i = j, 2*ncol
+               g(i,j) = g(i,j) + sgn*ddot(len,wb(1,i),1,wb(1,j),1)
+  30        continue
+  35     continue
+  40  continue
+      deallocate(wb)
+
+      return
+
+      end
+
+c======================= The end of wgram ==============================
+
       subroutine formt(m, wt, sy, ss, col, theta, info)
 
       integer          m, col, info
@@ -2449,18 +2679,211 @@ c     Put the least member in t(n).
 
 c====================== The end of hpsolb ==============================
 
+      subroutine bpsel(n, t, iorder, k)
+      integer          n, k, iorder(n)
+      double precision t(n)
+
+c     ************
+c
+c     Subroutine bpsel
+c
+c     This subroutine moves the k smallest elements of t to t(n-k+1)
+c       to t(n), in no particular order, and the remaining elements to
+c       t(1) to t(n-k).
+c
+c     n is an integer variable.
+c       On entry n is the dimension of the arrays t and iorder.
+c       On exit n is unchanged.
+c
+c     t is a double precision array of dimension n.
+c       On entry t stores the elements to be selected.
+c       On exit t is partitioned as described above.
+c
+c     iorder is an integer array of dimension n.
+c       On entry iorder(i) is the index of t(i).
+c       On exit iorder(i) is still the index of t(i), but iorder is
+c         permuted in accordance with t.
+c
+c     k is an integer variable.
+c       On entry k is the number of elements to select, 0 <= k <= n.
+c       On exit k is unchanged.
+c
+c     The selection is a quickselect whose pivots are taken from a
+c       sorted sample, slightly above the k-th element, so that most
+c       selections need a single pass over t. Each pass partitions
+c       chunks of lchunk elements in place, in parallel in OpenMP
+c       builds, and then swaps the elements left on the wrong side.
+c       The result does not depend on the number of threads.
+c
+c     ************
+
+      include 'lbfgsb_parallel.inc'
+
+      integer          nsamp
+      parameter        (nsamp = 127)
+      logical          lesseq
+      integer          lo,hi,ns,nl,len,nchunk,ic,ib,ie,i,j,is,
+     +                 ic1,ie1,i1,ic2,ib2,ie2,i2,itmp
+      double precision pivot,tmp,samp(nsamp)
+      integer, allocatable :: cnt(:)
+
+c     The elements t(1) to t(lo-1) are not smaller and t(hi+1) to t(n)
+c       are not larger than t(lo) to t(hi); the selection ends when the
+c       boundary ns lies outside of this range.
+
+      ns = n - k
+      lo = 1
+      hi = n
+      if (ns .lt. lo .or. ns .ge. hi) return
+      allocate(cnt((n + lchunk - 1)/lchunk))
+
+  10  continue
+
+c     Choose the pivot from an evenly spaced sample of t(lo) to t(hi),
+c       sorted by insertion.
+
+      len = hi - lo + 1
+      is = min(nsamp, len)
+      do 30 i = 1, is
+         tmp = t(lo + (i - 1)*(len/is))
+         j = i - 1
+  20     continue
+         if (j .ge. 1) then
+            if (samp(j) .gt. tmp) then
+               samp(j + 1) = samp(j)
+               j = j - 1
+               goto 20
+            endif
+         endif
+         samp(j + 1) = tmp
+  30  continue
+      i = int(dble(hi - ns)/dble(len)*dble(is)) + 2
+      pivot = samp(min(i, is))
+      lesseq = .false.
+      nchunk = (len - 1)/lchunk + 1
+
+c     Move the elements smaller than the pivot (not larger if lesseq)
+c       to the end of each chunk; cnt(ic) is their number.
+
+  40  continue
+!$omp parallel do private(ib,ie,i,j,tmp,itmp) if(len .gt. ompmin)
+      do 70 ic = 1, nchunk
+         ib = lo + (ic - 1)*lchunk
+         ie = min(ib + lchunk - 1, hi)
+         i = ib
+         j = ie
+  50     continue
+         if (i .le. j) then
+            if (.not. (t(i) .lt. pivot .or.
+     +          (lesseq .and. t(i) .eq. pivot))) then
+               i = i + 1
+               goto 50
+            endif
+         endif
+  60     continue
+         if (i .le. j) then
+            if (t(j) .lt. pivot .or. (lesseq .and. t(j) .eq. pivot))
+     +         then
+               j = j - 1
+               goto 60
+            endif
+         endif
+         if (i .lt. j) then
+            tmp = t(i)
+            t(i) = t(j)
+            t(j) = tmp
+            itmp = iorder(i)
+            iorder(i) = iorder(j)
+            iorder(j) = itmp
+            i = i + 1
+            j = j - 1
+            goto 50
+         endif
+         cnt(ic) = ie - j
+  70  continue
+!$omp end parallel do
+
+      nl = 0
+      do 80 ic = 1, nchunk
+         nl = nl + cnt(ic)
+  80  continue
+      if (nl .eq. 0) then
+c        The pivot is the smallest element: select the elements equal
+c          to it, unless the pivot is not a number.
+         if (lesseq .or. pivot .ne. pivot) goto 120
+         lesseq = .true.
+         goto 40
+      endif
+      if (nl .eq. len) goto 120
+
+c     Swap the selected elements before hi-nl+1 with the remaining
+c       ones after hi-nl, in increasing order of position.
+
+      ic1 = 1
+      ie1 = min(lo + lchunk - 1, hi)
+      i1 = ie1 - cnt(1) + 1
+      ic2 = (hi - nl - lo + 1)/lchunk + 1
+      ib2 = lo + (ic2 - 1)*lchunk
+      ie2 = min(ib2 + lchunk - 1, hi) - cnt(ic2)
+      i2 = max(hi - nl + 1, ib2)
+  90  continue
+      if (i1 .gt. ie1) then
+         ic1 = ic1 + 1
+         if (ic1 .gt. nchunk) goto 110
+         ie1 = min(lo + ic1*lchunk - 1, hi)
+         i1 = ie1 - cnt(ic1) + 1
+         goto 90
+      endif
+      if (i1 .gt. hi - nl) goto 110
+ 100  continue
+      if (i2 .gt. ie2) then
+         ic2 = ic2 + 1
+         ib2 = lo + (ic2 - 1)*lchunk
+         ie2 = min(ib2 + lchunk - 1, hi) - cnt(ic2)
+         i2 = ib2
+         goto 100
+      endif
+      tmp = t(i1)
+      t(i1) = t(i2)
+      t(i2) = tmp
+      itmp = iorder(i1)
+      iorder(i1) = iorder(i2)
+      iorder(i2) = itmp
+      i1 = i1 + 1
+      i2 = i2 + 1
+      goto 90
+ 110  continue
+
+c     Continue with the part that contains the boundary.
+
+      if (ns .lt. hi - nl) then
+         hi = hi - nl
+         goto 10
+      else if (ns .gt. hi - nl) then
+         lo = hi - nl + 1
+         goto 10
+      endif
+ 120  continue
+      deallocate(cnt)
+
+      return
+
+      end
+
+c====================== The end of bpsel ===============================
+
       subroutine lnsrlb(n, l, u, nbd, x, f, fold, gd, gdold, g, d, r, t,
      +                  z, stp, dnorm, dtd, xstep, stpmx, iter, ifun,
      +                  iback, nfgv, info, task, boxed, cnstnd, csave,
-     +                  isave, dsave)
+     +                  isave, dsave, ilsrch, dopt, iprint)
 
-      character*60     task, csave
       logical          boxed, cnstnd
-      integer          n, iter, ifun, iback, nfgv, info,
-     +                 nbd(n), isave(2)
+      integer          n, iter, ifun, iback, nfgv, info, task, csave,
+     +                 ilsrch, iprint, nbd(n), isave(2)
       double precision f, fold, gd, gdold, stp, dnorm, dtd, xstep,
      +                 stpmx, x(n), l(n), u(n), g(n), d(n), r(n), t(n),
-     +                 z(n), dsave(13)
+     +                 z(n), dsave(13), dopt(8)
+      include 'lbfgsb_codes.inc'
 c     **********
 c
 c     Subroutine lnsrlb
@@ -2469,10 +2892,22 @@ c     This subroutine calls subroutine dcsrch from the Minpack2 library
 c       to perform the line search.  Subroutine dscrch is safeguarded so
 c       that all trial points lie within the feasible region.
 c
+c     If ilsrch = 1, the step is found instead by backtracking from the
+c       initial step until the sufficient decrease condition holds
+c       (dbtsrch). The tolerances ftol, gtol and xtol of the search and
+c       the maximum step are read from dopt; zero entries select
+c       ftol = 1.0d-3, gtol = 0.9d0, xtol = 0.1d0 and a maximum step of
+c       1.0d+10.
+c
+c     iprint is the output level of setulb: nothing is written if it is
+c       negative.
+c
 c     Subprograms called:
 c
 c       Minpack2 Library ... dcsrch.
 c
+c       L-BFGS-B Library ... dbtsrch.
+c
 c       Linpack ... dtrsl, ddot.
 c
 c
@@ -2493,9 +2928,15 @@ c     **********
       double precision one,zero,big
       parameter        (one=1.0d0,zero=0.0d0,big=1.0d+10)
       double precision ftol,gtol,xtol
-      parameter        (ftol=1.0d-3,gtol=0.9d0,xtol=0.1d0)
 
-      if (task(1:5) .eq. 'FG_LN') goto 556
+      ftol = 1.0d-3
+      gtol = 0.9d0
+      xtol = 0.1d0
+      if (dopt(dopt_ftol) .gt. zero) ftol = dopt(dopt_ftol)
+      if (dopt(dopt_gtol) .gt. zero) gtol = dopt(dopt_gtol)
+      if (dopt(dopt_xtol) .gt. zero) xtol = dopt(dopt_xtol)
+
+      if (task .eq. task_fg_lnsrch) goto 556
 
       dtd = ddot(n,d,1,d,1)
       dnorm = sqrt(dtd)
@@ -2503,9 +2944,10 @@ c     **********
 c     Determine the maximum step length.
 
       stpmx = big
+      if (dopt(dopt_stpmax) .gt. zero) stpmx = dopt(dopt_stpmax)
       if (cnstnd) then
          if (iter .eq. 0) then
-            stpmx = one
+            stpmx = min(one, stpmx)
          else
             do 43 i = 1, n
                a1 = d(i)
@@ -2534,6 +2976,7 @@ c     Determine the maximum step length.
          stp = min(one/dnorm, stpmx)
       else
          stp = one
+         if (dopt(dopt_stpmax) .gt. zero) stp = min(one, stpmx)
       endif
 
       call dcopy(n,x,1,t,1)
@@ -2541,7 +2984,7 @@ c     Determine the maximum step length.
       fold = f
       ifun = 0
       iback = 0
-      csave = 'START'
+      csave = ls_start
  556  continue
       gd = ddot(n,g,1,d,1)
       if (ifun .eq. 0) then
@@ -2549,17 +2992,23 @@ c     Determine the maximum step length.
          if (gd .ge. zero) then
 c                               the directional derivative >=0.
 c                               Line search is impossible.
-            write(6,*)' ascent direction in projection gd = ', gd
+            if (iprint .ge. 0) write(6,*)
+     +         ' ascent direction in projection gd = ', gd
             info = -4
             return
          endif
       endif
 
-      call dcsrch(f,gd,stp,ftol,gtol,xtol,zero,stpmx,csave,isave,dsave)
+      if (ilsrch .eq. 1) then
+         call dbtsrch(f,gd,stp,ftol,gtol,stpmx,csave,dsave)
+      else
+         call dcsrch(f,gd,stp,ftol,gtol,xtol,zero,stpmx,csave,isave,
+     +               dsave)
+      endif
 
       xstep = stp*dnorm
-      if (csave(1:4) .ne. 'CONV' .and. csave(1:4) .ne. 'WARN') then
-         task = 'FG_LNSRCH'
+      if (csave .lt. ls_conv .or. csave .gt. ls_warn_stpmin) then
+         task = task_fg_lnsrch
          ifun = ifun + 1
          nfgv = nfgv + 1
          iback = ifun - 1
@@ -2571,7 +3020,7 @@ c                               Line search is impossible.
   41        continue
          endif
       else
-         task = 'NEW_X'
+         task = task_new_x
       endif
 
       return
@@ -2611,8 +3060,7 @@ c
 c
 c     ************
 
-      integer          j,pointr
-      double precision ddot
+      integer          j
       double precision one
       parameter        (one=1.0d0)
 
@@ -2648,12 +3096,7 @@ c                              move old information
       endif
 c        add new information: the last row of SY
 c                                             and the last column of SS:
-      pointr = head
-      do 51 j = 1, col - 1
-         sy(col,j) = ddot(n,d,1,wy(1,pointr),1)
-         ss(j,col) = ddot(n,ws(1,pointr),1,d,1)
-         pointr = mod(pointr,m) + 1
-  51  continue
+      call wtprd(n,m,ws,wy,col-1,head,d,sy(col,1),m,ss(1,col),1)
       if (stp .eq. one) then
          ss(col,col) = dtd
       else
@@ -2811,10 +3254,9 @@ c======================= The end of prn2lb =============================
      +                  time, nseg, word, iback, stp, xstep, k,
      +                  cachyt, sbtime, lnscht)
 
-      character*60     task
       character*3      word
-      integer          n, iprint, info, itfile, iter, nfgv, nintol,
-     +                 nskip, nact, nseg, iback, k
+      integer          n, iprint, task, info, itfile, iter, nfgv,
+     +                 nintol, nskip, nact, nseg, iback, k
       double precision f, sbgnrm, time, stp, xstep, cachyt, sbtime,
      +                 lnscht, x(n)
 
@@ -2840,8 +3282,11 @@ c
 c     ************
 
       integer i
+      character*60 msg
+      include 'lbfgsb_codes.inc'
 
-      if (task(1:5) .eq. 'ERROR') goto 999
+      if (task .ge. task_error_n .and. task .le. task_error_feasible)
+     +   goto 999
 
       if (iprint .ge. 0) then
          write (6,3003)
@@ -2854,7 +3299,8 @@ c     ************
       endif
  999  continue
       if (iprint .ge. 0) then
-         write (6,3009) task
+         call tskmsg(task, msg)
+         write (6,3009) msg
          if (info .ne. 0) then
             if (info .eq. -1) write (6,9011)
             if (info .eq. -2) write (6,9012)
@@ -2874,7 +3320,7 @@ c     ************
                write (itfile,3002)
      +             iter,nfgv,nseg,nact,word,iback,stp,xstep
             endif
-            write (itfile,3009) task
+            write (itfile,3009) msg
             if (info .ne. 0) then
                if (info .eq. -1) write (itfile,9011)
                if (info .eq. -2) write (itfile,9012)
@@ -2938,6 +3384,64 @@ c     ************
 
 c======================= The end of prn3lb =============================
 
+      subroutine tskmsg(task, msg)
+
+      integer          task
+      character*60     msg
+      include 'lbfgsb_codes.inc'
+
+c     ************
+c
+c     Subroutine tskmsg
+c
+c     This subroutine returns in msg the message printed for the
+c       task code task.
+c
+c     ************
+
+      select case (task)
+         case (task_start)
+            msg = 'START'
+         case (task_new_x)
+            msg = 'NEW_X'
+         case (task_fg_start)
+            msg = 'FG_START'
+         case (task_fg_lnsrch)
+            msg = 'FG_LNSRCH'
+         case (task_restart)
+            msg = 'RESTART_FROM_LNSRCH'
+         case (task_conv_pgtol)
+            msg = 'CONVERGENCE: NORM_OF_PROJECTED_GRADIENT_<=_PGTOL'
+         case (task_conv_factr)
+            msg = 'CONVERGENCE: REL_REDUCTION_OF_F_<=_FACTR*EPSMCH'
+         case (task_abnormal)
+            msg = 'ABNORMAL_TERMINATION_IN_LNSRCH'
+         case (task_error_n)
+            msg = 'ERROR: N .LE. 0'
+         case (task_error_m)
+            msg = 'ERROR: M .LE. 0'
+         case (task_error_factr)
+            msg = 'ERROR: FACTR .LT. 0'
+         case (task_error_nbd)
+            msg = 'ERROR: INVALID NBD'
+         case (task_error_feasible)
+            msg = 'ERROR: NO FEASIBLE SOLUTION'
+         case (task_warm_start)
+            msg = 'WARM_START'
+         case (task_stop)
+            msg = 'STOP'
+         case (task_stop_cpu)
+            msg = 'STOP: CPU'
+         case default
+            msg = 'UNKNOWN TASK'
+      end select
+
+      return
+
+      end
+
+c======================= The end of tskmsg =============================
+
       subroutine projgr(n, l, u, nbd, x, g, sbgnrm)
 
       integer          n, nbd(n)
@@ -2963,12 +3467,15 @@ c
 c
 c     ************
 
+      include 'lbfgsb_parallel.inc'
+
       integer i
       double precision gi
       double precision one,zero
       parameter        (one=1.0d0,zero=0.0d0)
 
       sbgnrm = zero
+!$omp parallel do private(gi) reduction(max:sbgnrm) if(n .gt. ompmin)
       do 15 i = 1, n
         gi = g(i)
         if (nbd(i) .ne. 0) then
@@ -2980,6 +3487,7 @@ c     ************
         endif
         sbgnrm = max(sbgnrm,abs(gi))
   15  continue
+!$omp end parallel do
 
       return
 
@@ -3177,7 +3685,9 @@ c
 c
 c     ************
 
-      integer          pointr,m2,col2,ibd,jy,js,i,j,k
+      include 'lbfgsb_parallel.inc'
+
+      integer          m2,col2,ibd,i,k
       double precision alpha, xk, dk, temp1, temp2
       double precision one,zero
       parameter        (one=1.0d0,zero=0.0d0)
@@ -3189,19 +3699,8 @@ c
 
 c     Compute wv = W'Zd.
 
-      pointr = head
-      do 20 i = 1, col
-         temp1 = zero
-         temp2 = zero
-         do 10 j = 1, nsub
-            k = ind(j)
-            temp1 = temp1 + wy(k,pointr)*d(j)
-            temp2 = temp2 + ws(k,pointr)*d(j)
-  10     continue
-         wv(i) = temp1
-         wv(col + i) = theta*temp2
-         pointr = mod(pointr,m) + 1
-  20  continue
+      call wtzprd(n,m,ws,wy,col,head,nsub,ind,d,wv(1),wv(col+1))
+      call dscal(col,theta,wv(col+1),1)
 
 c     Compute wv:=K^(-1)wv.
 
@@ -3217,16 +3716,8 @@ c     Compute wv:=K^(-1)wv.
 
 c     Compute d = (1/theta)d + (1/theta**2)Z'W wv.
 
-      pointr = head
-      do 40 jy = 1, col
-         js = col + jy
-         do 30 i = 1, nsub
-            k = ind(i)
-            d(i) = d(i) + wy(k,pointr)*wv(jy)/theta
-     +                  + ws(k,pointr)*wv(js)
-  30     continue
-         pointr = mod(pointr,m) + 1
-  40  continue
+      call dscal(col,one/theta,wv(1),1)
+      call wzprd(n,m,ws,wy,col,head,nsub,ind,wv(1),wv(col+1),d)
 
       call dscal( nsub, one/theta, d, 1 )
 c
@@ -3237,6 +3728,8 @@ c     Let us try the projection, d is the Newton direction
 
       call dcopy ( n, x, 1, xp, 1 )
 c
+!$omp parallel do private(k,dk,xk) reduction(max:iword)
+!$omp+ if(nsub .gt. ompmin)
       do 50 i=1, nsub
          k  = ind(i)
          dk = d(i)
@@ -3265,6 +3758,7 @@ c
             x(k) = xk + dk
          end if
  50   continue
+!$omp end parallel do
 c
       if ( iword.eq.0 ) then
          go to 911
@@ -3278,8 +3772,10 @@ c
  55   continue
       if ( dd_p .gt.zero ) then
          call dcopy( n, xp, 1, x, 1 )
-         write(6,*) ' Positive dir derivative in projection '
-         write(6,*) ' Using the backtracking step '
+         if (iprint .ge. 0) then
+            write(6,*) ' Positive dir derivative in projection '
+            write(6,*) ' Using the backtracking step '
+         endif
       else
          go to 911
       endif
@@ -3326,10 +3822,12 @@ c
             d(ibd) = zero
          endif
       endif
+!$omp parallel do private(k) if(nsub .gt. ompmin)
       do 70 i = 1, nsub
          k    = ind(i)
          x(k) = x(k) + alpha*d(i)
  70   continue
+!$omp end parallel do
 cccccc
  911  continue
 
@@ -3343,12 +3841,368 @@ cccccc
       end
 c====================== The end of subsm ===============================
 
+      subroutine twolp(n, m, ws, wy, sy, theta, col, head, x, g, z,
+     +                 alpha)
+
+      integer          n, m, col, head
+      double precision theta, ws(n, m), wy(n, m), sy(m, m),
+     +                 x(n), g(n), z(n), alpha(col)
+
+c     ************
+c
+c     Subroutine twolp
+c
+c     This subroutine computes z = x - Hg for problems without bounds,
+c       where H is the inverse of the L-BFGS matrix defined by theta
+c       and the col corrections stored from position head. H is
+c       applied by the two-loop recursion, with H0 = I/theta:
+c
+c          q = -g
+c          for j = col,...,1:  alpha(j) = s_j'q/s_j'y_j,
+c                              q = q - alpha(j)*y_j
+c          q = q/theta
+c          for j = 1,...,col:  beta = y_j'q/s_j'y_j,
+c                              q = q + (alpha(j) - beta)*s_j
+c
+c       The products s_j'y_j are the diagonal of sy. The recursion
+c       makes 4*col passes over n-vectors and does not need the
+c       factorization of the middle matrix (formk), the Cauchy point
+c       or the subspace minimization.
+c
+c     alpha is a double precision working array of dimension col.
+c
+c     ************
+
+      integer          j,pointr
+      double precision beta,ddot
+      double precision one
+      parameter        (one=1.0d0)
+
+c     q is stored in z.
+
+      call dcopy(n,g,1,z,1)
+      call dscal(n,-one,z,1)
+      do 10 j = col, 1, -1
+         pointr = mod(head + j - 2,m) + 1
+         alpha(j) = ddot(n,ws(1,pointr),1,z,1)/sy(j,j)
+         call daxpy(n,-alpha(j),wy(1,pointr),1,z,1)
+  10  continue
+      call dscal(n,one/theta,z,1)
+      do 20 j = 1, col
+         pointr = mod(head + j - 2,m) + 1
+         beta = ddot(n,wy(1,pointr),1,z,1)/sy(j,j)
+         call daxpy(n,alpha(j) - beta,ws(1,pointr),1,z,1)
+  20  continue
+      call daxpy(n,one,x,1,z,1)
+
+      return
+
+      end
+
+c====================== The end of twolp ===============================
+
+      subroutine wtprd(n, m, ws, wy, ncol, head, v, py, incpy,
+     +                 ps, incps)
+
+      integer          n, m, ncol, head, incpy, incps
+      double precision ws(n, m), wy(n, m), v(n), py(*), ps(*)
+
+c     ************
+c
+c     Subroutine wtprd
+c
+c     This subroutine computes the products of v with the ncol
+c       corrections stored from position head,
+c
+c          py(j) = wy(.,pointr)'v,  ps(j) = ws(.,pointr)'v,
+c
+c       with pointr = mod(head+j-2,m)+1, and stores them with
+c       increments incpy and incps.
+c
+c     The corrections are read in a single pass over memory (see
+c       wtprdb). Large problems are split in chunks of lchunk rows,
+c       which are processed in parallel in OpenMP builds. The partial
+c       products of up to mpart corrections and nblk chunks are kept
+c       in a local array, so that no memory is allocated; the chunks
+c       are still added in order.
+c
+c     ************
+
+      include 'lbfgsb_parallel.inc'
+
+      integer          mpart, nblk
+      parameter        (mpart = 32, nblk = 64)
+      integer          nchunk,nc,hd,ic,ic0,icn,ib,ie,j,j0,k,jp,js
+      double precision part(2*mpart,nblk)
+
+      nchunk = (n + lchunk - 1)/lchunk
+      if (nchunk .le. 1) then
+         call wtprdb(n,m,ws,wy,ncol,head,1,n,v,py,incpy,ps,incps)
+         return
+      endif
+
+      do 50 j0 = 1, ncol, mpart
+         nc = min(mpart, ncol - j0 + 1)
+         hd = mod(head + j0 - 2,m) + 1
+         do 40 ic0 = 1, nchunk, nblk
+            icn = min(ic0 + nblk - 1, nchunk)
+!$omp parallel do private(ib,ie,k)
+            do 10 ic = ic0, icn
+               ib = (ic - 1)*lchunk + 1
+               ie = min(ic*lchunk, n)
+               k = ic - ic0 + 1
+               call wtprdb(n,m,ws,wy,nc,hd,ib,ie,v,
+     +                     part(1,k),1,part(nc+1,k),1)
+  10        continue
+!$omp end parallel do
+            do 30 j = j0, j0 + nc - 1
+               jp = 1 + (j-1)*incpy
+               js = 1 + (j-1)*incps
+               do 20 ic = ic0, icn
+                  k = ic - ic0 + 1
+                  if (ic .eq. 1) then
+                     py(jp) = part(j-j0+1,k)
+                     ps(js) = part(nc+j-j0+1,k)
+                  else
+                     py(jp) = py(jp) + part(j-j0+1,k)
+                     ps(js) = ps(js) + part(nc+j-j0+1,k)
+                  endif
+  20           continue
+  30        continue
+  40     continue
+  50  continue
+
+      return
+
+      end
+
+c====================== The end of wtprd ===============================
+
+      subroutine wtprdb(n, m, ws, wy, ncol, head, ib, ie, v, py, incpy,
+     +                  ps, incps)
+
+      integer          n, m, ncol, head, ib, ie, incpy, incps
+      double precision ws(n, m), wy(n, m), v(n), py(*), ps(*)
+
+c     ************
+c
+c     Subroutine wtprdb
+c
+c     This subroutine computes the products of wtprd restricted to the
+c       rows ib,...,ie. The rows are processed in blocks of nb, and
+c       each block of v stays in cache while it is multiplied by the
+c       2*ncol columns.
+c
+c     ************
+
+      integer          nb
+      parameter        (nb = 1024)
+      integer          i,len,j,pointr
+      double precision ddot
+      double precision zero
+      parameter        (zero=0.0d0)
+
+      do 10 j = 1, ncol
+         py(1 + (j-1)*incpy) = zero
+         ps(1 + (j-1)*incps) = zero
+  10  continue
+      do 30 i = ib, ie, nb
+         len = min(nb, ie - i + 1)
+         pointr = head
+         do 20 j = 1, ncol
+            py(1 + (j-1)*incpy) = py(1 + (j-1)*incpy)
+     +                          + ddot(len,wy(i,pointr),1,v(i),1)
+            ps(1 + (j-1)*incps) = ps(1 + (j-1)*incps)
+     +                          + ddot(len,ws(i,pointr),1,v(i),1)
+            pointr = mod(pointr,m) + 1
+  20     continue
+  30  continue
+
+      return
+
+      end
+
+c====================== The end of wtprdb ==============================
+
+      subroutine wtzprd(n, m, ws, wy, ncol, head, nsub, ind, v,
+     +                  py, ps)
+
+      integer          n, m, ncol, head, nsub, ind(nsub)
+      double precision ws(n, m), wy(n, m), v(nsub), py(ncol), ps(ncol)
+
+c     ************
+c
+c     Subroutine wtzprd
+c
+c     This subroutine computes the products W'Zv of the ncol
+c       corrections stored from position head with the vector v of
+c       the subspace of the variables ind(1),...,ind(nsub),
+c
+c          py(j) = sum_i wy(ind(i),pointr)*v(i),
+c          ps(j) = sum_i ws(ind(i),pointr)*v(i).
+c
+c     Large subspaces are split in chunks of lchunk variables, whose
+c       partial products are kept in a local array, as in wtprd.
+c
+c     ************
+
+      include 'lbfgsb_parallel.inc'
+
+      integer          mpart, nblk
+      parameter        (mpart = 32, nblk = 64)
+      integer          nchunk,nc,hd,ic,ic0,icn,ib,ie,j,j0,k
+      double precision part(2*mpart,nblk)
+
+      nchunk = (nsub + lchunk - 1)/lchunk
+      if (nchunk .le. 1) then
+         call wtzprb(n,m,ws,wy,ncol,head,1,nsub,ind,v,py,ps)
+         return
+      endif
+
+      do 50 j0 = 1, ncol, mpart
+         nc = min(mpart, ncol - j0 + 1)
+         hd = mod(head + j0 - 2,m) + 1
+         do 40 ic0 = 1, nchunk, nblk
+            icn = min(ic0 + nblk - 1, nchunk)
+!$omp parallel do private(ib,ie,k)
+            do 10 ic = ic0, icn
+               ib = (ic - 1)*lchunk + 1
+               ie = min(ic*lchunk, nsub)
+               k = ic - ic0 + 1
+               call wtzprb(n,m,ws,wy,nc,hd,ib,ie,ind,v,
+     +                     part(1,k),part(nc+1,k))
+  10        continue
+!$omp end parallel do
+            do 30 j = j0, j0 + nc - 1
+               do 20 ic = ic0, icn
+                  k = ic - ic0 + 1
+                  if (ic .eq. 1) then
+                     py(j) = part(j-j0+1,k)
+                     ps(j) = part(nc+j-j0+1,k)
+                  else
+                     py(j) = py(j) + part(j-j0+1,k)
+                     ps(j) = ps(j) + part(nc+j-j0+1,k)
+                  endif
+  20           continue
+  30        continue
+  40     continue
+  50  continue
+
+      return
+
+      end
+
+c====================== The end of wtzprd ==============================
+
+      subroutine wtzprb(n, m, ws, wy, ncol, head, ib, ie, ind, v,
+     +                  py, ps)
+
+      integer          n, m, ncol, head, ib, ie, ind(*)
+      double precision ws(n, m), wy(n, m), v(*), py(ncol), ps(ncol)
+
+c     ************
+c
+c     Subroutine wtzprb
+c
+c     This subroutine computes the products of wtzprd restricted to
+c       the variables ind(ib),...,ind(ie). The rows are processed in
+c       blocks of nb, as in wtprdb. The terms of each sum are added in
+c       the same order as in a column-wise loop.
+c
+c     ************
+
+      integer          nb
+      parameter        (nb = 1024)
+      integer          i,i1,i2,j,k,pointr
+      double precision temp1,temp2
+      double precision zero
+      parameter        (zero=0.0d0)
+
+      do 10 j = 1, ncol
+         py(j) = zero
+         ps(j) = zero
+  10  continue
+      do 40 i1 = ib, ie, nb
+         i2 = min(i1 + nb - 1, ie)
+         pointr = head
+         do 30 j = 1, ncol
+            temp1 = py(j)
+            temp2 = ps(j)
+            do 20 i = i1, i2
+               k = ind(i)
+               temp1 = temp1 + wy(k,pointr)*v(i)
+               temp2 = temp2 + ws(k,pointr)*v(i)
+  20        continue
+            py(j) = temp1
+            ps(j) = temp2
+            pointr = mod(pointr,m) + 1
+  30     continue
+  40  continue
+
+      return
+
+      end
+
+c====================== The end of wtzprb ==============================
+
+      subroutine wzprd(n, m, ws, wy, ncol, head, nsub, ind, cy, cs, r)
+
+      integer          n, m, ncol, head, nsub, ind(nsub)
+      double precision ws(n, m), wy(n, m), cy(ncol), cs(ncol), r(nsub)
+
+c     ************
+c
+c     Subroutine wzprd
+c
+c     This subroutine adds to r the rows ind(1),...,ind(nsub) of the
+c       combination of the ncol corrections stored from position head
+c
+c          r(i) = r(i) + sum_j wy(ind(i),pointr)*cy(j)
+c                      + ws(ind(i),pointr)*cs(j).
+c
+c     The rows are processed in blocks of nb, so that each block of r
+c       is updated in cache by all the columns instead of being read
+c       and written once per column. The blocks are independent and
+c       are processed in parallel in OpenMP builds.
+c
+c     ************
+
+      include 'lbfgsb_parallel.inc'
+
+      integer          nb
+      parameter        (nb = 1024)
+      integer          ib,ie,i,j,k,pointr
+      double precision a1,a2
+
+!$omp parallel do private(ie,i,j,k,pointr,a1,a2) if(nsub .gt. ompmin)
+      do 30 ib = 1, nsub, nb
+         ie = min(ib + nb - 1, nsub)
+         pointr = head
+         do 20 j = 1, ncol
+            a1 = cy(j)
+            a2 = cs(j)
+            do 10 i = ib, ie
+               k = ind(i)
+               r(i) = r(i) + wy(k,pointr)*a1 + ws(k,pointr)*a2
+  10        continue
+            pointr = mod(pointr,m) + 1
+  20     continue
+  30  continue
+!$omp end parallel do
+
+      return
+
+      end
+
+c====================== The end of wzprd ===============================
+
       subroutine dcsrch(f,g,stp,ftol,gtol,xtol,stpmin,stpmax,
      +                  task,isave,dsave)
-      character*(*) task
+      integer task
       integer isave(2)
       double precision f,g,stp,ftol,gtol,xtol,stpmin,stpmax
       double precision dsave(13)
+      include 'lbfgsb_codes.inc'
 c     **********
 c
 c     Subroutine dcsrch
@@ -3493,22 +4347,22 @@ c     **********
 
 c     Initialization block.
 
-      if (task(1:5) .eq. 'START') then
+      if (task .eq. ls_start) then
 
 c        Check the input arguments for errors.
 
-         if (stp .lt. stpmin) task = 'ERROR: STP .LT. STPMIN'
-         if (stp .gt. stpmax) task = 'ERROR: STP .GT. STPMAX'
-         if (g .ge. zero) task = 'ERROR: INITIAL G .GE. ZERO'
-         if (ftol .lt. zero) task = 'ERROR: FTOL .LT. ZERO'
-         if (gtol .lt. zero) task = 'ERROR: GTOL .LT. ZERO'
-         if (xtol .lt. zero) task = 'ERROR: XTOL .LT. ZERO'
-         if (stpmin .lt. zero) task = 'ERROR: STPMIN .LT. ZERO'
-         if (stpmax .lt. stpmin) task = 'ERROR: STPMAX .LT. STPMIN'
+         if (stp .lt. stpmin) task = ls_error_stp_lt_min
+         if (stp .gt. stpmax) task = ls_error_stp_gt_max
+         if (g .ge. zero) task = ls_error_initial_g
+         if (ftol .lt. zero) task = ls_error_ftol
+         if (gtol .lt. zero) task = ls_error_gtol
+         if (xtol .lt. zero) task = ls_error_xtol
+         if (stpmin .lt. zero) task = ls_error_stpmin
+         if (stpmax .lt. stpmin) task = ls_error_stpmax
 
 c        Exit if there are errors on input.
 
-         if (task(1:5) .eq. 'ERROR') return
+         if (task .ge. ls_error_stp_lt_min) return
 
 c        Initialize local variables.
 
@@ -3535,7 +4389,7 @@ c        function, and derivative at stp.
          gy = ginit
          stmin = zero
          stmax = stp + xtrapu*stp
-         task = 'FG'
+         task = ls_fg
 
          goto 1000
 
@@ -3575,22 +4429,22 @@ c     algorithm enters the second stage.
 c     Test for warnings.
 
       if (brackt .and. (stp .le. stmin .or. stp .ge. stmax))
-     +   task = 'WARNING: ROUNDING ERRORS PREVENT PROGRESS'
+     +   task = ls_warn_rounding
       if (brackt .and. stmax - stmin .le. xtol*stmax)
-     +   task = 'WARNING: XTOL TEST SATISFIED'
+     +   task = ls_warn_xtol
       if (stp .eq. stpmax .and. f .le. ftest .and. g .le. gtest)
-     +   task = 'WARNING: STP = STPMAX'
+     +   task = ls_warn_stpmax
       if (stp .eq. stpmin .and. (f .gt. ftest .or. g .ge. gtest))
-     +   task = 'WARNING: STP = STPMIN'
+     +   task = ls_warn_stpmin
 
 c     Test for convergence.
 
       if (f .le. ftest .and. abs(g) .le. gtol*(-ginit))
-     +   task = 'CONVERGENCE'
+     +   task = ls_conv
 
 c     Test for termination.
 
-      if (task(1:4) .eq. 'WARN' .or. task(1:4) .eq. 'CONV') goto 1000
+      if (task .ge. ls_conv .and. task .le. ls_warn_stpmin) goto 1000
 
 c     A modified function is used to predict the step during the
 c     first stage if a lower function value has been obtained but
@@ -3659,7 +4513,7 @@ c     point obtained during the search.
 
 c     Obtain another function and derivative.
 
-      task = 'FG'
+      task = ls_fg
 
  1000 continue
 
@@ -3690,6 +4544,82 @@ c     Save local variables.
 
 c====================== The end of dcsrch ==============================
 
+      subroutine dbtsrch(f,g,stp,ftol,gtol,stpmax,task,dsave)
+      double precision f,g,stp,ftol,gtol,stpmax
+      integer task
+      double precision dsave(3)
+c     **********
+c
+c     Subroutine dbtsrch
+c
+c     This subroutine finds a step that satisfies the sufficient
+c       decrease condition
+c
+c             f(stp) <= f(0) + ftol*stp*f'(0)
+c
+c       by backtracking from the initial step. Each rejected step is
+c       replaced by the minimizer of the quadratic that interpolates
+c       f(0), f'(0) and f(stp), safeguarded to [0.1*stp,0.5*stp]. Steps
+c       where f is not finite are rejected as well. The curvature
+c       condition f'(stp) >= gtol*f'(0) is only used before the first
+c       backtrack, to double steps too short to give a useful
+c       correction pair (up to stpmax); in the common case the initial
+c       step is accepted after a single evaluation.
+c
+c     The arguments have the meaning of those of dcsrch, with
+c       task = ls_start on initial entry and dsave a work array of
+c       dimension 3. On exit task = ls_fg requests the evaluation of f
+c       at stp and task = ls_conv reports an acceptable step.
+c
+c     **********
+      include 'lbfgsb_codes.inc'
+
+      double precision zero,p1,p5,one,two
+      parameter(zero=0.0d0,p1=0.1d0,p5=0.5d0,one=1.0d0,two=2.0d0)
+      double precision finit,ginit,stpq
+
+      if (task .eq. ls_start) then
+         if (stp .le. zero) task = ls_error_stp_lt_min
+         if (stp .gt. stpmax) task = ls_error_stp_gt_max
+         if (g .ge. zero) task = ls_error_initial_g
+         if (ftol .lt. zero) task = ls_error_ftol
+         if (task .ge. ls_error_stp_lt_min) return
+         dsave(1) = f
+         dsave(2) = g
+         dsave(3) = zero
+         task = ls_fg
+         return
+      endif
+
+      finit = dsave(1)
+      ginit = dsave(2)
+      if (f .le. finit + ftol*stp*ginit) then
+         if (dsave(3) .eq. zero .and. g .lt. gtol*ginit
+     +       .and. stp .lt. stpmax) then
+            stp = min(two*stp, stpmax)
+            task = ls_fg
+         else
+            task = ls_conv
+         endif
+         return
+      endif
+      dsave(3) = one
+
+c     The denominator is positive when ftol < 1; a value of stpq that
+c       is not a number fails both tests below.
+
+      stpq = -ginit*stp*stp/(two*(f - finit - ginit*stp))
+      if (.not. (stpq .le. p5*stp)) stpq = p5*stp
+      if (.not. (stpq .ge. p1*stp)) stpq = p1*stp
+      stp = stpq
+      task = ls_fg
+
+      return
+
+      end
+
+c====================== The end of dbtsrch =============================
+
       subroutine dcstep(stx,fx,dx,sty,fy,dy,stp,fp,dp,brackt,
      +                  stpmin,stpmax)
       logical brackt
@@ -0,0 +1,104 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Level-1 BLAS kernels called by the Fortran engine: throughput of each
+// instruction set and time spent by the solver on large problems, where
+// ddot/daxpy/dcopy/dscal over vectors of size n dominate every iteration.
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+#include "blas_kernels.h"
+
+const char *isa_name(kernel_isa isa) {
+    switch (isa) {
+        case kernel_isa::avx512:
+            return "avx512";
+        case kernel_isa::avx2:
+            return "avx2";
+        default:
+            return "portable";
+    }
+}
+
+std::vector<kernel_isa> supported_isas() {
+    std::vector<kernel_isa> isas;
+    for (int isa = 0; isa <= static_cast<int>(kernel_isa::avx512); isa++) {
+        if (l_bfgs_b_blas::is_supported(static_cast<kernel_isa>(isa))) {
+            isas.push_back(static_cast<kernel_isa>(isa));
+        }
+    }
+    return isas;
+}
+
+// nanoseconds per element of dot and axpy
+void run_kernels(int n, kernel_isa isa) {
+    std::vector<double> x(n, 1.0), y(n, 0.5);
+    int repetitions = std::max(1, 200000000 / n);
+    // keeps the dot products from being optimized away
+    volatile double sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++) {
+        sink = sink + l_bfgs_b_blas::dot(isa, n, x.data(), y.data());
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++) {
+        l_bfgs_b_blas::axpy(isa, n, 1e-9, x.data(), y.data());
+    }
+    auto end = std::chrono::steady_clock::now();
+    double elements = double(n) * repetitions;
+    std::cout << n << "\t" << isa_name(isa) << "\t"
+              << std::chrono::duration<double, std::nano>(middle - start).count() / elements << "\t\t"
+              << std::chrono::duration<double, std::nano>(end - middle).count() / elements << std::endl;
+}
+
+// separable quadratic with a cheap gradient, so that the solver dominates
+struct separable_quadratic {
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double result = 0;
+        for (std::size_t i = 0; i < x.size(); i++) {
+            double d = 1 + (i % 100);
+            double residual = x[i] - 1;
+            result += 0.5 * d * residual * residual;
+            gr[i] = d * residual;
+        }
+        return result;
+    }
+};
+
+void run_solve(int n, kernel_isa isa, int iterations) {
+    l_bfgs_b_blas::set_isa(isa);
+    l_bfgs_b<std::vector<double> > solver;
+    solver.set_max_iterations(iterations);
+    double inf = std::numeric_limits<double>::infinity();
+    std::vector<double> lb(n, -inf), ub(n, inf), x(n, 0.0);
+    l_bfgs_b_result result = solver.optimize(separable_quadratic(), lb, ub, x);
+    double solverTime = result.stats.solver_time();
+    std::cout << n << "\t" << isa_name(isa) << "\t" << result.iterations << "\t"
+              << solverTime << "\t\t" << 1e9 * solverTime / result.iterations / n << std::endl;
+}
+
+int main() {
+    std::vector<kernel_isa> isas = supported_isas();
+    std::cout << "n\tisa\tdot (ns/elem)\taxpy (ns/elem)" << std::endl;
+    for (int n = 100000; n <= 10000000; n *= 10) {
+        for (kernel_isa isa : isas) {
+            run_kernels(n, isa);
+        }
+    }
+    std::cout << std::endl << "n\tisa\titers\tsolver (s)\tsolver (ns/iter/elem)" << std::endl;
+    for (int n = 100000; n <= 10000000; n *= 10) {
+        for (kernel_isa isa : isas) {
+            run_solve(n, isa, 30);
+        }
+    }
+    l_bfgs_b_blas::set_isa(l_bfgs_b_blas::detect_isa());
+    return 0;
+}
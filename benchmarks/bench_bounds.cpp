@@ -0,0 +1,93 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Cost of changing a few bounds between solves, as in model-predictive-control
+// loops: replacing the full bound vectors against updating single coordinates.
+// The setup cost includes the classification of the modified bounds (nbd).
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <lbfgsb_cpp/problem.h>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+
+class separable_quadratic : public problem<std::vector<double> > {
+public:
+    separable_quadratic(int inputDimension) : problem<std::vector<double> >(inputDimension) {}
+
+    double operator()(const std::vector<double> &x) {
+        double result = 0;
+        for (int i = 0; i < mInputDimension; i++) {
+            result += (x[i] - 1) * (x[i] - 1);
+        }
+        return result;
+    }
+
+    void gradient(const std::vector<double> &x, std::vector<double> &gr) {
+        for (int i = 0; i < mInputDimension; i++) {
+            gr[i] = 2 * (x[i] - 1);
+        }
+    }
+};
+
+template<class F>
+double time_per_call(int noCalls, F call) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < noCalls; i++) {
+        call(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count() / noCalls;
+}
+
+int main() {
+    int noChanges = 10;
+    int noRepetitions = 20;
+    std::cout << "n\tfull setup (us)\tcoordinate setup (us)\tfull solve (us)\tcoordinate solve (us)" << std::endl;
+    for (int n : {1000, 100000, 1000000}) {
+        separable_quadratic pb(n);
+        std::vector<double> lb(n, -10), ub(n, 0.5), x(n);
+        pb.set_lower_bound(lb);
+        pb.set_upper_bound(ub);
+        pb.get_bounds().get_nbd();
+
+        double fullSetup = time_per_call(noRepetitions, [&](int repetition) {
+            for (int k = 0; k < noChanges; k++) {
+                lb[(k * 7919 + repetition) % n] = -10 - repetition;
+            }
+            pb.set_lower_bound(lb);
+            pb.get_bounds().get_nbd();
+        });
+        double coordinateSetup = time_per_call(noRepetitions, [&](int repetition) {
+            for (int k = 0; k < noChanges; k++) {
+                pb.set_lower_bound((k * 7919 + repetition) % n, -20 - repetition);
+            }
+            pb.get_bounds().get_nbd();
+        });
+
+        l_bfgs_b<std::vector<double> > solver;
+        solver.set_max_iterations(1);
+        double fullSolve = time_per_call(noRepetitions, [&](int repetition) {
+            for (int k = 0; k < noChanges; k++) {
+                lb[(k * 7919 + repetition) % n] = -30 - repetition;
+            }
+            pb.set_lower_bound(lb);
+            std::fill(x.begin(), x.end(), 0);
+            solver.optimize(pb, x);
+        });
+        double coordinateSolve = time_per_call(noRepetitions, [&](int repetition) {
+            for (int k = 0; k < noChanges; k++) {
+                pb.set_lower_bound((k * 7919 + repetition) % n, -40 - repetition);
+            }
+            std::fill(x.begin(), x.end(), 0);
+            solver.optimize(pb, x);
+        });
+        std::cout << n << "\t" << fullSetup << "\t\t" << coordinateSetup << "\t\t\t"
+                  << fullSolve << "\t\t" << coordinateSolve << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Large problems where most variables end at a bound: ordering of the
+// breakpoints of the Cauchy search with the heap of the original routine
+// against bulk selection (l_bfgs_b::set_breakpoint_ordering). The first table
+// times the ordering alone, popping the k smallest of n random breakpoints as
+// the Cauchy search does; the second one solves a bound-constrained problem.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+
+extern "C" {
+void hpsolb_(int *n, double *t, int *iorder, int *iheap);
+void bpsel_(int *n, double *t, int *iorder, int *k);
+}
+
+typedef std::chrono::steady_clock clock_type;
+
+// Mirrors the loop of cauchy: the smallest remaining breakpoint is left in
+// t[nleft - 1] and nleft decreases
+double pop_heap(std::vector<double> &t, std::vector<int> &iorder, int k) {
+    int nleft = t.size();
+    double sum = 0;
+    for (int iter = 0; iter < k; iter++, nleft--) {
+        int iheap = iter > 0;
+        hpsolb_(&nleft, t.data(), iorder.data(), &iheap);
+        sum += t[nleft - 1];
+    }
+    return sum;
+}
+
+double pop_selection(std::vector<double> &t, std::vector<int> &iorder, int k) {
+    int nleft = t.size();
+    int kbatch = 0, nbatch = 0, base = 0;
+    double sum = 0;
+    for (int iter = 0; iter < k; iter++, nleft--) {
+        int iheap = 1;
+        if (nbatch == 0) {
+            kbatch = std::min(std::max(std::max(2 * kbatch, nleft / 16), 1024), nleft);
+            bpsel_(&nleft, t.data(), iorder.data(), &kbatch);
+            nbatch = kbatch;
+            base = nleft - kbatch;
+            iheap = 0;
+        }
+        hpsolb_(&nbatch, &t[base], &iorder[base], &iheap);
+        nbatch--;
+        sum += t[nleft - 1];
+    }
+    return sum;
+}
+
+void run_ordering(int n, double fraction) {
+    std::mt19937 generator(n);
+    std::uniform_real_distribution<double> distribution(0, 1);
+    std::vector<double> breakpoints(n);
+    for (double &t : breakpoints) {
+        t = distribution(generator);
+    }
+    std::vector<int> indices(n);
+    for (int i = 0; i < n; i++) {
+        indices[i] = i + 1;
+    }
+    int k = std::max(1, int(fraction * n));
+    std::vector<double> t = breakpoints;
+    std::vector<int> iorder = indices;
+    auto start = clock_type::now();
+    double heapSum = pop_heap(t, iorder, k);
+    double heapTime = std::chrono::duration<double>(clock_type::now() - start).count();
+    t = breakpoints;
+    iorder = indices;
+    start = clock_type::now();
+    double selectionSum = pop_selection(t, iorder, k);
+    double selectionTime = std::chrono::duration<double>(clock_type::now() - start).count();
+    std::cout << n << "\t" << k << "\t" << 1e3 * heapTime << "\t\t" << 1e3 * selectionTime << "\t\t"
+              << (heapSum == selectionSum ? "yes" : "no") << std::endl;
+}
+
+// pseudo-random number in [0, 1) determined by i
+double uniform(std::size_t i, std::size_t seed) {
+    return ((i * 2654435761u + seed) % 1000003) / 1000003.0;
+}
+
+// Sum of weighted squares whose minimizer lies outside of [0, 1] for two
+// thirds of the coordinates, plus a weak coupling between neighbours. The
+// weights and centers are scattered so that the breakpoints are distinct.
+struct bound_heavy_quadratic {
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double result = 0;
+        std::size_t n = x.size();
+        for (std::size_t i = 0; i < n; i++) {
+            double a = 1 + 9 * uniform(i, 1);
+            double c = -1 + 3 * uniform(i, 2);
+            result += 0.5 * a * (x[i] - c) * (x[i] - c);
+            gr[i] = a * (x[i] - c);
+        }
+        for (std::size_t i = 0; i + 1 < n; i++) {
+            double t = x[i + 1] - x[i];
+            result += 0.05 * t * t;
+            gr[i] -= 0.1 * t;
+            gr[i + 1] += 0.1 * t;
+        }
+        return result;
+    }
+};
+
+// best of three solves, to filter out the noise of the timings
+void run(int n, breakpoint_ordering ordering) {
+    l_bfgs_b<std::vector<double> > solver;
+    solver.set_breakpoint_ordering(ordering);
+    l_bfgs_b_result best;
+    for (int k = 0; k < 3; k++) {
+        std::vector<double> lb(n, 0), ub(n, 1), x(n, 0.5);
+        l_bfgs_b_result result = solver.optimize(bound_heavy_quadratic(), lb, ub, x);
+        if (k == 0 || result.stats.cauchyTime < best.stats.cauchyTime) {
+            best = result;
+        }
+    }
+    std::cout << n << "\t" << (ordering == breakpoint_ordering::heap ? "heap" : "selection") << "\t"
+              << best.iterations << "\t" << best.stats.cauchyIntervals << "\t\t" << best.f << "\t"
+              << 1e3 * best.stats.cauchyTime / best.iterations << "\t\t"
+              << 1e3 * best.stats.solver_time() / best.iterations << std::endl;
+}
+
+int main() {
+    std::cout << "n\tpopped\theap (ms)\tselection (ms)\tsame order" << std::endl;
+    for (int n = 100000; n <= 10000000; n *= 10) {
+        for (double fraction : {0.001, 0.01, 0.1, 1.0}) {
+            run_ordering(n, fraction);
+        }
+    }
+    std::cout << std::endl;
+
+    std::cout << "n\tordering\titers\tintervals\tf\tcauchy (ms/iter)\tsolver (ms/iter)" << std::endl;
+    for (int n = 10000; n <= 1000000; n *= 10) {
+        run(n, breakpoint_ordering::heap);
+        run(n, breakpoint_ordering::selection);
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Compares the cost of evaluating small std::array problems through the virtual
+// interface of problem<T> against the statically dispatched overloads of
+// l_bfgs_b::optimize (concrete problem type and plain callables).
+
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <lbfgsb_cpp/problem.h>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+
+template<std::size_t N>
+class array_quadratic : public problem<std::array<double, N> > {
+public:
+    typedef std::array<double, N> vector_type;
+
+    array_quadratic() : problem<vector_type>(N) {}
+
+    double operator()(const vector_type &x) {
+        double result = 0;
+        for (std::size_t i = 0; i < N; i++) {
+            result += (i + 1) * (x[i] - 1) * (x[i] - 1);
+        }
+        return result;
+    }
+
+    void gradient(const vector_type &x, vector_type &gr) {
+        for (std::size_t i = 0; i < N; i++) {
+            gr[i] = 2 * (i + 1) * (x[i] - 1);
+        }
+    }
+};
+
+template<class F>
+double time_per_call(int noCalls, F call) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < noCalls; i++) {
+        call();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / noCalls;
+}
+
+template<std::size_t N>
+void run(int noEvaluations, int noSolves) {
+    typedef std::array<double, N> vector_type;
+    array_quadratic<N> pb;
+    problem<vector_type> &base = pb;
+    vector_type x, gr;
+    x.fill(0.5);
+    volatile double sink = 0;
+
+    // evaluations alone, as performed by the solver loop
+    double virtualEval = time_per_call(noEvaluations, [&]() {
+        x[0] += 1e-9;
+        sink = sink + base.value_and_gradient(x, gr);
+    });
+    double staticEval = time_per_call(noEvaluations, [&]() {
+        x[0] += 1e-9;
+        sink = sink + problem<vector_type>::static_value_and_gradient(pb, x, gr);
+    });
+
+    // full solves
+    l_bfgs_b<vector_type> solver;
+    vector_type lb, ub;
+    lb.fill(-10);
+    ub.fill(0.5);
+    pb.set_lower_bound(lb);
+    pb.set_upper_bound(ub);
+    double virtualSolve = time_per_call(noSolves, [&]() {
+        x.fill(-5);
+        solver.optimize(base, x);
+    });
+    double staticSolve = time_per_call(noSolves, [&]() {
+        x.fill(-5);
+        solver.optimize(pb, x);
+    });
+    auto value = [&pb](const vector_type &z) { return pb.array_quadratic<N>::operator()(z); };
+    auto gradient = [&pb](const vector_type &z, vector_type &g) { pb.array_quadratic<N>::gradient(z, g); };
+    double callableSolve = time_per_call(noSolves, [&]() {
+        x.fill(-5);
+        solver.optimize(value, gradient, lb, ub, x);
+    });
+    std::cout << N << "\t" << virtualEval << "\t\t" << staticEval << "\t\t" << virtualSolve / 1000 << "\t\t"
+              << staticSolve / 1000 << "\t\t" << callableSolve / 1000 << std::endl;
+}
+
+int main() {
+    int noEvaluations = 10000000;
+    int noSolves = 20000;
+    std::cout << "n\tvirtual eval (ns)\tstatic eval (ns)\tvirtual solve (us)\tstatic solve (us)\t"
+              << "callable solve (us)" << std::endl;
+    run<2>(noEvaluations, noSolves);
+    run<4>(noEvaluations, noSolves);
+    run<8>(noEvaluations, noSolves);
+    return 0;
+}
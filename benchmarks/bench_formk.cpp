@@ -0,0 +1,110 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Cost of forming the middle matrix of the subspace minimization (formk) as a
+// function of the number of variables that enter or leave the free set. formk
+// updates the inner products of the previous iteration with the changed rows;
+// forming them from scratch (formw1) reads the n rows of the corrections.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+
+extern "C" {
+void formk_(int *n, int *nsub, int *ind, int *nenter, int *ileave, int *indx2, int *iupdat, int *updatd,
+            double *wn, double *wn1, int *m, double *ws, double *wy, double *sy, double *theta, int *col,
+            int *head, int *nchg, int *info);
+void formw1_(int *n, int *nsub, int *ind, int *m, double *ws, double *wy, int *col, int *head, double *wn1);
+}
+
+typedef std::chrono::steady_clock clock_type;
+
+double uniform(std::size_t i) {
+    return ((i * 2654435761u) % 1000003) / 1000003.0 - 0.5;
+}
+
+// free variables first, then the active ones (1-based, as the engine stores them)
+std::vector<int> free_set_indices(const std::vector<bool> &free) {
+    std::vector<int> ind;
+    for (std::size_t i = 0; i < free.size(); i++) {
+        if (free[i]) {
+            ind.push_back(i + 1);
+        }
+    }
+    for (std::size_t i = 0; i < free.size(); i++) {
+        if (!free[i]) {
+            ind.push_back(i + 1);
+        }
+    }
+    return ind;
+}
+
+void run(int n, int m, double churn, int repetitions) {
+    std::vector<double> ws(std::size_t(n) * m), wy(std::size_t(n) * m), sy(m * m, 0.0);
+    for (std::size_t k = 0; k < ws.size(); k++) {
+        ws[k] = uniform(2 * k);
+        wy[k] = uniform(2 * k + 1);
+    }
+    for (int j = 0; j < m; j++) {
+        sy[j * m + j] = 1.0;
+    }
+    // half of the variables are free; churn * n of them change their state
+    std::vector<bool> oldFree(n), newFree(n);
+    int changed = int(churn * n);
+    for (int i = 0; i < n; i++) {
+        oldFree[i] = i % 2 == 0;
+        newFree[i] = oldFree[i];
+    }
+    std::vector<int> indx2(n);
+    int nenter = 0, ileave = n + 1;
+    for (int k = 0; k < changed; k++) {
+        int i = int((std::size_t(k) * n) / changed);
+        newFree[i] = !oldFree[i];
+        if (newFree[i]) {
+            indx2[nenter++] = i + 1;
+        } else {
+            indx2[--ileave - 1] = i + 1;
+        }
+    }
+    std::vector<int> oldInd = free_set_indices(oldFree), ind = free_set_indices(newFree);
+    int oldNsub = (n + 1) / 2;
+    int nsub = std::count(newFree.begin(), newFree.end(), true);
+    int col = m, head = 1, iupdat = m, updatd = 0, nchg = 0, info = 0;
+    double theta = 1.0;
+    std::vector<double> wn(4 * m * m), oldWn1(4 * m * m), wn1(4 * m * m);
+    formw1_(&n, &oldNsub, oldInd.data(), &m, ws.data(), wy.data(), &col, &head, oldWn1.data());
+
+    double updateTime = 0;
+    for (int r = 0; r < repetitions; r++) {
+        wn1 = oldWn1;
+        nchg = 0;
+        auto start = clock_type::now();
+        formk_(&n, &nsub, ind.data(), &nenter, &ileave, indx2.data(), &iupdat, &updatd, wn.data(), wn1.data(),
+               &m, ws.data(), wy.data(), sy.data(), &theta, &col, &head, &nchg, &info);
+        updateTime += std::chrono::duration<double>(clock_type::now() - start).count();
+    }
+    auto start = clock_type::now();
+    for (int r = 0; r < repetitions; r++) {
+        formw1_(&n, &nsub, ind.data(), &m, ws.data(), wy.data(), &col, &head, wn1.data());
+    }
+    double scratchTime = std::chrono::duration<double>(clock_type::now() - start).count();
+    std::cout << n << "\t" << m << "\t" << changed << "\t\t" << 1e3 * updateTime / repetitions << "\t\t"
+              << 1e3 * scratchTime / repetitions << "\t\t" << info << std::endl;
+}
+
+int main() {
+    std::cout << "n\tm\tchanged\t\tformk (ms)\tscratch (ms)\tinfo" << std::endl;
+    int n = 1000000;
+    for (int m : {5, 10}) {
+        for (double churn : {0.0, 0.0001, 0.001, 0.01, 0.1, 0.5}) {
+            run(n, m, churn, 5);
+        }
+    }
+    return 0;
+}
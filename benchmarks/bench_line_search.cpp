@@ -0,0 +1,141 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Function evaluations needed to converge with the More-Thuente line search
+// (for several curvature tolerances) and with the backtracking line search, on
+// the classical test functions and on larger bounded and unbounded problems.
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+
+struct beale {
+    int n;
+
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double t1 = 1.5 - x[0] + x[0] * x[1];
+        double t2 = 2.25 - x[0] + x[0] * x[1] * x[1];
+        double t3 = 2.625 - x[0] + x[0] * x[1] * x[1] * x[1];
+        gr[0] = 2 * t1 * (x[1] - 1) + 2 * t2 * (x[1] * x[1] - 1) + 2 * t3 * (x[1] * x[1] * x[1] - 1);
+        gr[1] = 2 * t1 * x[0] + 4 * t2 * x[0] * x[1] + 6 * t3 * x[0] * x[1] * x[1];
+        return t1 * t1 + t2 * t2 + t3 * t3;
+    }
+};
+
+struct booth {
+    int n;
+
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double t1 = x[0] + 2 * x[1] - 7;
+        double t2 = 2 * x[0] + x[1] - 5;
+        gr[0] = 2 * t1 + 4 * t2;
+        gr[1] = 4 * t1 + 2 * t2;
+        return t1 * t1 + t2 * t2;
+    }
+};
+
+struct matyas {
+    int n;
+
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        gr[0] = 0.52 * x[0] - 0.48 * x[1];
+        gr[1] = 0.52 * x[1] - 0.48 * x[0];
+        return 0.26 * (x[0] * x[0] + x[1] * x[1]) - 0.48 * x[0] * x[1];
+    }
+};
+
+struct chained_rosenbrock {
+    int n;
+
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double result = 0;
+        for (int i = 0; i < n; i++) {
+            gr[i] = 0;
+        }
+        for (int i = 0; i + 1 < n; i++) {
+            double t1 = x[i + 1] - x[i] * x[i];
+            double t2 = 1 - x[i];
+            result += 100 * t1 * t1 + t2 * t2;
+            gr[i] += -400 * x[i] * t1 - 2 * t2;
+            gr[i + 1] += 200 * t1;
+        }
+        return result;
+    }
+};
+
+// ill-conditioned quadratic whose unconstrained minimizer violates the bounds of
+// half of the coordinates
+struct bounded_quadratic {
+    int n;
+
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double result = 0;
+        for (int i = 0; i < n; i++) {
+            double d = std::pow(10.0, 3.0 * i / (n - 1));
+            double residual = x[i] - 2 * std::sin(i);
+            result += 0.5 * d * residual * residual;
+            gr[i] = d * residual;
+        }
+        return result;
+    }
+};
+
+struct configuration {
+    std::string name;
+    line_search_policy policy;
+    double curvatureTolerance;
+};
+
+// solves the problem from a few starting points and reports the totals
+template<class F>
+void run(const std::string &name, F objective, double lower, double upper,
+         const std::vector<configuration> &configurations) {
+    std::vector<double> lb(objective.n, lower), ub(objective.n, upper);
+    for (const configuration &conf : configurations) {
+        l_bfgs_b<std::vector<double> > solver(10, 100000, 1e7, 1e-8);
+        solver.set_line_search_policy(conf.policy);
+        solver.set_curvature_tolerance(conf.curvatureTolerance);
+        int iterations = 0;
+        int evaluations = 0;
+        double f = 0;
+        for (int start = 0; start < 4; start++) {
+            std::vector<double> x(objective.n);
+            for (int i = 0; i < objective.n; i++) {
+                x[i] = std::max(lower, std::min(upper, -1.2 + 0.7 * start + 0.1 * (i % 3)));
+            }
+            l_bfgs_b_result result = solver.optimize(objective, lb, ub, x);
+            iterations += result.iterations;
+            evaluations += result.evaluations;
+            f = std::max(f, result.f);
+        }
+        std::cout << name << "\t" << objective.n << "\t" << conf.name << "\t" << iterations << "\t\t"
+                  << evaluations << "\t\t" << static_cast<double>(evaluations) / iterations << "\t\t"
+                  << f << std::endl;
+    }
+}
+
+int main() {
+    double inf = std::numeric_limits<double>::infinity();
+    std::vector<configuration> configurations = {
+            {"more-thuente 0.9", line_search_policy::more_thuente, 0.9},
+            {"more-thuente 0.1", line_search_policy::more_thuente, 0.1},
+            {"backtracking 0.9", line_search_policy::backtracking, 0.9},
+            {"backtracking 0.5", line_search_policy::backtracking, 0.5}
+    };
+    std::cout << "problem\t\tn\tline search\t\titerations\tevaluations\tper iteration\tworst f" << std::endl;
+    run("beale\t", beale{2}, -4.5, 4.5, configurations);
+    run("booth\t", booth{2}, -inf, inf, configurations);
+    run("matyas\t", matyas{2}, -inf, inf, configurations);
+    run("rosenbrock", chained_rosenbrock{2}, -10, 10, configurations);
+    run("rosenbrock", chained_rosenbrock{100}, -inf, inf, configurations);
+    run("rosenbrock", chained_rosenbrock{1000}, -2, 2, configurations);
+    run("quadratic", bounded_quadratic{10000}, -1, 1, configurations);
+    return 0;
+}
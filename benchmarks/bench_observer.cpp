@@ -0,0 +1,92 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Cost of the observer on tiny problems solved in a tight loop, where the
+// per-iteration overhead of the solver is most visible: without observer,
+// with an observer that does nothing and with one that records the objective
+// values. The times are the best of several repetitions.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+
+template<int N>
+struct chained_rosenbrock {
+    double operator()(const std::array<double, N> &x, std::array<double, N> &gr) const {
+        double result = 0;
+        gr.fill(0);
+        for (int i = 0; i + 1 < N; i++) {
+            double t1 = x[i + 1] - x[i] * x[i];
+            double t2 = 1 - x[i];
+            result += 100 * t1 * t1 + t2 * t2;
+            gr[i] += -400 * x[i] * t1 - 2 * t2;
+            gr[i + 1] += 200 * t1;
+        }
+        return result;
+    }
+};
+
+// nanoseconds per iteration
+template<int N>
+double time_per_iteration(l_bfgs_b<std::array<double, N> > &solver, int noSolves) {
+    typedef std::array<double, N> vector;
+    vector lb, ub, x;
+    lb.fill(-10);
+    ub.fill(10);
+    chained_rosenbrock<N> objective;
+    double best = 0;
+    for (int repetition = 0; repetition < 5; repetition++) {
+        long long iterations = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < noSolves; i++) {
+            for (int j = 0; j < N; j++) {
+                x[j] = -1.2 + 0.001 * ((i + j) % 100);
+            }
+            iterations += solver.optimize(objective, lb, ub, x).iterations;
+        }
+        auto end = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+        best = (repetition == 0) ? elapsed : std::min(best, elapsed);
+    }
+    return best;
+}
+
+template<int N>
+void run(int noSolves) {
+    typedef std::array<double, N> vector;
+    l_bfgs_b<vector> solver;
+    double none = time_per_iteration<N>(solver, noSolves);
+
+    solver.set_observer([](const l_bfgs_b_iteration<vector> &) {
+        return true;
+    });
+    double empty = time_per_iteration<N>(solver, noSolves);
+
+    std::vector<double> values;
+    values.reserve(1000);
+    solver.set_observer([&values](const l_bfgs_b_iteration<vector> &iteration) {
+        if (iteration.iterations == 1) {
+            values.clear();
+        }
+        values.push_back(iteration.f);
+        return true;
+    });
+    double recording = time_per_iteration<N>(solver, noSolves);
+    std::cout << N << "\t" << none << "\t\t" << empty << "\t\t" << recording << std::endl;
+}
+
+int main() {
+    int noSolves = 20000;
+    std::cout << "n\tnone (ns)\tempty (ns)\trecording (ns)" << std::endl;
+    run<2>(noSolves);
+    run<4>(noSolves);
+    run<8>(noSolves);
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Products of the n x m correction matrices WS and WY with vectors, which are
+// bandwidth bound for large n. The fused Fortran kernels (wtprd, wzprd) read
+// the corrections in a single pass; they are compared with one pass per column,
+// as the engine used to compute them. The effective bandwidth counts the bytes
+// that have to be read at least once.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+
+extern "C" {
+double ddot_(int *n, double *dx, int *incx, double *dy, int *incy);
+void wtprd_(int *n, int *m, double *ws, double *wy, int *ncol, int *head, double *v, double *py, int *incpy,
+            double *ps, int *incps);
+void wzprd_(int *n, int *m, double *ws, double *wy, int *ncol, int *head, int *nsub, int *ind, double *cy,
+            double *cs, double *r);
+}
+
+typedef std::chrono::steady_clock clock_type;
+
+double seconds_since(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+void run_kernels(int n, int m, int repetitions) {
+    std::vector<double> ws(std::size_t(n) * m, 0.5), wy(std::size_t(n) * m, 0.25), v(n, 1.0), r(n, 0.0);
+    std::vector<double> py(m), ps(m), cy(m, 1e-3), cs(m, 1e-3);
+    // 90% of the variables are free
+    std::vector<int> ind;
+    for (int i = 1; i <= n; i++) {
+        if (i % 10 != 0) {
+            ind.push_back(i);
+        }
+    }
+    int nsub = ind.size();
+    int one = 1, head = 1;
+    double gigabytes = (2.0 * m + 1) * n * sizeof(double) / 1e9;
+    double subspaceGigabytes = (2.0 * m * n + 2.0 * nsub) * sizeof(double) / 1e9 + nsub * sizeof(int) / 1e9;
+
+    auto start = clock_type::now();
+    for (int k = 0; k < repetitions; k++) {
+        for (int j = 0; j < m; j++) {
+            py[j] = ddot_(&n, &wy[std::size_t(j) * n], &one, v.data(), &one);
+            ps[j] = ddot_(&n, &ws[std::size_t(j) * n], &one, v.data(), &one);
+        }
+    }
+    double columnsTime = seconds_since(start) / repetitions;
+    start = clock_type::now();
+    for (int k = 0; k < repetitions; k++) {
+        wtprd_(&n, &m, ws.data(), wy.data(), &m, &head, v.data(), py.data(), &one, ps.data(), &one);
+    }
+    double fusedTime = seconds_since(start) / repetitions;
+    std::cout << n << "\t" << m << "\tW'v\t" << gigabytes / columnsTime << "\t\t"
+              << gigabytes / fusedTime << std::endl;
+
+    start = clock_type::now();
+    for (int k = 0; k < repetitions; k++) {
+        for (int j = 0; j < m; j++) {
+            const double *y = &wy[std::size_t(j) * n], *s = &ws[std::size_t(j) * n];
+            for (int i = 0; i < nsub; i++) {
+                r[i] += y[ind[i] - 1] * cy[j] + s[ind[i] - 1] * cs[j];
+            }
+        }
+    }
+    columnsTime = seconds_since(start) / repetitions;
+    start = clock_type::now();
+    for (int k = 0; k < repetitions; k++) {
+        wzprd_(&n, &m, ws.data(), wy.data(), &m, &head, &nsub, ind.data(), cy.data(), cs.data(), r.data());
+    }
+    fusedTime = seconds_since(start) / repetitions;
+    std::cout << n << "\t" << m << "\tZ'Wc\t" << subspaceGigabytes / columnsTime << "\t\t"
+              << subspaceGigabytes / fusedTime << std::endl;
+}
+
+// ill-conditioned separable quadratic; the lower bound is active for a tenth
+// of the variables, so that every iteration runs the Cauchy search and the
+// subspace minimization
+struct bounded_quadratic {
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double result = 0;
+        for (std::size_t i = 0; i < x.size(); i++) {
+            double d = 1 + (i % 100);
+            double residual = x[i] - (i % 10 == 0 ? -1.0 : 1.0);
+            result += 0.5 * d * residual * residual;
+            gr[i] = d * residual;
+        }
+        return result;
+    }
+};
+
+void run_solve(int n, int m, int iterations) {
+    l_bfgs_b<std::vector<double> > solver;
+    solver.set_memory_size(m);
+    solver.set_max_iterations(iterations);
+    std::vector<double> lb(n, 0.0), ub(n, std::numeric_limits<double>::infinity()), x(n, 0.5);
+    l_bfgs_b_result result = solver.optimize(bounded_quadratic(), lb, ub, x);
+    const l_bfgs_b_stats &stats = result.stats;
+    std::cout << n << "\t" << m << "\t" << result.iterations << "\t" << stats.cauchyTime << "\t"
+              << stats.subspaceTime << "\t\t" << stats.solver_time() << std::endl;
+}
+
+int main() {
+    int n = 5000000;
+    std::cout << "n\tm\tproduct\tcolumns (GB/s)\tfused (GB/s)" << std::endl;
+    run_kernels(n, 5, 10);
+    run_kernels(n, 10, 5);
+    std::cout << std::endl << "n\tm\titers\tcauchy\tsubspace\tsolver (s)" << std::endl;
+    run_solve(n, 5, 20);
+    run_solve(n, 10, 20);
+    return 0;
+}
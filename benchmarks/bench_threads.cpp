@@ -0,0 +1,66 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Scaling of the solver with the number of OpenMP threads on a large bound
+// constrained problem (requires -DLBFGSB_OPENMP=ON). The partitions of the
+// parallel loops only depend on the size of the problem, so every thread count
+// must reach exactly the same iterate.
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include <omp.h>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+
+// ill-conditioned separable quadratic; the lower bound is active for a tenth
+// of the variables. It is evaluated serially, so that only the solver scales.
+struct bounded_quadratic {
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double result = 0;
+        for (std::size_t i = 0; i < x.size(); i++) {
+            double d = 1 + (i % 100);
+            double residual = x[i] - (i % 10 == 0 ? -1.0 : 1.0);
+            result += 0.5 * d * residual * residual;
+            gr[i] = d * residual;
+        }
+        return result;
+    }
+};
+
+int main(int argc, char *argv[]) {
+    int n = 5000000;
+    int iterations = 20;
+    // 1, 2, 4, ... threads up to the number of processors or the first argument
+    int maxThreads = argc > 1 ? std::atoi(argv[1]) : omp_get_num_procs();
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    std::vector<double> reference;
+    double serialTime = 0;
+    std::cout << "threads\tsolver (s)\tspeedup\tidentical" << std::endl;
+    for (int threads : threadCounts) {
+        omp_set_num_threads(threads);
+        l_bfgs_b<std::vector<double> > solver;
+        solver.set_max_iterations(iterations);
+        std::vector<double> lb(n, 0.0), ub(n, std::numeric_limits<double>::infinity()), x(n, 0.5);
+        l_bfgs_b_result result = solver.optimize(bounded_quadratic(), lb, ub, x);
+        double solverTime = result.stats.solver_time();
+        if (reference.empty()) {
+            serialTime = solverTime;
+            reference = x;
+        }
+        bool identical = std::memcmp(reference.data(), x.data(), n * sizeof(double)) == 0;
+        std::cout << threads << "\t" << solverTime << "\t\t" << serialTime / solverTime << "\t"
+                  << (identical ? "yes" : "no") << std::endl;
+    }
+    return 0;
+}
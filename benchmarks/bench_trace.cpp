@@ -0,0 +1,77 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Cost of tracing the iterations of the chained Rosenbrock function: time per
+// iteration without and with a trace, and time needed to export the trace.
+// The times are the best of several repetitions.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+
+struct chained_rosenbrock {
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double result = 0;
+        int n = x.size();
+        std::fill(gr.begin(), gr.end(), 0.0);
+        for (int i = 0; i + 1 < n; i++) {
+            double t1 = x[i + 1] - x[i] * x[i];
+            double t2 = 1 - x[i];
+            result += 100 * t1 * t1 + t2 * t2;
+            gr[i] += -400 * x[i] * t1 - 2 * t2;
+            gr[i + 1] += 200 * t1;
+        }
+        return result;
+    }
+};
+
+// microseconds per iteration
+double time_per_iteration(l_bfgs_b<std::vector<double> > &solver, int n, int noSolves) {
+    std::vector<double> lb(n, -2), ub(n, 2), x(n);
+    chained_rosenbrock objective;
+    double best = 0;
+    for (int repetition = 0; repetition < 5; repetition++) {
+        long long iterations = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < noSolves; i++) {
+            for (int j = 0; j < n; j++) {
+                x[j] = (j % 2 == 0) ? -1.2 : 1 + 0.001 * (i % 100);
+            }
+            iterations += solver.optimize(objective, lb, ub, x).iterations;
+        }
+        auto end = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+        best = (repetition == 0) ? elapsed : std::min(best, elapsed);
+    }
+    return best;
+}
+
+void run(int n, int noSolves) {
+    l_bfgs_b<std::vector<double> > solver(5, 100000, 1e7, 1e-9);
+    double untraced = time_per_iteration(solver, n, noSolves);
+    l_bfgs_b_trace trace(100000);
+    solver.set_trace(&trace);
+    double traced = time_per_iteration(solver, n, noSolves);
+
+    auto start = std::chrono::steady_clock::now();
+    trace.write("bench_trace.bin");
+    auto end = std::chrono::steady_clock::now();
+    std::remove("bench_trace.bin");
+    std::cout << n << "\t" << untraced << "\t\t" << traced << "\t\t" << trace.size() << "\t\t"
+              << std::chrono::duration<double, std::milli>(end - start).count() << std::endl;
+}
+
+int main() {
+    std::cout << "n\tuntraced (us)\ttraced (us)\trecords\t\twrite (ms)" << std::endl;
+    run(2, 20000);
+    run(100, 500);
+    run(1000, 10);
+    return 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Problems without bounds: search direction computed by the subspace
+// minimization over the compact representation against the two-loop
+// recursion (l_bfgs_b::set_two_loop_recursion).
+
+#include <iostream>
+#include <limits>
+#include <vector>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+
+struct chained_rosenbrock {
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double result = 0;
+        std::fill(gr.begin(), gr.end(), 0.0);
+        for (std::size_t i = 0; i + 1 < x.size(); i++) {
+            double t1 = x[i + 1] - x[i] * x[i];
+            double t2 = 1 - x[i];
+            result += 100 * t1 * t1 + t2 * t2;
+            gr[i] += -400 * x[i] * t1 - 2 * t2;
+            gr[i + 1] += 200 * t1;
+        }
+        return result;
+    }
+};
+
+void run(int n, int m, bool twoLoopRecursion) {
+    l_bfgs_b<std::vector<double> > solver(m);
+    solver.set_max_iterations(100);
+    solver.set_two_loop_recursion(twoLoopRecursion);
+    double inf = std::numeric_limits<double>::infinity();
+    std::vector<double> lb(n, -inf), ub(n, inf), x(n, -1.2);
+    l_bfgs_b_result result = solver.optimize(chained_rosenbrock(), lb, ub, x);
+    std::cout << n << "\t" << m << "\t" << (twoLoopRecursion ? "two-loop" : "compact") << "\t"
+              << result.iterations << "\t" << result.evaluations << "\t" << result.f << "\t"
+              << 1e6 * result.stats.solver_time() / result.iterations << std::endl;
+}
+
+int main() {
+    std::cout << "n\tm\tpath\t\titers\tevals\tf\tsolver (us/iter)" << std::endl;
+    for (int n = 1000; n <= 1000000; n *= 10) {
+        for (int m : {5, 20}) {
+            run(n, m, false);
+            run(n, m, true);
+        }
+    }
+    return 0;
+}
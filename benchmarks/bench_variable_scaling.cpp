@@ -0,0 +1,143 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Iterations and evaluations needed to solve ill-scaled variants of the test
+// functions, f(z / c) with the magnitudes c of the parameters spanning 1e-6 to
+// 1e4, without scaling, with the scales c given by the user and with the
+// automatic scaling. The initial points have the right magnitudes and the
+// error is the largest error of the parameters relative to their magnitudes.
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+
+struct chained_rosenbrock {
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double result = 0;
+        int n = x.size();
+        std::fill(gr.begin(), gr.end(), 0.0);
+        for (int i = 0; i + 1 < n; i++) {
+            double t1 = x[i + 1] - x[i] * x[i];
+            double t2 = 1 - x[i];
+            result += 100 * t1 * t1 + t2 * t2;
+            gr[i] += -400 * x[i] * t1 - 2 * t2;
+            gr[i + 1] += 200 * t1;
+        }
+        return result;
+    }
+};
+
+struct beale {
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double t1 = 1.5 - x[0] + x[0] * x[1];
+        double t2 = 2.25 - x[0] + x[0] * x[1] * x[1];
+        double t3 = 2.625 - x[0] + x[0] * x[1] * x[1] * x[1];
+        gr[0] = 2 * t1 * (x[1] - 1) + 2 * t2 * (x[1] * x[1] - 1) + 2 * t3 * (x[1] * x[1] * x[1] - 1);
+        gr[1] = 2 * t1 * x[0] + 4 * t2 * x[0] * x[1] + 6 * t3 * x[0] * x[1] * x[1];
+        return t1 * t1 + t2 * t2 + t3 * t3;
+    }
+};
+
+// convex quadratic sum_i (x_i - 1)^2 + (x_i - x_{i+1})^2 / 2
+struct coupled_quadratic {
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double result = 0;
+        int n = x.size();
+        for (int i = 0; i < n; i++) {
+            result += (x[i] - 1) * (x[i] - 1);
+            gr[i] = 2 * (x[i] - 1);
+        }
+        for (int i = 0; i + 1 < n; i++) {
+            double t = x[i] - x[i + 1];
+            result += 0.5 * t * t;
+            gr[i] += t;
+            gr[i + 1] -= t;
+        }
+        return result;
+    }
+};
+
+// f(z / c): the parameter z_i has magnitude c_i
+template<class F>
+struct ill_scaled {
+    F f;
+    std::vector<double> c;
+    mutable std::vector<double> x;
+    mutable std::vector<double> gx;
+
+    double operator()(const std::vector<double> &z, std::vector<double> &gr) const {
+        int n = z.size();
+        x.resize(n);
+        gx.resize(n);
+        for (int i = 0; i < n; i++) {
+            x[i] = z[i] / c[i];
+        }
+        double result = f(x, gx);
+        for (int i = 0; i < n; i++) {
+            gr[i] = gx[i] / c[i];
+        }
+        return result;
+    }
+};
+
+// magnitudes log-spaced between 1e-6 and 1e4, in a scrambled order
+std::vector<double> magnitudes(int n) {
+    std::vector<double> c(n);
+    for (int i = 0; i < n; i++) {
+        int k = (7 * i) % n;
+        c[i] = std::pow(10.0, -6 + 10.0 * k / std::max(n - 1, 1));
+    }
+    return c;
+}
+
+template<class F>
+void run(const std::string &name, F f, int n, double lower, double upper, const std::vector<double> &start,
+         const std::vector<double> &solution) {
+    ill_scaled<F> objective = {f, magnitudes(n), {}, {}};
+    std::vector<double> lb(n), ub(n), x0(n);
+    for (int i = 0; i < n; i++) {
+        lb[i] = lower * objective.c[i];
+        ub[i] = upper * objective.c[i];
+        x0[i] = start[i % start.size()] * objective.c[i];
+    }
+    const char *modes[] = {"none", "manual", "automatic"};
+    for (int mode = 0; mode < 3; mode++) {
+        l_bfgs_b<std::vector<double> > solver(5, 100000, 1e7, 1e-12);
+        if (mode == 1) {
+            solver.set_variable_scales(objective.c);
+        } else if (mode == 2) {
+            solver.set_variable_scaling(variable_scaling::automatic);
+        }
+        std::vector<double> z = x0;
+        l_bfgs_b_result result = solver.optimize(objective, lb, ub, z);
+        // relative error of the parameters
+        double error = 0;
+        for (int i = 0; i < n; i++) {
+            error = std::max(error, std::abs(z[i] / objective.c[i] - solution[i % solution.size()]));
+        }
+        std::cout << name << "\t" << n << "\t" << modes[mode] << (mode == 2 ? "\t" : "\t\t")
+                  << result.iterations << "\t\t" << result.evaluations << "\t\t" << result.f << "\t"
+                  << error << std::endl;
+    }
+}
+
+int main() {
+    double inf = std::numeric_limits<double>::infinity();
+    std::cout << "problem\t\tn\tscaling\t\titerations\tevaluations\tf\t\terror" << std::endl;
+    run("beale\t", beale(), 2, -inf, inf, {1, 1}, {3, 0.5});
+    run("rosenbrock", chained_rosenbrock(), 2, -inf, inf, {-1.2, 1}, {1});
+    run("rosenbrock", chained_rosenbrock(), 20, -2, 2, {-1.2, 1}, {1});
+    run("rosenbrock", chained_rosenbrock(), 100, -inf, inf, {-1.2, 1}, {1});
+    run("quadratic", coupled_quadratic(), 1000, -inf, inf, {0.5}, {1});
+    // the upper bound is active for all the parameters
+    run("quadratic", coupled_quadratic(), 1000, -0.5, 0.9, {0.5}, {0.9});
+    return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Function evaluations needed to follow a homotopy sequence of problems, solving
+// each one from the solution of the previous one: cold starts against warm
+// starts that reuse the limited-memory corrections of the previous solve.
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+
+// ill-conditioned quadratic whose minimizer moves with t; the lower bound is
+// active for part of the coordinates
+struct moving_quadratic {
+    int n;
+    double t;
+
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double result = 0;
+        for (int i = 0; i < n; i++) {
+            double d = std::pow(10.0, 3.0 * i / (n - 1));
+            double residual = x[i] - std::sin(i + t);
+            result += 0.5 * d * residual * residual;
+            gr[i] = d * residual;
+        }
+        return result;
+    }
+};
+
+// extended Rosenbrock function with minimizer (a, a^2, a, a^2, ...), a = 1 + t
+struct moving_rosenbrock {
+    int n;
+    double t;
+
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double a = 1 + t;
+        double result = 0;
+        for (int i = 0; i < n; i += 2) {
+            double t1 = x[i + 1] - x[i] * x[i];
+            double t2 = a - x[i];
+            result += 100 * t1 * t1 + t2 * t2;
+            gr[i] = -400 * x[i] * t1 - 2 * t2;
+            gr[i + 1] = 200 * t1;
+        }
+        return result;
+    }
+};
+
+template<class F>
+void follow_homotopy(const std::string &name, F objective, const std::vector<double> &lb,
+                     const std::vector<double> &ub, int noSteps, bool warmStart) {
+    l_bfgs_b<std::vector<double> > solver(10, 10000, 1e7, 1e-6);
+    solver.set_warm_start(warmStart);
+    std::vector<double> x(objective.n, 0.5);
+    int evaluations = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int step = 0; step <= noSteps; step++) {
+        objective.t = static_cast<double>(step) / noSteps;
+        evaluations += solver.optimize(objective, lb, ub, x).evaluations;
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << name << "\t" << objective.n << "\t" << (warmStart ? "warm" : "cold") << "\t"
+              << evaluations << "\t\t" << std::chrono::duration<double, std::milli>(end - start).count()
+              << std::endl;
+}
+
+int main() {
+    int noSteps = 50;
+    double inf = std::numeric_limits<double>::infinity();
+    std::cout << "problem\t\tn\tstart\tevaluations\ttime (ms)" << std::endl;
+    for (int n : {100, 1000}) {
+        std::vector<double> lb(n, -0.5), ub(n, inf);
+        for (bool warmStart : {false, true}) {
+            follow_homotopy("quadratic", moving_quadratic{n, 0}, lb, ub, noSteps, warmStart);
+        }
+    }
+    for (int n : {100, 1000}) {
+        std::vector<double> lb(n, -inf), ub(n, inf);
+        for (bool warmStart : {false, true}) {
+            follow_homotopy("rosenbrock", moving_rosenbrock{n, 0}, lb, ub, noSteps, warmStart);
+        }
+    }
+    return 0;
+}
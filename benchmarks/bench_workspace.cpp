@@ -0,0 +1,73 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Compares repeated solves of same-shaped problems allocating a new workspace
+// per solve (the behaviour of older versions) against reusing one workspace.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <lbfgsb_cpp/problem.h>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+
+class shifted_quadratic : public problem<std::vector<double> > {
+public:
+    shifted_quadratic(int inputDimension) : problem<std::vector<double> >(inputDimension) {}
+
+    double operator()(const std::vector<double> &x) {
+        double result = 0;
+        for (int i = 0; i < mInputDimension; i++) {
+            result += (i + 1) * (x[i] - 1) * (x[i] - 1);
+        }
+        return result;
+    }
+
+    void gradient(const std::vector<double> &x, std::vector<double> &gr) {
+        for (int i = 0; i < mInputDimension; i++) {
+            gr[i] = 2 * (i + 1) * (x[i] - 1);
+        }
+    }
+};
+
+template<class F>
+double time_per_solve(int noSolves, F solve) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < noSolves; i++) {
+        solve();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count() / noSolves;
+}
+
+int main() {
+    int noSolves = 2000;
+    std::cout << "n\tm\tfresh (us/solve)\treused (us/solve)" << std::endl;
+    for (int n : {10, 100, 1000, 10000}) {
+        for (int m : {5, 20}) {
+            shifted_quadratic pb(n);
+            pb.set_lower_bound(std::vector<double>(n, -10));
+            pb.set_upper_bound(std::vector<double>(n, 0.5));
+            l_bfgs_b<std::vector<double> > solver(m);
+            std::vector<double> x(n);
+            int solves = std::max(10, noSolves * 10 / n);
+
+            double fresh = time_per_solve(solves, [&]() {
+                l_bfgs_b_workspace<std::vector<double> > workspace;
+                std::fill(x.begin(), x.end(), -5);
+                solver.optimize(pb, x, workspace);
+            });
+            l_bfgs_b_workspace<std::vector<double> > workspace(n, m);
+            double reused = time_per_solve(solves, [&]() {
+                std::fill(x.begin(), x.end(), -5);
+                solver.optimize(pb, x, workspace);
+            });
+            std::cout << n << "\t" << m << "\t" << fresh << "\t\t\t" << reused << std::endl;
+        }
+    }
+    return 0;
+}
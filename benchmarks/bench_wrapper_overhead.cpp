@@ -0,0 +1,66 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Per-iteration overhead of the solver on tiny problems solved in a tight loop,
+// where the cost of the objective is negligible and the time is dominated by the
+// reverse-communication round trips between C++ and Fortran.
+
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+
+template<int N>
+struct chained_rosenbrock {
+    double operator()(const std::array<double, N> &x, std::array<double, N> &gr) const {
+        double result = 0;
+        gr.fill(0);
+        for (int i = 0; i + 1 < N; i++) {
+            double t1 = x[i + 1] - x[i] * x[i];
+            double t2 = 1 - x[i];
+            result += 100 * t1 * t1 + t2 * t2;
+            gr[i] += -400 * x[i] * t1 - 2 * t2;
+            gr[i + 1] += 200 * t1;
+        }
+        return result;
+    }
+};
+
+template<int N>
+void run(int noSolves) {
+    typedef std::array<double, N> vector;
+    l_bfgs_b<vector> solver;
+    vector lb, ub, x;
+    lb.fill(-10);
+    ub.fill(10);
+    chained_rosenbrock<N> objective;
+    long long iterations = 0;
+    long long calls = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < noSolves; i++) {
+        for (int j = 0; j < N; j++) {
+            x[j] = -1.2 + 0.001 * ((i + j) % 100);
+        }
+        l_bfgs_b_result result = solver.optimize(objective, lb, ub, x);
+        iterations += result.iterations;
+        // one call per evaluation and per new iterate, plus the initial one
+        calls += result.evaluations + result.iterations + 1;
+    }
+    auto end = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double, std::nano>(end - start).count();
+    std::cout << N << "\t" << elapsed / noSolves / 1000 << "\t\t" << elapsed / iterations << "\t\t"
+              << elapsed / calls << std::endl;
+}
+
+int main() {
+    int noSolves = 20000;
+    std::cout << "n\tsolve (us)\titeration (ns)\tcall (ns)" << std::endl;
+    run<2>(noSolves);
+    run<4>(noSolves);
+    run<8>(noSolves);
+    return 0;
+}
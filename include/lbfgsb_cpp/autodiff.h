@@ -0,0 +1,403 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef LBFGSB_CPP_AUTODIFF_H
+#define LBFGSB_CPP_AUTODIFF_H
+
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "problem.h"
+
+// Bump allocator of fixed-size chunks. clear() rewinds it without releasing the
+// chunks, so that a tape recorded once per iteration stops allocating after the
+// first evaluation. Elements never move, since chunks are not reallocated.
+template<class U>
+class arena {
+public:
+    arena() : mSize(0) {
+    }
+
+    std::size_t size() const {
+        return mSize;
+    }
+
+    // number of elements that can be stored without allocating
+    std::size_t capacity() const {
+        return mChunks.size() * chunk_size;
+    }
+
+    void clear() {
+        mSize = 0;
+    }
+
+    std::size_t push_back(const U &element) {
+        if (mSize == capacity()) {
+            mChunks.push_back(std::unique_ptr<U[]>(new U[chunk_size]));
+        }
+        (*this)[mSize] = element;
+        return mSize++;
+    }
+
+    U &operator[](std::size_t i) {
+        return mChunks[i >> chunk_bits][i & (chunk_size - 1)];
+    }
+
+    const U &operator[](std::size_t i) const {
+        return mChunks[i >> chunk_bits][i & (chunk_size - 1)];
+    }
+
+private:
+    static const std::size_t chunk_bits = 12;
+    static const std::size_t chunk_size = std::size_t(1) << chunk_bits;
+    std::vector<std::unique_ptr<U[]> > mChunks;
+    std::size_t mSize;
+};
+
+class ad_var;
+
+// Tape of the operations performed with ad_var's. Each node stores up to two
+// parents and the partial derivatives of the node with respect to them. Operations
+// are recorded on the tape activated in the current thread (see ad_tape::scope).
+class ad_tape {
+public:
+    struct node {
+        int parent[2];
+        double partial[2];
+    };
+
+    // Activates a tape in the current thread during its lifetime
+    class scope {
+    public:
+        scope(ad_tape &tape) : mPrevious(active()) {
+            active() = &tape;
+        }
+
+        ~scope() {
+            active() = mPrevious;
+        }
+
+    private:
+        ad_tape *mPrevious;
+    };
+
+    ad_tape() = default;
+
+    // nodes recorded since the last clear
+    std::size_t size() const {
+        return mNodes.size();
+    }
+
+    void clear() {
+        mNodes.clear();
+    }
+
+    // independent variable
+    inline ad_var variable(double value);
+
+    // Propagate the adjoints from output to all the nodes of the tape. Use
+    // adjoint(x) afterwards to get the derivative of output with respect to x.
+    inline void backward(const ad_var &output);
+
+    inline double adjoint(const ad_var &x) const;
+
+    static ad_tape *&active() {
+        static thread_local ad_tape *tape = nullptr;
+        return tape;
+    }
+
+    int record(int parent0, double partial0, int parent1, double partial1) {
+        node newNode = {{parent0, parent1}, {partial0, partial1}};
+        return mNodes.push_back(newNode);
+    }
+
+private:
+    arena<node> mNodes;
+    std::vector<double> mAdjoints;
+};
+
+// Scalar recording the operations in which it takes part for reverse-mode
+// automatic differentiation. A default-constructed ad_var or one built from a
+// double is a constant, which is never recorded.
+class ad_var {
+public:
+    ad_var() : mValue(0), mIndex(-1) {
+    }
+
+    ad_var(double value) : mValue(value), mIndex(-1) {
+    }
+
+    ad_var(double value, int index) : mValue(value), mIndex(index) {
+    }
+
+    double value() const {
+        return mValue;
+    }
+
+    int index() const {
+        return mIndex;
+    }
+
+    bool is_constant() const {
+        return mIndex < 0;
+    }
+
+    ad_var &operator+=(const ad_var &other);
+
+    ad_var &operator-=(const ad_var &other);
+
+    ad_var &operator*=(const ad_var &other);
+
+    ad_var &operator/=(const ad_var &other);
+
+    // result of an operation with partial derivatives da (and db) with respect to a (and b)
+    static ad_var record(double value, const ad_var &a, double da) {
+        if (a.is_constant()) {
+            return ad_var(value);
+        }
+        return ad_var(value, tape().record(a.mIndex, da, -1, 0));
+    }
+
+    static ad_var record(double value, const ad_var &a, double da, const ad_var &b, double db) {
+        if (a.is_constant()) {
+            return record(value, b, db);
+        }
+        if (b.is_constant()) {
+            return record(value, a, da);
+        }
+        return ad_var(value, tape().record(a.mIndex, da, b.mIndex, db));
+    }
+
+private:
+    double mValue;
+    int mIndex;
+
+    static ad_tape &tape() {
+        ad_tape *tape = ad_tape::active();
+        if (!tape) {
+            throw std::logic_error("No active ad_tape in the current thread");
+        }
+        return *tape;
+    }
+};
+
+ad_var ad_tape::variable(double value) {
+    return ad_var(value, record(-1, 0, -1, 0));
+}
+
+void ad_tape::backward(const ad_var &output) {
+    std::size_t noNodes = mNodes.size();
+    mAdjoints.assign(noNodes, 0.0);
+    if (output.is_constant()) {
+        return;
+    }
+    mAdjoints[output.index()] = 1.0;
+    for (std::size_t i = noNodes; i-- > 0;) {
+        double adjoint = mAdjoints[i];
+        if (adjoint == 0) {
+            continue;
+        }
+        const node &current = mNodes[i];
+        if (current.parent[0] >= 0) {
+            mAdjoints[current.parent[0]] += current.partial[0] * adjoint;
+        }
+        if (current.parent[1] >= 0) {
+            mAdjoints[current.parent[1]] += current.partial[1] * adjoint;
+        }
+    }
+}
+
+double ad_tape::adjoint(const ad_var &x) const {
+    if (x.is_constant() || x.index() >= static_cast<int>(mAdjoints.size())) {
+        return 0;
+    }
+    return mAdjoints[x.index()];
+}
+
+inline ad_var operator+(const ad_var &a, const ad_var &b) {
+    return ad_var::record(a.value() + b.value(), a, 1, b, 1);
+}
+
+inline ad_var operator-(const ad_var &a, const ad_var &b) {
+    return ad_var::record(a.value() - b.value(), a, 1, b, -1);
+}
+
+inline ad_var operator*(const ad_var &a, const ad_var &b) {
+    return ad_var::record(a.value() * b.value(), a, b.value(), b, a.value());
+}
+
+inline ad_var operator/(const ad_var &a, const ad_var &b) {
+    double result = a.value() / b.value();
+    return ad_var::record(result, a, 1 / b.value(), b, -result / b.value());
+}
+
+inline ad_var operator-(const ad_var &a) {
+    return ad_var::record(-a.value(), a, -1);
+}
+
+inline ad_var operator+(const ad_var &a) {
+    return a;
+}
+
+inline ad_var &ad_var::operator+=(const ad_var &other) {
+    return *this = *this + other;
+}
+
+inline ad_var &ad_var::operator-=(const ad_var &other) {
+    return *this = *this - other;
+}
+
+inline ad_var &ad_var::operator*=(const ad_var &other) {
+    return *this = *this * other;
+}
+
+inline ad_var &ad_var::operator/=(const ad_var &other) {
+    return *this = *this / other;
+}
+
+inline bool operator<(const ad_var &a, const ad_var &b) {
+    return a.value() < b.value();
+}
+
+inline bool operator>(const ad_var &a, const ad_var &b) {
+    return a.value() > b.value();
+}
+
+inline bool operator<=(const ad_var &a, const ad_var &b) {
+    return a.value() <= b.value();
+}
+
+inline bool operator>=(const ad_var &a, const ad_var &b) {
+    return a.value() >= b.value();
+}
+
+inline bool operator==(const ad_var &a, const ad_var &b) {
+    return a.value() == b.value();
+}
+
+inline bool operator!=(const ad_var &a, const ad_var &b) {
+    return a.value() != b.value();
+}
+
+// Mathematical functions are found by argument-dependent lookup: generic code
+// should call them unqualified after "using std::exp;" etc.
+inline ad_var exp(const ad_var &a) {
+    double result = std::exp(a.value());
+    return ad_var::record(result, a, result);
+}
+
+inline ad_var log(const ad_var &a) {
+    return ad_var::record(std::log(a.value()), a, 1 / a.value());
+}
+
+inline ad_var sqrt(const ad_var &a) {
+    double result = std::sqrt(a.value());
+    return ad_var::record(result, a, 0.5 / result);
+}
+
+inline ad_var pow(const ad_var &a, double b) {
+    return ad_var::record(std::pow(a.value(), b), a, b * std::pow(a.value(), b - 1));
+}
+
+inline ad_var pow(double a, const ad_var &b) {
+    double result = std::pow(a, b.value());
+    return ad_var::record(result, b, result * std::log(a));
+}
+
+inline ad_var pow(const ad_var &a, const ad_var &b) {
+    double result = std::pow(a.value(), b.value());
+    return ad_var::record(result, a, b.value() * std::pow(a.value(), b.value() - 1),
+                          b, (a.value() > 0) ? result * std::log(a.value()) : 0.0);
+}
+
+inline ad_var sin(const ad_var &a) {
+    return ad_var::record(std::sin(a.value()), a, std::cos(a.value()));
+}
+
+inline ad_var cos(const ad_var &a) {
+    return ad_var::record(std::cos(a.value()), a, -std::sin(a.value()));
+}
+
+inline ad_var tanh(const ad_var &a) {
+    double result = std::tanh(a.value());
+    return ad_var::record(result, a, 1 - result * result);
+}
+
+inline ad_var abs(const ad_var &a) {
+    return ad_var::record(std::abs(a.value()), a, (a.value() < 0) ? -1.0 : 1.0);
+}
+
+// Problem whose gradient is computed by reverse-mode automatic differentiation.
+// The objective is written once as a functor accepting both a
+// std::vector<double> and a std::vector<ad_var>, e.g.
+//
+//   struct objective {
+//       template<class S>
+//       S operator()(const std::vector<S> &x) const { ... }
+//   };
+//
+// The gradient costs a small constant multiple of an evaluation of the objective.
+// The tape and its buffers are reused between evaluations, so, after the first
+// evaluation, gradients do not allocate unless the tape grows. Each problem owns a
+// tape: do not evaluate the same problem from several threads at the same time.
+template<class T, class F>
+class autodiff_problem : public problem<T> {
+public:
+    autodiff_problem(int inputDimension, const F &functor = F()) :
+            problem<T>(inputDimension),
+            mFunctor(functor), mPoint(inputDimension), mVariables(inputDimension) {
+    }
+
+    autodiff_problem(int inputDimension, const T &lowerBound, const T &upperBound, const F &functor = F()) :
+            problem<T>(inputDimension, lowerBound, upperBound),
+            mFunctor(functor), mPoint(inputDimension), mVariables(inputDimension) {
+    }
+
+    double operator()(const T &x) {
+        for (int i = 0; i < this->mInputDimension; i++) {
+            mPoint[i] = x[i];
+        }
+        return mFunctor(mPoint);
+    }
+
+    void gradient(const T &x, T &gr) {
+        value_and_gradient(x, gr);
+    }
+
+    double value_and_gradient(const T &x, T &gr) {
+        mTape.clear();
+        ad_tape::scope scope(mTape);
+        for (int i = 0; i < this->mInputDimension; i++) {
+            mVariables[i] = mTape.variable(x[i]);
+        }
+        ad_var result = mFunctor(mVariables);
+        mTape.backward(result);
+        for (int i = 0; i < this->mInputDimension; i++) {
+            gr[i] = mTape.adjoint(mVariables[i]);
+        }
+        return result.value();
+    }
+
+    const F &get_functor() const {
+        return mFunctor;
+    }
+
+    // number of operations recorded in the last gradient evaluation
+    std::size_t get_tape_size() const {
+        return mTape.size();
+    }
+
+private:
+    F mFunctor;
+    ad_tape mTape;
+    std::vector<double> mPoint;
+    std::vector<ad_var> mVariables;
+};
+
+#endif //LBFGSB_CPP_AUTODIFF_H
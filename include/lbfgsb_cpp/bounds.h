@@ -0,0 +1,117 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef LBFGSB_CPP_BOUNDS_H
+#define LBFGSB_CPP_BOUNDS_H
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+// Box constraints in the form required by the Fortran routine: the lower and
+// upper bounds and the type of each constraint (nbd). The bounds may be updated
+// coordinate by coordinate; only the modified coordinates are reclassified, so
+// that updating k bounds between two solves costs O(k) instead of O(n). The
+// accessors do not modify the block, so that several threads may read it.
+template<class T>
+class bounds_block {
+public:
+    bounds_block() = default;
+
+    // lowerBound and upperBound should have been validated by the caller
+    bounds_block(const T &lowerBound, const T &upperBound) {
+        assign(lowerBound, upperBound);
+    }
+
+    int size() const {
+        return mNbd.size();
+    }
+
+    const T &get_lower_bound() const {
+        return mLowerBound;
+    }
+
+    const T &get_upper_bound() const {
+        return mUpperBound;
+    }
+
+    // Replace all the bounds. Only the coordinates whose bounds change are
+    // reclassified (all of them if the dimension changes).
+    void assign(const T &lowerBound, const T &upperBound) {
+        int n = lowerBound.size();
+        if (n != size()) {
+            mLowerBound = lowerBound;
+            mUpperBound = upperBound;
+            mNbd.resize(n);
+            for (int i = 0; i < n; ++i) {
+                mNbd[i] = classify(mLowerBound[i], mUpperBound[i]);
+            }
+            return;
+        }
+        for (int i = 0; i < n; ++i) {
+            if (mLowerBound[i] != lowerBound[i] || mUpperBound[i] != upperBound[i]) {
+                mLowerBound[i] = lowerBound[i];
+                mUpperBound[i] = upperBound[i];
+                mNbd[i] = classify(mLowerBound[i], mUpperBound[i]);
+            }
+        }
+    }
+
+    void set_lower_bound(int i, double lowerBound) {
+        set_bounds(i, lowerBound, get_coordinate(mUpperBound, i));
+    }
+
+    void set_upper_bound(int i, double upperBound) {
+        set_bounds(i, get_coordinate(mLowerBound, i), upperBound);
+    }
+
+    void set_bounds(int i, double lowerBound, double upperBound) {
+        check_coordinate(i);
+        if (lowerBound > upperBound) {
+            throw std::invalid_argument("Incompatible bounds (lowerBound > upperBound)");
+        }
+        mLowerBound[i] = lowerBound;
+        mUpperBound[i] = upperBound;
+        mNbd[i] = classify(lowerBound, upperBound);
+    }
+
+    // Type of each constraint, as expected by the Fortran routine
+    const int *get_nbd() const {
+        return mNbd.data();
+    }
+
+    // nbd(i)=0 if x(i) is unbounded,
+    // 1 if x(i) has only a lower bound,
+    // 2 if x(i) has both lower and upper bounds, and
+    // 3 if x(i) has only an upper bound.
+    static int classify(double lowerBound, double upperBound) {
+        bool hasLowerBound = !std::isinf(lowerBound);
+        bool hasUpperBound = !std::isinf(upperBound);
+        if (hasLowerBound) {
+            return hasUpperBound ? 2 : 1;
+        }
+        return hasUpperBound ? 3 : 0;
+    }
+
+private:
+    T mLowerBound;
+    T mUpperBound;
+    std::vector<int> mNbd;
+
+    void check_coordinate(int i) const {
+        if (i < 0 || i >= size()) {
+            throw std::invalid_argument("Coordinate out of range [0, inputDimension)");
+        }
+    }
+
+    double get_coordinate(const T &bound, int i) const {
+        check_coordinate(i);
+        return bound[i];
+    }
+};
+
+#endif //LBFGSB_CPP_BOUNDS_H
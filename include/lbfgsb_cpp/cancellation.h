@@ -0,0 +1,40 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef LBFGSB_CPP_CANCELLATION_H
+#define LBFGSB_CPP_CANCELLATION_H
+
+#include <atomic>
+#include <memory>
+
+// Flag used to cancel solves from another thread. Copies of a token share the
+// same flag, so a token can be given to a solver (and thus to all the solves of
+// a batch) and cancelled later through any copy. Solves check the flag after
+// every evaluation of the objective.
+class cancellation_token {
+public:
+    cancellation_token() : mCancelled(std::make_shared<std::atomic<bool> >(false)) {
+    }
+
+    void cancel() {
+        mCancelled->store(true, std::memory_order_release);
+    }
+
+    bool is_cancelled() const {
+        return mCancelled->load(std::memory_order_acquire);
+    }
+
+    // allow the token to be used again (for new solves)
+    void reset() {
+        mCancelled->store(false, std::memory_order_release);
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool> > mCancelled;
+};
+
+#endif //LBFGSB_CPP_CANCELLATION_H
@@ -0,0 +1,140 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef LBFGSB_CPP_CHECKPOINT_H
+#define LBFGSB_CPP_CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include "tasks.h"
+
+namespace l_bfgs_b_utils {
+    // Binary snapshot of the reverse-communication state of a solve. The file
+    // starts with a fixed header (magic, format version, shape and scalar state)
+    // followed by the raw arrays, in the native byte order. Checkpoints are only
+    // meant to be read by the same build on the same platform.
+    struct checkpoint_header {
+        char magic[8];
+        std::uint32_t version;
+        // sizeof(double) + 256 * sizeof(int) + 65536 * sizeof(bool), to reject
+        // files written with a different data model
+        std::uint32_t layout;
+        std::int32_t inputDimension;
+        std::int32_t memorySize;
+        std::int32_t task;
+        std::int32_t csave;
+        // 1 if the iterate is scaled: the scales follow the gradient
+        std::int32_t scaled;
+        // evaluations counted by the wrapper, which include those of the
+        // automatic scaling
+        std::int32_t evaluations;
+        // options of the engine (see l_bfgs_b_options), which have to match
+        // those of the resumed solve
+        std::int32_t options[l_bfgs_b_options::size];
+        double f;
+        double realOptions[l_bfgs_b_options::size];
+
+        static const std::uint32_t current_version = 4;
+
+        static std::uint32_t native_layout() {
+            return sizeof(double) + 256 * sizeof(int) + 65536 * sizeof(bool);
+        }
+
+        static checkpoint_header make(int inputDimension, int memorySize, int task, int csave, bool scaled,
+                                      int evaluations, const int options[], const double realOptions[],
+                                      double f) {
+            checkpoint_header header;
+            std::memcpy(header.magic, "LBFGSBCK", sizeof(header.magic));
+            header.version = current_version;
+            header.layout = native_layout();
+            header.inputDimension = inputDimension;
+            header.memorySize = memorySize;
+            header.task = task;
+            header.csave = csave;
+            header.scaled = scaled ? 1 : 0;
+            header.evaluations = evaluations;
+            for (int i = 0; i < l_bfgs_b_options::size; i++) {
+                header.options[i] = options[i];
+                header.realOptions[i] = realOptions[i];
+            }
+            header.f = f;
+            return header;
+        }
+    };
+
+    // Writes a checkpoint atomically: the data goes to a temporary file that
+    // replaces path once it has been completely written, so that a process
+    // killed while writing leaves the previous checkpoint intact.
+    class checkpoint_writer {
+    public:
+        checkpoint_writer(const std::string &path, const checkpoint_header &header) :
+                mPath(path), mTemporaryPath(path + ".tmp"),
+                mStream(mTemporaryPath.c_str(), std::ios::binary | std::ios::trunc) {
+            if (!mStream) {
+                throw std::runtime_error("Could not open " + mTemporaryPath + " for writing");
+            }
+            write(&header, sizeof(header));
+        }
+
+        void write(const void *data, std::size_t bytes) {
+            mStream.write(static_cast<const char *>(data), bytes);
+        }
+
+        void commit() {
+            mStream.close();
+            if (mStream.fail() || std::rename(mTemporaryPath.c_str(), mPath.c_str()) != 0) {
+                std::remove(mTemporaryPath.c_str());
+                throw std::runtime_error("Could not write the checkpoint " + mPath);
+            }
+        }
+
+    private:
+        std::string mPath;
+        std::string mTemporaryPath;
+        std::ofstream mStream;
+    };
+
+    class checkpoint_reader {
+    public:
+        checkpoint_reader(const std::string &path) : mPath(path), mStream(path.c_str(), std::ios::binary) {
+            if (!mStream) {
+                throw std::runtime_error("Could not open the checkpoint " + path);
+            }
+            read(&mHeader, sizeof(mHeader));
+            if (std::memcmp(mHeader.magic, "LBFGSBCK", sizeof(mHeader.magic)) != 0) {
+                throw std::runtime_error(path + " is not a checkpoint");
+            }
+            if (mHeader.version != checkpoint_header::current_version ||
+                mHeader.layout != checkpoint_header::native_layout()) {
+                throw std::runtime_error("Unsupported checkpoint version or platform in " + path);
+            }
+        }
+
+        const checkpoint_header &get_header() const {
+            return mHeader;
+        }
+
+        void read(void *data, std::size_t bytes) {
+            mStream.read(static_cast<char *>(data), bytes);
+            if (!mStream) {
+                throw std::runtime_error("Truncated checkpoint " + mPath);
+            }
+        }
+
+    private:
+        std::string mPath;
+        std::ifstream mStream;
+        checkpoint_header mHeader;
+    };
+}
+
+#endif //LBFGSB_CPP_CHECKPOINT_H
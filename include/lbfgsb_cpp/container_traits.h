@@ -0,0 +1,87 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef LBFGSB_CPP_CONTAINER_TRAITS_H
+#define LBFGSB_CPP_CONTAINER_TRAITS_H
+
+#include <type_traits>
+#include <utility>
+
+namespace l_bfgs_b_utils {
+    namespace detail {
+        // C exposes its storage through data(), as std::vector, std::array and Eigen do
+        template<class C, class = void>
+        struct has_data : std::false_type {
+        };
+
+        template<class C>
+        struct has_data<C, typename std::enable_if<
+                std::is_convertible<decltype(std::declval<C &>().data()), const double *>::value>::type>
+                : std::true_type {
+        };
+
+        // C exposes its storage through memptr(), as armadillo does
+        template<class C, class = void>
+        struct has_memptr : std::false_type {
+        };
+
+        template<class C>
+        struct has_memptr<C, typename std::enable_if<
+                std::is_convertible<decltype(std::declval<C &>().memptr()), const double *>::value>::type>
+                : std::true_type {
+        };
+    }
+
+    // C is known to store its doubles contiguously
+    template<class C>
+    struct is_contiguous_container
+            : std::integral_constant<bool, detail::has_data<C>::value || detail::has_memptr<C>::value> {
+    };
+
+    // Access to the contiguous storage of the doubles held by a container, so that
+    // it can be handed to the Fortran routine without copies. For containers that
+    // are not known to be contiguous, the element addresses are obtained through
+    // operator[] (valid only if the elements are actually contiguous, as required
+    // for x and the gradient).
+    template<class C>
+    struct container_traits {
+        static double *data(C &x) {
+            return data(x, std::integral_constant<int, selector>());
+        }
+
+        static const double *data(const C &x) {
+            return data(const_cast<C &>(x));
+        }
+
+    private:
+        static const int selector = detail::has_data<C>::value ? 0 : (detail::has_memptr<C>::value ? 1 : 2);
+
+        static double *data(C &x, std::integral_constant<int, 0>) {
+            return x.data();
+        }
+
+        static double *data(C &x, std::integral_constant<int, 1>) {
+            return x.memptr();
+        }
+
+        static double *data(C &x, std::integral_constant<int, 2>) {
+            return &x[0];
+        }
+    };
+
+    template<class C>
+    double *data_pointer(C &x) {
+        return container_traits<C>::data(x);
+    }
+
+    template<class C>
+    const double *data_pointer(const C &x) {
+        return container_traits<C>::data(x);
+    }
+}
+
+#endif //LBFGSB_CPP_CONTAINER_TRAITS_H
@@ -0,0 +1,260 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef LBFGSB_CPP_GROUPED_DIFFERENCES_H
+#define LBFGSB_CPP_GROUPED_DIFFERENCES_H
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "utils.h"
+
+// Coupling structure of a partially separable objective f(x) = sum_k f_k(x),
+// where each element f_k depends only on a few variables. Two variables that
+// never appear in the same element can be perturbed at the same time when
+// differencing the vector of element values (i.e., the sparse Jacobian of
+// [f_1, ..., f_K]), since each element only "sees" one of them. The variables
+// are grouped by a greedy coloring of this conflict graph, so that the gradient
+// costs O(number of colors) evaluations instead of O(n). For instance, a chain
+// of elements f_k(x_k, x_{k+1}) (like the Rosenbrock function) requires 2 colors
+// whatever n is.
+class coupling_structure {
+public:
+    // elementVariables[k] lists the variables on which the k-th element depends
+    coupling_structure(int inputDimension, const std::vector<std::vector<int> > &elementVariables) :
+            mInputDimension(inputDimension),
+            mNoElements(elementVariables.size()),
+            mColors(inputDimension, -1) {
+        if (inputDimension < 1) {
+            throw std::invalid_argument("inputDimension should be >= 1");
+        }
+        for (const auto &variables : elementVariables) {
+            for (int variable : variables) {
+                if (variable < 0 || variable >= inputDimension) {
+                    throw std::invalid_argument("Element variable out of range [0, inputDimension)");
+                }
+            }
+        }
+        color_variables(elementVariables);
+        group_pairs(elementVariables);
+    }
+
+    int get_input_dimension() const {
+        return mInputDimension;
+    }
+
+    int get_number_of_elements() const {
+        return mNoElements;
+    }
+
+    int get_number_of_colors() const {
+        return mPairs.size();
+    }
+
+    // color assigned to each variable
+    const std::vector<int> &get_colors() const {
+        return mColors;
+    }
+
+    // variables with the given color
+    const std::vector<int> &get_color_members(int color) const {
+        return mMembers[color];
+    }
+
+    // (element, variable) pairs such that the variable has the given color and
+    // the element depends on it. Each element appears at most once per color.
+    const std::vector<std::pair<int, int> > &get_color_pairs(int color) const {
+        return mPairs[color];
+    }
+
+private:
+    int mInputDimension;
+    int mNoElements;
+    std::vector<int> mColors;
+    std::vector<std::vector<int> > mMembers;
+    std::vector<std::vector<std::pair<int, int> > > mPairs;
+
+    // greedy coloring, visiting the variables by decreasing number of elements
+    void color_variables(const std::vector<std::vector<int> > &elementVariables) {
+        std::vector<std::vector<int> > variableElements(mInputDimension);
+        for (int k = 0; k < mNoElements; k++) {
+            for (int variable : elementVariables[k]) {
+                variableElements[variable].push_back(k);
+            }
+        }
+        std::vector<int> order(mInputDimension);
+        for (int i = 0; i < mInputDimension; i++) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](int i, int j) {
+            return variableElements[i].size() > variableElements[j].size();
+        });
+
+        // forbidden[c] == i if color c is used by a neighbour of variable i
+        std::vector<int> forbidden;
+        int noColors = 0;
+        for (int i : order) {
+            for (int k : variableElements[i]) {
+                for (int neighbour : elementVariables[k]) {
+                    int color = mColors[neighbour];
+                    if (color >= 0) {
+                        forbidden[color] = i;
+                    }
+                }
+            }
+            int color = 0;
+            while (color < noColors && forbidden[color] == i) {
+                color++;
+            }
+            if (color == noColors) {
+                noColors++;
+                forbidden.push_back(-1);
+            }
+            mColors[i] = color;
+        }
+        mMembers.resize(noColors);
+        for (int i = 0; i < mInputDimension; i++) {
+            mMembers[mColors[i]].push_back(i);
+        }
+        mPairs.resize(noColors);
+    }
+
+    void group_pairs(const std::vector<std::vector<int> > &elementVariables) {
+        for (int k = 0; k < mNoElements; k++) {
+            std::vector<int> variables(elementVariables[k]);
+            // an element may list the same variable twice
+            std::sort(variables.begin(), variables.end());
+            variables.erase(std::unique(variables.begin(), variables.end()), variables.end());
+            for (int variable : variables) {
+                mPairs[mColors[variable]].push_back(std::make_pair(k, variable));
+            }
+        }
+    }
+};
+
+namespace l_bfgs_b_utils {
+    namespace detail {
+        // Scratch space of grouped_gradient, kept between calls so that they do
+        // not allocate once the dimensions are known
+        struct grouped_buffers {
+            struct worker_buffers {
+                std::vector<double> stepOver;
+                std::vector<double> stepBelow;
+                std::vector<double> valuesOver;
+                std::vector<double> valuesBelow;
+            };
+
+            std::vector<double> valuesAtX;
+            std::vector<worker_buffers> workers;
+        };
+
+        // In-place version of grouped_numerical_gradient. gr must have the size of x
+        // and each worker perturbs its own entry of workPoints.
+        template<class T, typename F>
+        void grouped_gradient(F &functor, const T &x, const coupling_structure &structure,
+                              const T &lowerBound, const T &upperBound, double gridSpacing,
+                              bool central, int noThreads, std::vector<T> &workPoints,
+                              grouped_buffers &scratch, T &gr) {
+            int inputDimension = x.size();
+            if (inputDimension != structure.get_input_dimension()) {
+                throw std::invalid_argument("The size of x does not match the coupling structure's dimension");
+            }
+            check_gradient_arguments(x, lowerBound, upperBound);
+            int noElements = structure.get_number_of_elements();
+            int noColors = structure.get_number_of_colors();
+
+            for (int i = 0; i < inputDimension; i++) {
+                gr[i] = 0;
+            }
+            std::vector<double> &valuesAtX = scratch.valuesAtX;
+            if (!central) {
+                valuesAtX.resize(noElements);
+                functor(x, valuesAtX);
+            }
+
+            int noWorkers = effective_thread_count(noColors, noThreads);
+            std::vector<grouped_buffers::worker_buffers> &buffers = scratch.workers;
+            if (static_cast<int>(buffers.size()) < noWorkers) {
+                buffers.resize(noWorkers);
+            }
+            prepare_work_points(x, noWorkers, workPoints);
+            for (int worker = 0; worker < noWorkers; worker++) {
+                grouped_buffers::worker_buffers &buffer = buffers[worker];
+                buffer.stepOver.resize(inputDimension);
+                buffer.stepBelow.resize(inputDimension);
+                buffer.valuesOver.resize(noElements);
+                buffer.valuesBelow.resize(noElements);
+            }
+
+            parallel_for(noColors, noWorkers, [&](int worker, int color) {
+                grouped_buffers::worker_buffers &buffer = buffers[worker];
+                T &workX = workPoints[worker];
+                const std::vector<int> &members = structure.get_color_members(color);
+                // perturb all the variables of the color at once
+                for (int i : members) {
+                    // one-sided steps are relative to x[i], as in one_sided_difference
+                    double h = central ? gridSpacing : gridSpacing * std::max(1.0, std::abs(x[i]));
+                    double over = ((x[i] + h) > upperBound[i]) ? upperBound[i] - x[i] : h;
+                    double below = ((x[i] - h) < lowerBound[i]) ? x[i] - lowerBound[i] : h;
+                    if (!central) {
+                        // one-sided step: forward if possible, else towards the farthest bound
+                        if (over < h && below >= over) {
+                            over = -below;
+                        }
+                        below = 0;
+                    }
+                    buffer.stepOver[i] = over;
+                    buffer.stepBelow[i] = below;
+                    workX[i] = x[i] + over;
+                }
+                functor(workX, buffer.valuesOver);
+                if (central) {
+                    for (int i : members) {
+                        workX[i] = x[i] - buffer.stepBelow[i];
+                    }
+                    functor(workX, buffer.valuesBelow);
+                }
+                for (int i : members) {
+                    workX[i] = x[i];
+                }
+                // each variable belongs to a single color, so no other worker writes gr[i]
+                const std::vector<double> &valuesBelow = central ? buffer.valuesBelow : valuesAtX;
+                for (const auto &pair : structure.get_color_pairs(color)) {
+                    int k = pair.first;
+                    int i = pair.second;
+                    double step = buffer.stepOver[i] + buffer.stepBelow[i];
+                    if (step != 0) {
+                        gr[i] += (buffer.valuesOver[k] - valuesBelow[k]) / step;
+                    }
+                }
+            });
+        }
+    }
+
+    // Gradient of a partially separable objective using grouped differences. The
+    // functor is called as functor(x, values) and must store the value of each
+    // element at x in values (of size structure.get_number_of_elements()). With
+    // central differences, each color costs 2 evaluations of the elements;
+    // otherwise, forward differences are used (1 evaluation per color, plus one at
+    // x). Steps are limited by the bounds as in numerical_gradient. The colors are
+    // distributed among noThreads threads (see parallel_numerical_gradient).
+    template<class T, typename F>
+    T grouped_numerical_gradient(F &functor, const T &x, const coupling_structure &structure,
+                                 const T &lowerBound, const T &upperBound, double gridSpacing,
+                                 bool central = true, int noThreads = 1) {
+        T gr(x);
+        std::vector<T> workPoints;
+        detail::grouped_buffers scratch;
+        detail::grouped_gradient(functor, x, structure, lowerBound, upperBound, gridSpacing, central,
+                                 noThreads, workPoints, scratch, gr);
+        return gr;
+    }
+}
+
+#endif //LBFGSB_CPP_GROUPED_DIFFERENCES_H
@@ -8,17 +8,150 @@
 #ifndef LBFGSB_CPP_WRAPPER_H
 #define LBFGSB_CPP_WRAPPER_H
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include "cancellation.h"
+#include "checkpoint.h"
+#include "container_traits.h"
 #include "problem.h"
+#include "scaling.h"
+#include "tasks.h"
+#include "trace.h"
+#include "workspace.h"
+#include "parallel.h"
 #include <vector>
 
 extern "C" {
+// task and csave are passed as the underlying int of the enum classes
 void setulb_wrapper(int *n, int *m, double x[], double l[], double u[], int nbd[], double *f,
-                    double g[], double *factr, double *pgtol, double wa[], int iwa[], int *itask,
-                    int *iprint, int *icsave, bool *lsave0, bool *lsave1, bool *lsave2, bool *lsave3,
-                    int isave[], double dsave[]);
+                    double g[], double *factr, double *pgtol, double wa[], int iwa[], l_bfgs_b_task *task,
+                    int *iprint, line_search_state *csave, bool lsave[], int isave[], double dsave[],
+                    int iopt[], double dopt[]);
 }
 
+// How the search of the generalized Cauchy point orders the breakpoints
+// (the steps at which the variables reach their bounds)
+enum class breakpoint_ordering {
+    // a binary heap over all the breakpoints, as in the original routine
+    heap,
+    // bulk selection of batches of the smallest breakpoints, which is faster
+    // when many breakpoints are crossed and is parallel in OpenMP builds
+    selection
+};
+
+// How the step along the search direction is chosen
+enum class line_search_policy {
+    // search for a step that satisfies the strong Wolfe conditions (More and
+    // Thuente), as in the original routine
+    more_thuente,
+    // backtracking from the unit step until the sufficient decrease (Armijo)
+    // condition holds. Accepted unit steps cost a single evaluation; steps
+    // that fail the curvature condition are only lengthened before the first
+    // backtrack
+    backtracking
+};
+
+// How the variables are scaled before being passed to the Fortran routine,
+// which minimizes f(scales * y) over y. Scaling the variables by their typical
+// magnitude (or 1 / sqrt of their curvature) helps with badly scaled models
+// whose parameters span many orders of magnitude
+enum class variable_scaling {
+    none,
+    // scales given by set_variable_scales
+    manual,
+    // scales estimated from the diagonal of the Hessian at the initial point,
+    // at the cost of one extra evaluation (see estimate_variable_scales). The
+    // initial point should have the magnitudes expected for the solution
+    automatic
+};
+
+// Where the time of a solve goes and how the iterations behaved. The engine
+// timings are the processor time accumulated by the Fortran routine; the
+// objective and total timings are wall times measured by the wrapper. All the
+// times are in seconds. A resumed solve also accounts for the engine timings
+// and counters before the checkpoint.
+struct l_bfgs_b_stats {
+    // time spent searching for generalized Cauchy points
+    double cauchyTime = 0;
+    // time spent in subspace minimizations
+    double subspaceTime = 0;
+    // time spent in line searches (excluding the evaluations of the objective)
+    double lineSearchTime = 0;
+    // time spent evaluating the objective and its gradient
+    double objectiveTime = 0;
+    double totalTime = 0;
+    // number of limited-memory updates since the memory was last reset (the
+    // engine resets it on numerical trouble; warm starts keep it)
+    int updates = 0;
+    // number of updates skipped because the curvature condition failed
+    int skippedUpdates = 0;
+    // total number of intervals explored in the search of Cauchy points
+    int cauchyIntervals = 0;
+    // free and active variables at the Cauchy point of the last iteration
+    int freeVariables = 0;
+    int activeVariables = 0;
+
+    // time spent outside the objective: if it is small compared to
+    // objectiveTime, the solve is objective-bound
+    double solver_time() const {
+        return totalTime - objectiveTime;
+    }
+};
+
+// Why a solve stopped
+enum class l_bfgs_b_status {
+    // the projected gradient or the relative reduction of the objective fell
+    // below their tolerances
+    converged,
+    max_iterations,
+    max_evaluations,
+    time_limit,
+    cancelled,
+    // the observer asked to stop
+    stopped_by_observer,
+    // the line search could not find a better point
+    abnormal_line_search,
+    // the input was rejected (task tells why)
+    error
+};
+
+// Summary of a call to l_bfgs_b::optimize
+struct l_bfgs_b_result {
+    // objective value at the returned point
+    double f = 0;
+    int iterations = 0;
+    // number of function and gradient evaluations
+    int evaluations = 0;
+    // last task returned by the Fortran routine
+    l_bfgs_b_task task = l_bfgs_b_task::start;
+    l_bfgs_b_status status = l_bfgs_b_status::converged;
+    l_bfgs_b_stats stats;
+};
+
+// Read-only view of a solve at a new iterate, passed to the observer. It refers
+// to the storage of the solver, so it is only valid during the call
+template<class T>
+struct l_bfgs_b_iteration {
+    const T &x;
+    double f;
+    // infinity norm of the projected gradient (with respect to the scaled
+    // variables, if the variables are scaled)
+    double projectedGradientNorm;
+    int iterations;
+    int evaluations;
+};
+
+// Called at every new iterate. Returning false stops the solve
+template<class T>
+using l_bfgs_b_observer = std::function<bool(const l_bfgs_b_iteration<T> &)>;
+
 template<class T>
 class l_bfgs_b {
 public:
@@ -102,81 +235,345 @@ public:
         mGradientScalingFactor = gradientScalingFactor;
     }
 
-    void optimize(problem<T> &pb, T &x0) {
-        int n = pb.get_input_dimension();
-        // prepare variables for the algorithm
-        std::vector<double> mLowerBound(n);
-        std::vector<double> mUpperBound(n);
-        std::vector<int> mNbd(n);
-        std::vector<double> mWorkArray(2 * mMemorySize * n + 5 * n +
-                                       11 * mMemorySize * mMemorySize + 8 * mMemorySize);
-        std::vector<int> mIntWorkArray(3 * n);
-
-        T lowerBound = pb.get_lower_bound();
-        T upperBound = pb.get_upper_bound();
-        bool hasLowerBound, hasUpperBound;
-        for (int i = 0; i < n; ++i) {
-            mLowerBound[i] = lowerBound[i];
-            mUpperBound[i] = upperBound[i];
-            hasLowerBound = !std::isinf(mLowerBound[i]);
-            hasUpperBound = !std::isinf(mUpperBound[i]);
-            // nbd(i)=0 if x(i) is unbounded,
-            // 1 if x(i) has only a lower bound,
-            // 2 if x(i) has both lower and upper bounds, and
-            // 3 if x(i) has only an upper bound.
-            if (hasLowerBound) {
-                if (hasUpperBound) {
-                    mNbd[i] = 2;
-                } else {
-                    mNbd[i] = 1;
-                }
-            } else if (hasUpperBound) {
-                mNbd[i] = 3;
-            } else {
-                mNbd[i] = 0;
-            }
+    int get_max_evaluations() const {
+        return mMaximumNumberOfEvaluations;
+    }
+
+    // Stop once the objective and its gradient have been evaluated
+    // maximumNumberOfEvaluations times, as counted by result.evaluations. The
+    // evaluation used by the automatic scaling is counted but not checked.
+    // Default: no limit
+    void set_max_evaluations(int maximumNumberOfEvaluations) {
+        if (maximumNumberOfEvaluations < 1) {
+            throw std::invalid_argument("maximumNumberOfEvaluations should be >= 1");
         }
+        mMaximumNumberOfEvaluations = maximumNumberOfEvaluations;
+    }
 
-        double f = pb(x0);
-        // use x0 to initialize gr with the proper dimensions without
-        // dealing with Templates
-        T gr(x0);
-        pb.gradient(x0, gr);
-        if (mGradientScalingFactor != 1.0) {
-            scale_gradient(gr, n);
+    double get_time_limit() const {
+        return mTimeLimit;
+    }
+
+    // Stop once timeLimit seconds of wall time have elapsed since the solve
+    // started. The limit is checked after every evaluation, so a solve may
+    // exceed it by the time of one evaluation. Default: no limit (infinity)
+    void set_time_limit(double timeLimit) {
+        if (!(timeLimit > 0)) {
+            throw std::invalid_argument("timeLimit should be > 0");
         }
+        mTimeLimit = timeLimit;
+    }
 
-        int i = 0;
-        int itask = 0;
-        int icsave = 0;
-
-        bool test = false;
-        // TODO: translate itask using enum class to make this more readable
-        while ((i < mMaximumNumberOfIterations) && (
-                (itask == 0) || (itask == 1) || (itask == 2) || (itask == 3)
-        )) {
-            setulb_wrapper(&n, &mMemorySize, &x0[0], &mLowerBound[0], &mUpperBound[0], &mNbd[0], &f,
-                           &gr[0],
-                           &mMachinePrecisionFactor, &mProjectedGradientTolerance,
-                           &mWorkArray[0], &mIntWorkArray[0], &itask, &mVerboseLevel,
-                           &icsave, &mBoolInformation[0], &mBoolInformation[1],
-                           &mBoolInformation[2], &mBoolInformation[3],
-                           &mIntInformation[0], &mDoubleInformation[0]);
-            // assert that impossible values do not occur
-            assert(icsave <= 14 && icsave >= 0);
-            assert(itask <= 12 && itask >= 0);
+    const cancellation_token &get_cancellation_token() const {
+        return mCancellationToken;
+    }
 
-            if (itask == 2 || itask == 3) {
-                f = pb(x0);
-                pb.gradient(x0, gr);
-                if (mGradientScalingFactor != 1.0) {
-                    scale_gradient(gr, n);
-                }
-            }
+    // Solves stop soon after token.cancel() is called from any thread, and
+    // solves that have not started yet (e.g., in optimize_batch) return
+    // immediately. A solve stopped by a limit or cancelled returns the best of
+    // its last iterate and the last point evaluated by the line search.
+    void set_cancellation_token(const cancellation_token &token) {
+        mCancellationToken = token;
+    }
+
+    const l_bfgs_b_observer<T> &get_observer() const {
+        return mObserver;
+    }
 
-            i = mIntInformation[29];
+    // The observer is called at every new iterate, and the solve stops
+    // (keeping that iterate) if it returns false. Observers of optimize_batch are
+    // called concurrently from several threads. An empty observer (the default)
+    // costs nothing
+    void set_observer(const l_bfgs_b_observer<T> &observer) {
+        mObserver = observer;
+    }
+
+    l_bfgs_b_trace *get_trace() const {
+        return mTrace;
+    }
+
+    // Append a record to trace at every new iterate (nullptr, the default,
+    // disables tracing). Unlike set_verbose_level, tracing does not write
+    // anything. The trace has to outlive the solves, and concurrent solves
+    // should not share a trace, so optimize_batch rejects solvers with one.
+    void set_trace(l_bfgs_b_trace *trace) {
+        mTrace = trace;
+    }
+
+    bool get_warm_start() const {
+        return mWarmStart;
+    }
+
+    // When enabled, a solve reuses the limited-memory corrections and the
+    // scaling (theta) left in the workspace by the previous solve, provided that
+    // it had the same dimension, memory size and variable scales (with automatic
+    // scaling, the new estimate has to equal the previous scales); otherwise it
+    // starts from scratch. This saves the iterations spent re-learning the
+    // curvature when solving a sequence of slightly perturbed problems. The
+    // active set is recomputed at the first Cauchy point using the reused
+    // curvature.
+    void set_warm_start(bool warmStart) {
+        mWarmStart = warmStart;
+    }
+
+    bool get_two_loop_recursion() const {
+        return mTwoLoopRecursion;
+    }
+
+    // When enabled (the default), the search direction of problems without
+    // bounds (all nbd entries 0) is computed with the two-loop recursion of
+    // L-BFGS, skipping the Cauchy point and the subspace minimization over the
+    // compact representation. Both compute the same direction up to rounding.
+    void set_two_loop_recursion(bool twoLoopRecursion) {
+        mTwoLoopRecursion = twoLoopRecursion;
+    }
+
+    breakpoint_ordering get_breakpoint_ordering() const {
+        return mBreakpointOrdering;
+    }
+
+    // Both orderings visit the breakpoints in increasing order and give the
+    // same Cauchy point up to rounding (ties may be visited in a different
+    // order). They only differ when more than a thousand breakpoints are
+    // left after the first interval.
+    void set_breakpoint_ordering(breakpoint_ordering ordering) {
+        mBreakpointOrdering = ordering;
+    }
+
+    line_search_policy get_line_search_policy() const {
+        return mLineSearchPolicy;
+    }
+
+    void set_line_search_policy(line_search_policy policy) {
+        mLineSearchPolicy = policy;
+    }
+
+    double get_sufficient_decrease_tolerance() const {
+        return mSufficientDecreaseTolerance;
+    }
+
+    // ftol in f(x + stp d) <= f(x) + ftol stp g'd. The More-Thuente search
+    // requires it to be smaller than the curvature tolerance, which is checked
+    // when a solve starts. Default: 1e-3
+    void set_sufficient_decrease_tolerance(double sufficientDecreaseTolerance) {
+        check_line_search_tolerance(sufficientDecreaseTolerance, "sufficientDecreaseTolerance");
+        mSufficientDecreaseTolerance = sufficientDecreaseTolerance;
+    }
+
+    double get_curvature_tolerance() const {
+        return mCurvatureTolerance;
+    }
+
+    // gtol in |g(x + stp d)'d| <= gtol |g'd|. Smaller values give more exact
+    // line searches, but the More-Thuente search requires gtol to be larger
+    // than the sufficient decrease tolerance so that both conditions can hold.
+    // Default: 0.9
+    void set_curvature_tolerance(double curvatureTolerance) {
+        check_line_search_tolerance(curvatureTolerance, "curvatureTolerance");
+        mCurvatureTolerance = curvatureTolerance;
+    }
+
+    double get_step_tolerance() const {
+        return mStepTolerance;
+    }
+
+    // relative width of the interval of uncertainty below which the search
+    // stops with a warning (More-Thuente only). Default: 0.1
+    void set_step_tolerance(double stepTolerance) {
+        check_line_search_tolerance(stepTolerance, "stepTolerance");
+        mStepTolerance = stepTolerance;
+    }
+
+    double get_max_step() const {
+        return mMaxStep;
+    }
+
+    // upper bound of the step along the search direction (the direction of the
+    // first iteration is normalized). Default: 1e10
+    void set_max_step(double maxStep) {
+        if (!(maxStep > 0)) {
+            throw std::invalid_argument("maxStep should be > 0");
+        }
+        mMaxStep = maxStep;
+    }
+
+    variable_scaling get_variable_scaling() const {
+        return mVariableScaling;
+    }
+
+    // Select none or automatic scaling; manual scaling is selected by giving
+    // the scales. The solver works on y = x / scales with the bounds scaled
+    // consistently, and the solution is mapped back to x. The projected gradient
+    // tolerance applies to the gradient with respect to y (scales * g).
+    void set_variable_scaling(variable_scaling scaling) {
+        if (scaling == variable_scaling::manual && mVariableScales.empty()) {
+            throw std::invalid_argument("Manual scaling requires the scales (set_variable_scales)");
         }
+        mVariableScaling = scaling;
+    }
+
+    const std::vector<double> &get_variable_scales() const {
+        return mVariableScales;
+    }
+
+    // Scale each variable by scales[i] > 0, e.g., its typical magnitude. The size
+    // of scales has to match the dimension of the problems being solved.
+    void set_variable_scales(const std::vector<double> &scales) {
+        l_bfgs_b_utils::check_variable_scales(scales);
+        mVariableScales = scales;
+        mVariableScaling = variable_scaling::manual;
+    }
+
+    const std::string &get_checkpoint_file() const {
+        return mCheckpointFile;
+    }
+
+    int get_checkpoint_interval() const {
+        return mCheckpointInterval;
+    }
+
+    // Save the complete state of the solver to checkpointFile every
+    // checkpointInterval iterations, so that an interrupted solve can be
+    // continued with resume(). The file is replaced atomically. An empty
+    // checkpointFile disables checkpointing. Concurrent solves should not share
+    // a checkpoint file, so optimize_batch rejects solvers with one.
+    void set_checkpoint(const std::string &checkpointFile, int checkpointInterval) {
+        check_checkpoint_interval(checkpointInterval);
+        mCheckpointFile = checkpointFile;
+        mCheckpointInterval = checkpointInterval;
+    }
+
+    l_bfgs_b_result optimize(problem<T> &pb, T &x0) {
+        return optimize(pb, x0, mWorkspace);
+    }
 
+    // Use an explicit workspace. Reusing the same workspace across calls avoids
+    // reallocating the Fortran work arrays when solving same-shaped problems.
+    // All the state of the solve lives in the workspace, so this method may be
+    // called concurrently from several threads as long as each one uses its own
+    // workspace and problem (and the verbose level is < 0).
+    l_bfgs_b_result optimize(problem<T> &pb, T &x0, l_bfgs_b_workspace<T> &workspace) const {
+        auto evaluate = [&pb](const T &x, T &gr) {
+            return pb.value_and_gradient(x, gr);
+        };
+        return solve(pb.get_input_dimension(), pb.get_bounds(), x0, workspace, evaluate);
+    }
+
+    // Overloads for a concrete problem class P. When the dynamic type of pb is
+    // P, the objective is called without virtual dispatch, so that it can be
+    // inlined in the solver loop. Otherwise (pb refers to a class derived from
+    // P, or P is abstract), they behave as optimize(problem<T>&, ...).
+    template<class P>
+    typename std::enable_if<std::is_base_of<problem<T>, P>::value, l_bfgs_b_result>::type
+    optimize(P &pb, T &x0) {
+        return optimize(pb, x0, mWorkspace);
+    }
+
+    template<class P>
+    typename std::enable_if<std::is_base_of<problem<T>, P>::value, l_bfgs_b_result>::type
+    optimize(P &pb, T &x0, l_bfgs_b_workspace<T> &workspace) const {
+        return optimize_static(pb, x0, workspace, std::integral_constant<bool, !std::is_abstract<P>::value>());
+    }
+
+    // Minimize value(x) in the box [lowerBound, upperBound] using gradient(x, gr)
+    // to compute the gradient. value and gradient may be any callables (e.g.,
+    // lambdas) and the bounds any indexable containers of size x0.size() (use
+    // infinite values for unbounded variables). No problem object is required.
+    template<class F, class G, class B>
+    l_bfgs_b_result optimize(F value, G gradient, const B &lowerBound, const B &upperBound, T &x0) {
+        auto evaluate = [&value, &gradient](const T &x, T &gr) {
+            double f = value(x);
+            gradient(x, gr);
+            return f;
+        };
+        int n = x0.size();
+        check_bounds(n, lowerBound, upperBound);
+        return solve(n, lowerBound, upperBound, x0, mWorkspace, evaluate);
+    }
+
+    // Same as above with a single callable that returns the objective at x and
+    // stores its gradient in gr: valueAndGradient(x, gr)
+    template<class FG, class B>
+    l_bfgs_b_result optimize(FG valueAndGradient, const B &lowerBound, const B &upperBound, T &x0) {
+        int n = x0.size();
+        check_bounds(n, lowerBound, upperBound);
+        return solve(n, lowerBound, upperBound, x0, mWorkspace, valueAndGradient);
+    }
+
+    // Continue the solve saved in the checkpoint file. x0 should have the
+    // dimension of the problem and is overwritten with the saved iterate. With
+    // the same problem and settings, the solve proceeds exactly as the one that
+    // wrote the checkpoint. The reported iterations and evaluations include
+    // those performed before the checkpoint. A checkpoint saved with other
+    // engine options (line search, breakpoint ordering, direction) is rejected.
+    l_bfgs_b_result resume(problem<T> &pb, T &x0) {
+        return resume(pb, x0, mWorkspace);
+    }
+
+    l_bfgs_b_result resume(problem<T> &pb, T &x0, l_bfgs_b_workspace<T> &workspace) const {
+        if (static_cast<int>(x0.size()) != pb.get_input_dimension()) {
+            throw std::invalid_argument("x0's size does not match the problem's inputDimension");
+        }
+        auto evaluate = [&pb](const T &x, T &gr) {
+            return pb.value_and_gradient(x, gr);
+        };
+        return solve(pb.get_input_dimension(), pb.get_bounds(), x0, workspace, evaluate, true);
+    }
+
+    // Solve many independent problems using noThreads threads (<= 0 selects the
+    // number of hardware threads). [first, last) is a random-access range of
+    // pairs whose first member points to a problem<T> (raw or smart pointer) and
+    // whose second member is the initial point, which is overwritten with the
+    // solution. Problems are distributed among the threads using work stealing,
+    // and each thread reuses its own workspace. Returns the result of each
+    // problem, in the order of the range. Each entry needs its own problem
+    // object, since problems keep scratch buffers used while they are
+    // evaluated; a problem that appears twice is rejected. Verbose levels >= 0
+    // are rejected too, since every solve would print its summary to the
+    // standard output (and write iterate.dat for levels >= 1). The problems
+    // are unrelated, so they never warm start from each other.
+    template<class RandomAccessIterator>
+    std::vector<l_bfgs_b_result> optimize_batch(RandomAccessIterator first, RandomAccessIterator last,
+                                                int noThreads = 0) const {
+        if (mVerboseLevel >= 0) {
+            // the output of the concurrent solves would be interleaved, and all
+            // the problems would write the same iterate.dat file
+            throw std::invalid_argument("optimize_batch does not support verbose levels >= 0");
+        }
+        if (!mCheckpointFile.empty()) {
+            // all the problems would write the same file
+            throw std::invalid_argument("optimize_batch does not support checkpoints");
+        }
+        if (mTrace) {
+            // the records of concurrent solves would be pushed to the same trace
+            throw std::invalid_argument("optimize_batch does not support traces");
+        }
+        int noProblems = std::distance(first, last);
+        std::vector<const problem<T> *> problems(noProblems);
+        for (int i = 0; i < noProblems; i++) {
+            problems[i] = &*(first[i].first);
+        }
+        std::sort(problems.begin(), problems.end());
+        if (std::adjacent_find(problems.begin(), problems.end()) != problems.end()) {
+            // the evaluations of the same problem would share its scratch buffers
+            throw std::invalid_argument("optimize_batch requires a different problem object for each entry");
+        }
+        std::vector<l_bfgs_b_result> results(noProblems);
+        int noWorkers = l_bfgs_b_utils::effective_thread_count(noProblems, noThreads);
+        std::vector<l_bfgs_b_workspace<T> > workspaces(noWorkers);
+        l_bfgs_b_utils::parallel_for(noProblems, noWorkers, [&](int worker, int i) {
+            auto &entry = first[i];
+            // the corrections left by the previous problem of the worker depend
+            // on the scheduling
+            workspaces[worker].clear_curvature_pairs();
+            results[i] = optimize(*(entry.first), entry.second, workspaces[worker]);
+        });
+        return results;
+    }
+
+    // workspace used by optimize(pb, x0)
+    const l_bfgs_b_workspace<T> &get_workspace() const {
+        return mWorkspace;
     }
 
 private:
@@ -185,19 +582,458 @@ private:
     double mProjectedGradientTolerance;
     int mVerboseLevel;
     int mMaximumNumberOfIterations;
+    int mMaximumNumberOfEvaluations = std::numeric_limits<int>::max();
+    double mTimeLimit = std::numeric_limits<double>::infinity();
+    cancellation_token mCancellationToken;
+    l_bfgs_b_observer<T> mObserver;
+    l_bfgs_b_trace *mTrace = nullptr;
     // factor <= 1 used to scale the gradient for explosive functions
     double mGradientScalingFactor = 1.0;
-    // interface to Fortran code
-    bool mBoolInformation[4];
-    int mIntInformation[44];
-    double mDoubleInformation[29];
+    bool mWarmStart = false;
+    bool mTwoLoopRecursion = true;
+    breakpoint_ordering mBreakpointOrdering = breakpoint_ordering::heap;
+    line_search_policy mLineSearchPolicy = line_search_policy::more_thuente;
+    double mSufficientDecreaseTolerance = 1e-3;
+    double mCurvatureTolerance = 0.9;
+    double mStepTolerance = 0.1;
+    double mMaxStep = 1e10;
+    variable_scaling mVariableScaling = variable_scaling::none;
+    std::vector<double> mVariableScales;
+    std::string mCheckpointFile;
+    int mCheckpointInterval = 1;
+    l_bfgs_b_workspace<T> mWorkspace;
+
+    template<class P>
+    l_bfgs_b_result optimize_static(P &pb, T &x0, l_bfgs_b_workspace<T> &workspace, std::true_type) const {
+        if (typeid(pb) != typeid(P)) {
+            return optimize(static_cast<problem<T> &>(pb), x0, workspace);
+        }
+        auto evaluate = [&pb](const T &x, T &gr) {
+            return problem<T>::static_value_and_gradient(pb, x, gr);
+        };
+        return solve(pb.get_input_dimension(), pb.get_bounds(), x0, workspace, evaluate);
+    }
+
+    template<class P>
+    l_bfgs_b_result optimize_static(P &pb, T &x0, l_bfgs_b_workspace<T> &workspace, std::false_type) const {
+        return optimize(static_cast<problem<T> &>(pb), x0, workspace);
+    }
+
+    // bounds cached by a problem: nbd is only refreshed for the modified coordinates
+    template<class Evaluator>
+    l_bfgs_b_result solve(int n, const bounds_block<T> &bounds, T &x0,
+                          l_bfgs_b_workspace<T> &workspace, Evaluator &evaluate, bool resume = false) const {
+        // the Fortran routine does not modify the bounds
+        double *l = const_cast<double *>(l_bfgs_b_utils::data_pointer(bounds.get_lower_bound()));
+        double *u = const_cast<double *>(l_bfgs_b_utils::data_pointer(bounds.get_upper_bound()));
+        int *nbd = const_cast<int *>(bounds.get_nbd());
+        return solve(n, l, u, nbd, x0, workspace, evaluate, resume);
+    }
+
+    // bounds given as plain containers: they are classified on every call
+    template<class B, class Evaluator>
+    l_bfgs_b_result solve(int n, const B &lowerBound, const B &upperBound, T &x0,
+                          l_bfgs_b_workspace<T> &workspace, Evaluator &evaluate) const {
+        // the Fortran routine does not modify the bounds: use them in place if possible
+        double *l = bounds_pointer(lowerBound, n, workspace.mLowerBound,
+                                   l_bfgs_b_utils::is_contiguous_container<B>());
+        double *u = bounds_pointer(upperBound, n, workspace.mUpperBound,
+                                   l_bfgs_b_utils::is_contiguous_container<B>());
+        if (static_cast<int>(workspace.mNbd.size()) < n) {
+            workspace.mNbd.resize(n);
+        }
+        int *nbd = &workspace.mNbd[0];
+        for (int i = 0; i < n; ++i) {
+            nbd[i] = bounds_block<T>::classify(l[i], u[i]);
+        }
+        return solve(n, l, u, nbd, x0, workspace, evaluate);
+    }
+
+    // Reverse-communication loop with the Fortran routine. evaluate(x, gr) returns
+    // the objective at x and stores its gradient in gr. If resume is true, the
+    // state is loaded from the checkpoint file.
+    template<class Evaluator>
+    l_bfgs_b_result solve(int n, double *l, double *u, int *nbd, T &x0,
+                          l_bfgs_b_workspace<T> &workspace, Evaluator &evaluate, bool resume = false) const {
+        typedef std::chrono::steady_clock clock;
+        clock::time_point solveStart = clock::now();
+        clock::duration objectiveTime = clock::duration::zero();
+        l_bfgs_b_result result;
+        if (mCancellationToken.is_cancelled()) {
+            result.status = l_bfgs_b_status::cancelled;
+            return result;
+        }
+        int m = mMemorySize;
+        double factr = mMachinePrecisionFactor;
+        double pgtol = mProjectedGradientTolerance;
+        int iprint = mVerboseLevel;
+        int options[l_bfgs_b_options::size];
+        double realOptions[l_bfgs_b_options::size];
+        engine_options(options, realOptions);
+        // prepare variables for the algorithm
+        workspace.reserve(n, m);
+
+        // use x0 to initialize gr with the proper dimensions without
+        // dealing with Templates. The workspace keeps it between calls of the
+        // same dimension.
+        T &gr = workspace.mGradient;
+        if (gr.size() != x0.size()) {
+            gr = x0;
+        }
+        double *x = l_bfgs_b_utils::data_pointer(x0);
+        double *g = l_bfgs_b_utils::data_pointer(gr);
+        // f and gr are computed when the Fortran routine requests them (FG_START)
+        double f = 0;
+
+        // with scaled variables the Fortran routine works on y = x0 / scales,
+        // stored in the workspace, and x0 is only updated to evaluate the objective
+        bool scaled = mVariableScaling != variable_scaling::none;
+        std::vector<double> &scales = workspace.mVariableScales;
+        // the automatic scaling evaluates the objective at the initial point,
+        // which is reused by the first evaluation requested by the routine
+        bool initialEvaluation = false;
+        if (scaled) {
+            workspace.mScaledPoint.resize(n);
+            x = &workspace.mScaledPoint[0];
+        } else {
+            scales.clear();
+        }
+
+        int i = 0;
+        bool warmStart = mWarmStart && workspace.has_curvature_pairs(n, m);
+        l_bfgs_b_task task = l_bfgs_b_task::start;
+        line_search_state csave = line_search_state::start;
+        // the corrections are only valid once the solve finishes
+        workspace.clear_curvature_pairs();
+        // evaluations performed so far and objective at the last iterate
+        int evaluations = 0;
+        double iterateF = std::numeric_limits<double>::infinity();
+        l_bfgs_b_status stopStatus = l_bfgs_b_status::converged;
+        bool stopped = false;
+        // cumulative times at the last traced iterate
+        double tracedTimes[4] = {0, 0, 0, 0};
+        if (resume) {
+            load_checkpoint(n, x, g, f, task, csave, evaluations, options, realOptions, workspace);
+            i = workspace.mIntInformation[29];
+            iterateF = f;
+            std::copy(workspace.mDoubleInformation + 6, workspace.mDoubleInformation + 9, tracedTimes);
+        } else if (scaled) {
+            if (mVariableScaling == variable_scaling::manual) {
+                if (static_cast<int>(mVariableScales.size()) != n) {
+                    throw std::invalid_argument("The size of the scales does not match x0's size");
+                }
+                scales = mVariableScales;
+            } else {
+                // the routine would project x0 onto the bounds anyway
+                l_bfgs_b_utils::project_onto_bounds(n, l, u, nbd, x0);
+                clock::time_point evaluationStart = clock::now();
+                f = evaluate(x0, gr);
+                l_bfgs_b_utils::estimate_variable_scales(n, l, u, nbd, x0, gr, workspace.mScalingPoint,
+                                                         workspace.mScalingGradient, evaluate, scales);
+                objectiveTime += clock::now() - evaluationStart;
+                initialEvaluation = true;
+                evaluations = 2;
+            }
+            for (int j = 0; j < n; j++) {
+                x[j] = x0[j] / scales[j];
+            }
+        }
+        if (scaled) {
+            scale_bounds(n, l, u, nbd, scales, workspace);
+            l = &workspace.mScaledLowerBound[0];
+            u = &workspace.mScaledUpperBound[0];
+        }
+        // 13 requests a warm start from the corrections kept in the workspace,
+        // which are only valid in the coordinates of the solve that left them
+        if (!resume && warmStart && workspace.mPairsScales == scales) {
+            task = l_bfgs_b_task::warm_start;
+        }
+
+        auto call_engine = [&]() {
+            setulb_wrapper(&n, &m, x, l, u, nbd, &f,
+                           g, &factr, &pgtol,
+                           &workspace.mWorkArray[0], &workspace.mIntWorkArray[0], &task, &iprint,
+                           &csave, workspace.mBoolInformation,
+                           workspace.mIntInformation, workspace.mDoubleInformation, options, realOptions);
+            // assert that impossible values do not occur
+            assert(csave >= line_search_state::start && csave <= line_search_state::error_max_step);
+            assert(task >= l_bfgs_b_task::start && task <= l_bfgs_b_task::stop_restore);
+        };
+
+        while ((i < mMaximumNumberOfIterations) && l_bfgs_b_utils::is_running(task)) {
+            call_engine();
+
+            if (l_bfgs_b_utils::requests_evaluation(task)) {
+                if (initialEvaluation) {
+                    // f and gr already hold the values at x0, which is exactly
+                    // scales * x since the scales are powers of two
+                    initialEvaluation = false;
+                } else {
+                    if (scaled) {
+                        for (int j = 0; j < n; j++) {
+                            x0[j] = scales[j] * x[j];
+                        }
+                    }
+                    clock::time_point evaluationStart = clock::now();
+                    f = evaluate(x0, gr);
+                    objectiveTime += clock::now() - evaluationStart;
+                    evaluations++;
+                }
+                if (scaled) {
+                    // gradient with respect to y
+                    for (int j = 0; j < n; j++) {
+                        g[j] *= scales[j];
+                    }
+                }
+                if (mGradientScalingFactor != 1.0) {
+                    scale_gradient(gr, n);
+                }
+            }
+
+            if (task != l_bfgs_b_task::fg_line_search) {
+                iterateF = f;
+            }
+
+            i = workspace.mIntInformation[29];
+            // the state at a new iterate is complete: resuming calls setulb with it
+            if (task == l_bfgs_b_task::new_x && !mCheckpointFile.empty() && i % mCheckpointInterval == 0) {
+                save_checkpoint(n, x, g, f, task, csave, evaluations, options, realOptions, workspace);
+            }
+            if (task == l_bfgs_b_task::new_x && mTrace) {
+                trace_iteration(workspace, f, std::chrono::duration<double>(objectiveTime).count(), tracedTimes);
+            }
+            if (task == l_bfgs_b_task::new_x && mObserver) {
+                // x0 holds the iterate: it was the last point evaluated
+                l_bfgs_b_iteration<T> iteration = {x0, f, workspace.mDoubleInformation[12], i, evaluations};
+                if (!mObserver(iteration)) {
+                    stopped = true;
+                    stopStatus = l_bfgs_b_status::stopped_by_observer;
+                    task = l_bfgs_b_task::stop;
+                    call_engine();
+                }
+            }
+            if (l_bfgs_b_utils::is_running(task) && limit_reached(evaluations, solveStart, stopStatus)) {
+                // a last call lets the routine finish, restoring the last iterate
+                // if the point evaluated by the line search is not better
+                stopped = true;
+                task = (task == l_bfgs_b_task::fg_line_search && !(f < iterateF)) ?
+                       l_bfgs_b_task::stop_restore : l_bfgs_b_task::stop;
+                call_engine();
+            }
+        }
+        if (!l_bfgs_b_utils::is_error(task)) {
+            workspace.mPairsDimension = n;
+            workspace.mPairsMemorySize = m;
+            workspace.mPairsScales = scales;
+        }
+        if (scaled) {
+            for (int j = 0; j < n; j++) {
+                x0[j] = scales[j] * x[j];
+            }
+        }
+
+        result.f = f;
+        result.iterations = workspace.mIntInformation[29];
+        result.evaluations = evaluations;
+        result.task = task;
+        if (stopped) {
+            result.status = stopStatus;
+        } else if (l_bfgs_b_utils::is_error(task)) {
+            result.status = l_bfgs_b_status::error;
+        } else if (task == l_bfgs_b_task::abnormal_line_search) {
+            result.status = l_bfgs_b_status::abnormal_line_search;
+        } else if (l_bfgs_b_utils::is_running(task)) {
+            result.status = l_bfgs_b_status::max_iterations;
+        }
+        result.stats.cauchyTime = workspace.mDoubleInformation[6];
+        result.stats.subspaceTime = workspace.mDoubleInformation[7];
+        result.stats.lineSearchTime = workspace.mDoubleInformation[8];
+        result.stats.updates = workspace.mIntInformation[30];
+        result.stats.skippedUpdates = workspace.mIntInformation[25];
+        result.stats.cauchyIntervals = workspace.mIntInformation[21];
+        result.stats.freeVariables = workspace.mIntInformation[37];
+        result.stats.activeVariables = workspace.mIntInformation[38];
+        result.stats.objectiveTime = std::chrono::duration<double>(objectiveTime).count();
+        result.stats.totalTime = std::chrono::duration<double>(clock::now() - solveStart).count();
+        return result;
+    }
+
+    // Append the state at a new iterate to the trace. times holds the cumulative
+    // times of the Cauchy search, the subspace minimization, the line search
+    // and the objective at the last traced iterate, and is updated
+    void trace_iteration(const l_bfgs_b_workspace<T> &workspace, double f, double objectiveTime,
+                         double times[4]) const {
+        const int *isave = workspace.mIntInformation;
+        const double *dsave = workspace.mDoubleInformation;
+        l_bfgs_b_trace_record record;
+        record.iteration = isave[29];
+        record.evaluations = isave[35];
+        record.f = f;
+        record.projectedGradientNorm = dsave[12];
+        record.step = dsave[13];
+        record.stepNorm = dsave[13] * dsave[3];
+        record.freeVariables = isave[37];
+        record.activeVariables = isave[38];
+        record.breakpoints = isave[32];
+        record.backtracks = isave[24];
+        record.cauchyTime = dsave[6] - times[0];
+        record.subspaceTime = dsave[7] - times[1];
+        record.lineSearchTime = dsave[8] - times[2];
+        record.objectiveTime = objectiveTime - times[3];
+        std::copy(dsave + 6, dsave + 9, times);
+        times[3] = objectiveTime;
+        mTrace->push(record);
+    }
+
+    // the evaluation budget or the time limit are exhausted, or the solve was
+    // cancelled
+    bool limit_reached(int evaluations, std::chrono::steady_clock::time_point solveStart,
+                       l_bfgs_b_status &status) const {
+        if (mCancellationToken.is_cancelled()) {
+            status = l_bfgs_b_status::cancelled;
+        } else if (evaluations >= mMaximumNumberOfEvaluations) {
+            status = l_bfgs_b_status::max_evaluations;
+        } else if (mTimeLimit != std::numeric_limits<double>::infinity() &&
+                   std::chrono::duration<double>(std::chrono::steady_clock::now() - solveStart).count() >
+                   mTimeLimit) {
+            status = l_bfgs_b_status::time_limit;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    void engine_options(int options[], double realOptions[]) const {
+        if (mLineSearchPolicy == line_search_policy::more_thuente) {
+            // the tolerances may be set in any order, so they are checked together here
+            check_line_search_tolerances(mSufficientDecreaseTolerance, mCurvatureTolerance);
+        }
+        std::fill(options, options + l_bfgs_b_options::size, 0);
+        options[l_bfgs_b_options::direction] = mTwoLoopRecursion ? 1 : 0;
+        options[l_bfgs_b_options::breakpoints] = mBreakpointOrdering == breakpoint_ordering::selection ? 1 : 0;
+        options[l_bfgs_b_options::line_search] = mLineSearchPolicy == line_search_policy::backtracking ? 1 : 0;
+        std::fill(realOptions, realOptions + l_bfgs_b_options::size, 0.0);
+        realOptions[l_bfgs_b_options::sufficient_decrease] = mSufficientDecreaseTolerance;
+        realOptions[l_bfgs_b_options::curvature] = mCurvatureTolerance;
+        realOptions[l_bfgs_b_options::step_tolerance] = mStepTolerance;
+        realOptions[l_bfgs_b_options::max_step] = mMaxStep;
+    }
+
+    void save_checkpoint(int n, const double *x, const double *g, double f, l_bfgs_b_task task,
+                         line_search_state csave, int evaluations, const int options[], const double realOptions[],
+                         const l_bfgs_b_workspace<T> &workspace) const {
+        int m = mMemorySize;
+        l_bfgs_b_utils::checkpoint_writer writer(mCheckpointFile, l_bfgs_b_utils::checkpoint_header::make(
+                n, m, static_cast<int>(task), static_cast<int>(csave), !workspace.mVariableScales.empty(), evaluations,
+                options, realOptions, f));
+        writer.write(x, n * sizeof(double));
+        writer.write(g, n * sizeof(double));
+        if (!workspace.mVariableScales.empty()) {
+            writer.write(&workspace.mVariableScales[0], n * sizeof(double));
+        }
+        writer.write(workspace.mBoolInformation, sizeof(workspace.mBoolInformation));
+        writer.write(workspace.mIntInformation, sizeof(workspace.mIntInformation));
+        writer.write(workspace.mDoubleInformation, sizeof(workspace.mDoubleInformation));
+        writer.write(&workspace.mWorkArray[0],
+                     l_bfgs_b_workspace<T>::work_array_size(n, m) * sizeof(double));
+        writer.write(&workspace.mIntWorkArray[0],
+                     l_bfgs_b_workspace<T>::int_work_array_size(n) * sizeof(int));
+        writer.commit();
+    }
+
+    void load_checkpoint(int n, double *x, double *g, double &f, l_bfgs_b_task &task, line_search_state &csave,
+                         int &evaluations, const int options[], const double realOptions[],
+                         l_bfgs_b_workspace<T> &workspace) const {
+        if (mCheckpointFile.empty()) {
+            throw std::invalid_argument("No checkpoint file has been set");
+        }
+        int m = mMemorySize;
+        l_bfgs_b_utils::checkpoint_reader reader(mCheckpointFile);
+        const l_bfgs_b_utils::checkpoint_header &header = reader.get_header();
+        if (header.inputDimension != n || header.memorySize != m) {
+            throw std::invalid_argument("The checkpoint was saved for a different inputDimension or memorySize");
+        }
+        if ((header.scaled != 0) != (mVariableScaling != variable_scaling::none)) {
+            throw std::invalid_argument("The checkpoint was saved with a different variable scaling");
+        }
+        // the line search and the direction would change in the middle of the solve
+        if (!std::equal(options, options + l_bfgs_b_options::size, header.options) ||
+            !std::equal(realOptions, realOptions + l_bfgs_b_options::size, header.realOptions)) {
+            throw std::invalid_argument("The checkpoint was saved with different engine options");
+        }
+        reader.read(x, n * sizeof(double));
+        reader.read(g, n * sizeof(double));
+        if (header.scaled != 0) {
+            // the scales of the saved solve, which may have been estimated
+            workspace.mVariableScales.resize(n);
+            reader.read(&workspace.mVariableScales[0], n * sizeof(double));
+        }
+        reader.read(workspace.mBoolInformation, sizeof(workspace.mBoolInformation));
+        reader.read(workspace.mIntInformation, sizeof(workspace.mIntInformation));
+        reader.read(workspace.mDoubleInformation, sizeof(workspace.mDoubleInformation));
+        reader.read(&workspace.mWorkArray[0], l_bfgs_b_workspace<T>::work_array_size(n, m) * sizeof(double));
+        reader.read(&workspace.mIntWorkArray[0], l_bfgs_b_workspace<T>::int_work_array_size(n) * sizeof(int));
+        f = header.f;
+        task = static_cast<l_bfgs_b_task>(header.task);
+        csave = static_cast<line_search_state>(header.csave);
+        evaluations = header.evaluations;
+    }
+
+    template<class B>
+    static double *bounds_pointer(const B &bound, int, std::vector<double> &, std::true_type) {
+        return const_cast<double *>(l_bfgs_b_utils::data_pointer(bound));
+    }
+
+    // copy bounds whose storage is not known to be contiguous into buffer
+    template<class B>
+    static double *bounds_pointer(const B &bound, int n, std::vector<double> &buffer, std::false_type) {
+        if (static_cast<int>(buffer.size()) < n) {
+            buffer.resize(n);
+        }
+        for (int i = 0; i < n; ++i) {
+            buffer[i] = bound[i];
+        }
+        return &buffer[0];
+    }
+
+    // bounds of y = x / scales. The bound types do not change since scales > 0
+    static void scale_bounds(int n, const double *l, const double *u, const int *nbd,
+                             const std::vector<double> &scales, l_bfgs_b_workspace<T> &workspace) {
+        workspace.mScaledLowerBound.resize(n);
+        workspace.mScaledUpperBound.resize(n);
+        for (int i = 0; i < n; i++) {
+            workspace.mScaledLowerBound[i] = (nbd[i] == 1 || nbd[i] == 2) ? l[i] / scales[i] : l[i];
+            workspace.mScaledUpperBound[i] = (nbd[i] == 2 || nbd[i] == 3) ? u[i] / scales[i] : u[i];
+        }
+    }
 
-    void scale_gradient(T& gradient, int gradientSize) {
+    void scale_gradient(T& gradient, int gradientSize) const {
         for (int i = 0; i < gradientSize; i++) {
             gradient[i] *= mGradientScalingFactor;
         }
     }
 
+    template<class B>
+    static void check_bounds(int n, const B &lowerBound, const B &upperBound) {
+        if (n < 1) {
+            throw std::invalid_argument("x0 should not be empty");
+        }
+        if (static_cast<int>(lowerBound.size()) != n || static_cast<int>(upperBound.size()) != n) {
+            throw std::invalid_argument("The bounds' sizes do not match x0's size");
+        }
+        for (int i = 0; i < n; ++i) {
+            if (lowerBound[i] > upperBound[i]) {
+                throw std::invalid_argument("Incompatible bounds (lowerBound[i] > upperBound[i] for some i)");
+            }
+        }
+    }
+
+    static void check_checkpoint_interval(int checkpointInterval) {
+        if (checkpointInterval < 1) {
+            throw std::invalid_argument("checkpointInterval should be >= 1");
+        }
+    }
+
     static void check_memory_size(int memorySize) {
         if (memorySize < 1) {
             throw std::invalid_argument("memorySize should be >= 1");
@@ -216,6 +1052,18 @@ private:
         }
     }
 
+    static void check_line_search_tolerance(double tolerance, const std::string &name) {
+        if (!(tolerance > 0 && tolerance < 1)) {
+            throw std::invalid_argument(name + " should be in (0, 1)");
+        }
+    }
+
+    static void check_line_search_tolerances(double sufficientDecreaseTolerance, double curvatureTolerance) {
+        if (!(sufficientDecreaseTolerance < curvatureTolerance)) {
+            throw std::invalid_argument("sufficientDecreaseTolerance should be < curvatureTolerance");
+        }
+    }
+
     static void check_gradient_tolerance(double projectedGradientTolerance) {
         if (projectedGradientTolerance < 0) {
             throw std::invalid_argument("projectedGradientTolerance should be >= 0");
@@ -0,0 +1,135 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef LBFGSB_CPP_PARALLEL_H
+#define LBFGSB_CPP_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace l_bfgs_b_utils {
+    namespace detail {
+        // Range of pending task indices [begin, end) owned by a worker. The owner
+        // consumes tasks from the front; idle workers steal from the back.
+        struct task_range {
+            std::mutex mutex;
+            int begin = 0;
+            int end = 0;
+        };
+
+        inline bool pop_task(task_range &range, int &task) {
+            std::lock_guard<std::mutex> lock(range.mutex);
+            if (range.begin < range.end) {
+                task = range.begin++;
+                return true;
+            }
+            return false;
+        }
+
+        // Steal the upper half of the largest pending range of the other workers
+        inline bool steal_tasks(std::vector<task_range> &ranges, int thief, int &task) {
+            int noWorkers = ranges.size();
+            for (int attempt = 1; attempt < noWorkers; attempt++) {
+                task_range &victim = ranges[(thief + attempt) % noWorkers];
+                int begin, end;
+                {
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    int pending = victim.end - victim.begin;
+                    if (pending <= 0) {
+                        continue;
+                    }
+                    begin = victim.end - (pending + 1) / 2;
+                    end = victim.end;
+                    victim.end = begin;
+                }
+                std::lock_guard<std::mutex> lock(ranges[thief].mutex);
+                task = begin;
+                ranges[thief].begin = begin + 1;
+                ranges[thief].end = end;
+                return true;
+            }
+            return false;
+        }
+    }
+
+    // number of threads used when the caller does not specify one
+    inline int default_thread_count() {
+        int noThreads = std::thread::hardware_concurrency();
+        return (noThreads > 0) ? noThreads : 1;
+    }
+
+    // Number of workers that parallel_for will actually use
+    inline int effective_thread_count(int noTasks, int noThreads) {
+        if (noThreads <= 0) {
+            noThreads = default_thread_count();
+        }
+        return std::max(1, std::min(noThreads, noTasks));
+    }
+
+    // Run task(workerId, taskIndex) for every taskIndex in [0, noTasks) using
+    // effective_thread_count(noTasks, noThreads) workers. Tasks are initially
+    // split into contiguous blocks, one per worker, and idle workers steal
+    // pending tasks from the others. workerId may be used to index per-worker
+    // resources. If some task throws, pending tasks are abandoned and the
+    // first exception is rethrown once all the workers have finished.
+    template<typename F>
+    void parallel_for(int noTasks, int noThreads, F task) {
+        if (noTasks <= 0) {
+            return;
+        }
+        int noWorkers = effective_thread_count(noTasks, noThreads);
+        if (noWorkers == 1) {
+            for (int i = 0; i < noTasks; i++) {
+                task(0, i);
+            }
+            return;
+        }
+
+        std::vector<detail::task_range> ranges(noWorkers);
+        for (int i = 0; i < noWorkers; i++) {
+            ranges[i].begin = static_cast<int>((static_cast<long long>(noTasks) * i) / noWorkers);
+            ranges[i].end = static_cast<int>((static_cast<long long>(noTasks) * (i + 1)) / noWorkers);
+        }
+        std::vector<std::exception_ptr> errors(noWorkers);
+        std::atomic<bool> failed(false);
+
+        auto worker = [&](int workerId) {
+            try {
+                int taskIndex;
+                while (!failed.load(std::memory_order_relaxed) &&
+                       (detail::pop_task(ranges[workerId], taskIndex) ||
+                        detail::steal_tasks(ranges, workerId, taskIndex))) {
+                    task(workerId, taskIndex);
+                }
+            } catch (...) {
+                errors[workerId] = std::current_exception();
+                failed = true;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(noWorkers - 1);
+        for (int i = 1; i < noWorkers; i++) {
+            threads.emplace_back(worker, i);
+        }
+        worker(0);
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        for (auto &error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+}
+
+#endif //LBFGSB_CPP_PARALLEL_H
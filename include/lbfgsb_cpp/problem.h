@@ -9,10 +9,36 @@
 #define LBFGSB_CPP_PROBLEM_H
 
 #include <array>
+#include <complex>
 #include <limits>
 #include <cmath>
 #include <initializer_list>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "bounds.h"
 #include "utils.h"
+#include "grouped_differences.h"
+
+// Execution policy of the numerical gradient used by default in problem_base
+enum class differencing_mode {
+    serial,
+    // the objective is evaluated concurrently from several threads: operator()
+    // (or element_values with a coupling structure, or complex_value with the
+    // complex step) must not modify any state shared between calls
+    parallel
+};
+
+// Finite difference scheme of the numerical gradient used by default in problem_base
+enum class finite_difference_scheme {
+    // n evaluations, reusing f(x) when it is known. Error O(h)
+    forward,
+    // 2n evaluations. Error O(h^2)
+    central,
+    // n evaluations with complex arguments. Requires overriding complex_value
+    complex_step
+};
 
 // Use the Curiosly repeating pattern to avoid code duplication
 template<typename T, typename derived>
@@ -21,15 +47,15 @@ public:
     problem_base(int inputDimension, const T &lowerBound, const T &upperBound) :
     // note the use of the , operator to check for the correctness of the arguments
             mInputDimension((check_input_dimension(inputDimension), inputDimension)),
-            mLowerBound((check_container_dimensions(lowerBound.size(), inputDimension), lowerBound)),
-            mUpperBound( (check_bounds(lowerBound, upperBound), upperBound)) {
+            mBounds((check_container_dimensions(lowerBound.size(), inputDimension),
+                     check_bounds(lowerBound, upperBound), lowerBound), upperBound) {
     };
 
     problem_base(int inputDimension) :
-            mInputDimension((check_input_dimension(inputDimension), inputDimension)),
-            mLowerBound(inputDimension),
-            mUpperBound(inputDimension) {
-        set_default_bounds();
+            mInputDimension((check_input_dimension(inputDimension), inputDimension)) {
+        T lowerBound(inputDimension);
+        T upperBound(inputDimension);
+        set_default_bounds(lowerBound, upperBound);
     }
 
     virtual ~problem_base() = default;
@@ -38,14 +64,14 @@ public:
         return mInputDimension;
     }
 
-    T get_lower_bound() const {
-        return mLowerBound;
+    const T &get_lower_bound() const {
+        return mBounds.get_lower_bound();
     }
 
     void set_lower_bound(const T &lowerBound) {
         check_container_dimensions(lowerBound.size(), mInputDimension);
-        check_bounds(lowerBound, mUpperBound);
-        mLowerBound = lowerBound;
+        check_bounds(lowerBound, get_upper_bound());
+        mBounds.assign(lowerBound, get_upper_bound());
     }
 
     void set_lower_bound(const std::initializer_list<double>& lowerBound) {
@@ -54,14 +80,14 @@ public:
         set_lower_bound(lowerBoundContainer);
     }
 
-    T get_upper_bound() const {
-        return mUpperBound;
+    const T &get_upper_bound() const {
+        return mBounds.get_upper_bound();
     }
 
     void set_upper_bound(const T &upperBound) {
         check_container_dimensions(upperBound.size(), mInputDimension);
-        check_bounds(mLowerBound, upperBound);
-        mUpperBound = upperBound;
+        check_bounds(get_lower_bound(), upperBound);
+        mBounds.assign(get_lower_bound(), upperBound);
     }
 
     void set_upper_bound(const std::initializer_list<double>& upperBound) {
@@ -70,31 +96,228 @@ public:
         set_upper_bound(upperBoundContainer);
     }
 
+    // Update the bounds of the i-th coordinate only. Unlike the setters taking
+    // containers, these methods do not validate nor copy the remaining bounds,
+    // so that re-bounding a few coordinates between solves is cheap.
+    void set_lower_bound(int i, double lowerBound) {
+        mBounds.set_lower_bound(i, lowerBound);
+    }
+
+    void set_upper_bound(int i, double upperBound) {
+        mBounds.set_upper_bound(i, upperBound);
+    }
+
+    void set_bounds(int i, double lowerBound, double upperBound) {
+        mBounds.set_bounds(i, lowerBound, upperBound);
+    }
+
+    // bounds in the form required by the solver
+    const bounds_block<T> &get_bounds() const {
+        return mBounds;
+    }
+
     virtual double operator()(const T &x) = 0;
 
     virtual void gradient(const T& x, T& gr)  {
         numerical_gradient(x, gr);
     };
 
-    void numerical_gradient(const T& x, T& gr, double gridSpacing = 1e-3) {
+    // Compute both the objective and its gradient at x, returning the former.
+    // The solver always calls this method, so override it when the value and
+    // the gradient share computations. By default, it falls back to operator()
+    // and gradient(). If the latter ends up using forward differences, the
+    // value of the objective at x is reused.
+    virtual double value_and_gradient(const T& x, T& gr) {
+        double value = (*this)(x);
+        known_value_guard guard(*this, x, value);
+        gradient(x, gr);
+        return value;
+    }
+
+    // Non-virtual equivalent of pb.value_and_gradient(x, gr), valid only if the
+    // dynamic type of pb is exactly P. The member functions of P are called with
+    // qualified names so that the compiler may inline them.
+    template<class P>
+    static double static_value_and_gradient(P &pb, const T &x, T &gr) {
+        typedef std::is_same<decltype(&P::value_and_gradient), double (problem_base::*)(const T &, T &)> inherited;
+        return static_value_and_gradient(pb, x, gr, inherited());
+    }
+
+    // Objective evaluated at complex arguments, only required by the complex_step
+    // scheme. Write the objective as a template on the scalar type to implement
+    // both this method and operator().
+    virtual std::complex<double> complex_value(const std::vector<std::complex<double> > &) {
+        throw std::logic_error("The complex_step scheme requires overriding complex_value");
+    }
+
+    // Values of the elements of a partially separable objective f(x) = sum_k f_k(x),
+    // only required when a coupling structure has been set. values has one entry
+    // per element.
+    virtual void element_values(const T&, std::vector<double>&) {
+        throw std::logic_error("Grouped differences require overriding element_values");
+    }
+
+    // Declare the objective as partially separable: elementVariables[k] lists the
+    // variables of the k-th element (see element_values). The forward and central
+    // schemes then perturb groups of non-interacting variables at once (see
+    // coupling_structure), so the numerical gradient costs O(number of colors)
+    // evaluations of the elements instead of O(n) evaluations of the objective.
+    void set_coupling_structure(const std::vector<std::vector<int> >& elementVariables) {
+        mCouplingStructure = std::make_shared<const coupling_structure>(mInputDimension, elementVariables);
+    }
+
+    void clear_coupling_structure() {
+        mCouplingStructure.reset();
+    }
+
+    std::shared_ptr<const coupling_structure> get_coupling_structure() const {
+        return mCouplingStructure;
+    }
+
+    // Numerical gradient using the finite difference scheme and the differencing mode
+    // of the problem. A default grid spacing is selected for each scheme.
+    void numerical_gradient(const T& x, T& gr) {
+        numerical_gradient(x, gr, default_grid_spacing(mFiniteDifferenceScheme));
+    }
+
+    // The gradient is written in place: gr only needs to have the right size
+    // and, after the first call, no full-length temporaries are created.
+    void numerical_gradient(const T& x, T& gr, double gridSpacing) {
         if (x.size() != mInputDimension) {
             throw std::invalid_argument("x size does not match the problem's input dimension");
         }
-        gr = l_bfgs_b_utils::numerical_gradient((*this), x, mLowerBound, mUpperBound, gridSpacing);
+        if (gr.size() != mInputDimension) {
+            gr = x;
+        }
+        int noThreads = (mDifferencingMode == differencing_mode::parallel) ? mDifferencingThreads : 1;
+        if (mCouplingStructure && mFiniteDifferenceScheme != finite_difference_scheme::complex_step) {
+            auto elementFunctor = [this](const T &z, std::vector<double> &values) {
+                this->element_values(z, values);
+            };
+            l_bfgs_b_utils::detail::grouped_gradient(
+                    elementFunctor, x, *mCouplingStructure, get_lower_bound(), get_upper_bound(), gridSpacing,
+                    mFiniteDifferenceScheme == finite_difference_scheme::central, noThreads, mWorkPoints,
+                    mGroupedBuffers, gr);
+            return;
+        }
+        switch (mFiniteDifferenceScheme) {
+            case finite_difference_scheme::forward: {
+                double fx = (mKnownPoint == &x) ? mKnownValue : (*this)(x);
+                l_bfgs_b_utils::detail::forward_gradient((*this), x, fx, get_lower_bound(), get_upper_bound(),
+                                                         gridSpacing, noThreads, mWorkPoints, gr);
+                break;
+            }
+            case finite_difference_scheme::complex_step: {
+                auto complexFunctor = [this](const std::vector<std::complex<double> > &z) {
+                    return this->complex_value(z);
+                };
+                l_bfgs_b_utils::detail::complex_step_gradient(complexFunctor, x, gridSpacing, noThreads,
+                                                              mComplexWorkPoints, gr);
+                break;
+            }
+            default:
+                l_bfgs_b_utils::detail::central_gradient((*this), x, get_lower_bound(), get_upper_bound(),
+                                                         gridSpacing, noThreads, mWorkPoints, gr);
+        }
+    }
+
+    finite_difference_scheme get_finite_difference_scheme() const {
+        return mFiniteDifferenceScheme;
+    }
+
+    void set_finite_difference_scheme(finite_difference_scheme scheme) {
+        mFiniteDifferenceScheme = scheme;
+    }
+
+    static double default_grid_spacing(finite_difference_scheme scheme) {
+        switch (scheme) {
+            case finite_difference_scheme::forward:
+                // ~ sqrt(machine epsilon)
+                return 1.5e-8;
+            case finite_difference_scheme::complex_step:
+                return 1e-20;
+            default:
+                return 1e-3;
+        }
+    }
+
+    differencing_mode get_differencing_mode() const {
+        return mDifferencingMode;
+    }
+
+    int get_differencing_threads() const {
+        return mDifferencingThreads;
+    }
+
+    // Choose between serial and parallel evaluation of the numerical gradient.
+    // noThreads is only used by the parallel mode (<= 0 selects the number of
+    // hardware threads). With the parallel mode, the function used by the
+    // scheme (operator(), element_values if a coupling structure is set, or
+    // complex_value for the complex step) is called concurrently from several
+    // threads and must not modify shared state.
+    void set_differencing_mode(differencing_mode mode, int noThreads = 0) {
+        mDifferencingMode = mode;
+        mDifferencingThreads = noThreads;
     }
 
 protected:
     int mInputDimension;
-    T mLowerBound;
-    T mUpperBound;
+    bounds_block<T> mBounds;
+    differencing_mode mDifferencingMode = differencing_mode::serial;
+    int mDifferencingThreads = 0;
+    finite_difference_scheme mFiniteDifferenceScheme = finite_difference_scheme::central;
+    std::shared_ptr<const coupling_structure> mCouplingStructure;
+    // value of the objective at *mKnownPoint, set while value_and_gradient
+    // calls gradient()
+    const T *mKnownPoint = nullptr;
+    double mKnownValue = 0;
+    // perturbed copies of x used by numerical_gradient, one per worker
+    std::vector<T> mWorkPoints;
+    // complex copies of x used by the complex-step scheme
+    std::vector<l_bfgs_b_utils::detail::complex_vector> mComplexWorkPoints;
+    // scratch space of the grouped differences
+    l_bfgs_b_utils::detail::grouped_buffers mGroupedBuffers;
 
     problem_base() = default;
 
-    void set_default_bounds() {
+    // publish f(x) during the lifetime of the guard
+    class known_value_guard {
+    public:
+        known_value_guard(problem_base &pb, const T &x, double value) : mPb(pb) {
+            mPb.mKnownPoint = &x;
+            mPb.mKnownValue = value;
+        }
+
+        ~known_value_guard() {
+            mPb.mKnownPoint = nullptr;
+        }
+
+    private:
+        problem_base &mPb;
+    };
+
+    // P overrides value_and_gradient
+    template<class P>
+    static double static_value_and_gradient(P &pb, const T &x, T &gr, std::false_type) {
+        return pb.P::value_and_gradient(x, gr);
+    }
+
+    // same as the default value_and_gradient
+    template<class P>
+    static double static_value_and_gradient(P &pb, const T &x, T &gr, std::true_type) {
+        double value = pb.P::operator()(x);
+        known_value_guard guard(pb, x, value);
+        pb.P::gradient(x, gr);
+        return value;
+    }
+
+    // set unbounded coordinates using lowerBound and upperBound as storage
+    void set_default_bounds(T &lowerBound, T &upperBound) {
         for (int i = 0; i < mInputDimension; ++i) {
-            mLowerBound[i] = -::std::numeric_limits<double>::infinity();
-            mUpperBound[i] = ::std::numeric_limits<double>::infinity();
+            lowerBound[i] = -::std::numeric_limits<double>::infinity();
+            upperBound[i] = ::std::numeric_limits<double>::infinity();
         }
+        mBounds.assign(lowerBound, upperBound);
     };
 
     static void check_input_dimension(int inputDimension) {
@@ -150,14 +373,14 @@ public:
         this->mInputDimension = inputDimension;
         this->check_container_dimensions(N, inputDimension);
         this->check_bounds(lowerBound,upperBound);
-        this->mLowerBound = lowerBound;
-        this->mUpperBound = upperBound;
+        this->mBounds.assign(lowerBound, upperBound);
     }
 
     problem(int inputDimension) : base() {
         this->check_container_dimensions(N, inputDimension);
         this->mInputDimension = inputDimension;
-        this->set_default_bounds();
+        std::array<U, N> lowerBound, upperBound;
+        this->set_default_bounds(lowerBound, upperBound);
     }
 };
 
@@ -0,0 +1,119 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef LBFGSB_CPP_SCALING_H
+#define LBFGSB_CPP_SCALING_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace l_bfgs_b_utils {
+    // relative size of the perturbation used to estimate the curvature
+    const double scaling_step = 1e-3;
+    // the estimated scales are powers of two within 2^-max_scaling_exponent and
+    // 2^max_scaling_exponent of their geometric mean
+    const int max_scaling_exponent = 60;
+
+    inline void check_variable_scales(const std::vector<double> &scales) {
+        if (scales.empty()) {
+            throw std::invalid_argument("scales should not be empty");
+        }
+        for (double scale : scales) {
+            if (!(scale > 0) || std::isinf(scale)) {
+                throw std::invalid_argument("scales should be finite and > 0");
+            }
+        }
+    }
+
+    inline bool within_bounds(double xi, double li, double ui, int nbdi) {
+        return !(((nbdi == 1 || nbdi == 2) && xi < li) || ((nbdi == 2 || nbdi == 3) && xi > ui));
+    }
+
+    // Clamp x to the box [l, u] described by nbd (the bound types of setulb)
+    template<class T>
+    void project_onto_bounds(int n, const double *l, const double *u, const int *nbd, T &x) {
+        for (int i = 0; i < n; i++) {
+            if ((nbd[i] == 1 || nbd[i] == 2) && x[i] < l[i]) {
+                x[i] = l[i];
+            }
+            if ((nbd[i] == 2 || nbd[i] == 3) && x[i] > u[i]) {
+                x[i] = u[i];
+            }
+        }
+    }
+
+    // Estimate the scales of the variables from the diagonal of the Hessian at
+    // x, whose gradient is g. All the coordinates are perturbed at once by
+    // scaling_step times their magnitude (or the width of their bounds, or 1,
+    // if they are 0), with pseudo-random signs, which costs a single evaluation
+    // of the gradient: evaluate(xp, gp). Then scale_i = 1 / sqrt(H_ii), so that
+    // the scaled problem has a unit diagonal. This is a one-sample estimate: the
+    // curvature of coordinate i also includes sum_{j != i} H_ij s_j / s_i, where
+    // s are the perturbations, which only cancels in expectation over the signs.
+    // Strongly coupled objectives may therefore get biased scales, and x should
+    // have the magnitudes expected for the solution so that the perturbations
+    // are roughly proportional to the scales. Coordinates without a positive
+    // curvature estimate (e.g. because the coupling flipped its sign) get the
+    // geometric mean of the others. The scales are normalized to a unit
+    // geometric mean and rounded to powers of two, so that scaling and
+    // unscaling the variables is exact and problems whose curvatures are within
+    // a factor of two keep unit scales.
+    template<class T, class Evaluator>
+    void estimate_variable_scales(int n, const double *l, const double *u, const int *nbd, const T &x,
+                                  const T &g, T &xp, T &gp, Evaluator &evaluate,
+                                  std::vector<double> &scales) {
+        std::minstd_rand signs(12345);
+        xp = x;
+        // scales holds the perturbations until the curvature is known
+        scales.resize(n);
+        for (int i = 0; i < n; i++) {
+            double typical = std::abs(x[i]);
+            if (typical == 0) {
+                typical = (nbd[i] == 2) ? std::min(u[i] - l[i], 1.0) : 1.0;
+            }
+            double step = scaling_step * typical;
+            if (signs() % 2 == 0) {
+                step = -step;
+            }
+            if (!within_bounds(x[i] + step, l[i], u[i], nbd[i])) {
+                step = within_bounds(x[i] - step, l[i], u[i], nbd[i]) ? -step : 0;
+            }
+            xp[i] = x[i] + step;
+            // the perturbation actually applied, after rounding
+            scales[i] = xp[i] - x[i];
+        }
+        gp = g;
+        evaluate(xp, gp);
+
+        // log2 of the scales, NaN where the curvature is unknown
+        double sum = 0;
+        int noValid = 0;
+        for (int i = 0; i < n; i++) {
+            double curvature = (scales[i] != 0) ? (gp[i] - g[i]) / scales[i] : 0;
+            if (curvature > 0 && !std::isinf(curvature)) {
+                scales[i] = -0.5 * std::log2(curvature);
+                sum += scales[i];
+                noValid++;
+            } else {
+                scales[i] = std::numeric_limits<double>::quiet_NaN();
+            }
+        }
+        double mean = (noValid > 0) ? sum / noValid : 0;
+        for (int i = 0; i < n; i++) {
+            double exponent = std::isnan(scales[i]) ? 0 : std::round(scales[i] - mean);
+            exponent = std::max(-static_cast<double>(max_scaling_exponent),
+                                std::min(static_cast<double>(max_scaling_exponent), exponent));
+            scales[i] = std::ldexp(1.0, static_cast<int>(exponent));
+        }
+    }
+}
+
+#endif //LBFGSB_CPP_SCALING_H
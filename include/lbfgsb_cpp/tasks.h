@@ -0,0 +1,94 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef LBFGSB_CPP_TASKS_H
+#define LBFGSB_CPP_TASKS_H
+
+// Job exchanged with the Fortran routine (setulb's task argument). The values
+// must match the task_* codes of Lbfgsb.3.0/lbfgsb_codes.inc.
+enum class l_bfgs_b_task : int {
+    start = 0,
+    // x holds a new iterate
+    new_x = 1,
+    // evaluate the objective and its gradient at x
+    fg_start = 2,
+    fg_line_search = 3,
+    restart_from_line_search = 4,
+    convergence_projected_gradient = 5,
+    convergence_relative_reduction = 6,
+    abnormal_line_search = 7,
+    error_dimension = 8,
+    error_memory_size = 9,
+    error_precision_factor = 10,
+    error_bound_type = 11,
+    error_infeasible_bounds = 12,
+    // start reusing the limited-memory corrections of a previous solve
+    warm_start = 13,
+    stop = 14,
+    // stop and restore the previous iterate
+    stop_restore = 15
+};
+
+// State of the line search (setulb's csave argument). The values must match
+// the ls_* codes of Lbfgsb.3.0/lbfgsb_codes.inc.
+enum class line_search_state : int {
+    start = 0,
+    evaluate = 1,
+    convergence = 2,
+    warning_rounding_errors = 3,
+    warning_xtol = 4,
+    warning_max_step = 5,
+    warning_min_step = 6,
+    error_step_below_min = 7,
+    error_step_above_max = 8,
+    error_ascent_direction = 9,
+    error_ftol = 10,
+    error_gtol = 11,
+    error_xtol = 12,
+    error_min_step = 13,
+    error_max_step = 14
+};
+
+// Entries of the options arrays passed to the Fortran routine (setulb's iopt
+// and dopt arguments, 0-based here). They must match the opt_* and dopt_*
+// codes of Lbfgsb.3.0/lbfgsb_codes.inc; unused entries are 0.
+namespace l_bfgs_b_options {
+    const int size = 8;
+    // 1: the search direction of problems without bounds is computed with the
+    // two-loop recursion
+    const int direction = 0;
+    // 1: the breakpoints of the Cauchy search are ordered by bulk selection
+    const int breakpoints = 1;
+    // 1: the line search backtracks until the sufficient decrease condition holds
+    const int line_search = 2;
+
+    // real options, 0 selects the default value
+    const int sufficient_decrease = 0;
+    const int curvature = 1;
+    const int step_tolerance = 2;
+    const int max_step = 3;
+}
+
+namespace l_bfgs_b_utils {
+    // the objective and its gradient have to be evaluated at x
+    inline bool requests_evaluation(l_bfgs_b_task task) {
+        return task == l_bfgs_b_task::fg_start || task == l_bfgs_b_task::fg_line_search;
+    }
+
+    // the solve is in progress: setulb has to be called again
+    inline bool is_running(l_bfgs_b_task task) {
+        return task == l_bfgs_b_task::start || task == l_bfgs_b_task::new_x || requests_evaluation(task) ||
+               task == l_bfgs_b_task::warm_start;
+    }
+
+    // the input was rejected before the work arrays were initialized
+    inline bool is_error(l_bfgs_b_task task) {
+        return task >= l_bfgs_b_task::error_dimension && task <= l_bfgs_b_task::error_infeasible_bounds;
+    }
+}
+
+#endif //LBFGSB_CPP_TASKS_H
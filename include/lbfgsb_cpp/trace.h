@@ -0,0 +1,227 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef LBFGSB_CPP_TRACE_H
+#define LBFGSB_CPP_TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// State of a solve after one iteration. The times are those spent during the
+// iteration, in seconds
+struct l_bfgs_b_trace_record {
+    std::int32_t iteration;
+    // evaluations of the objective in the iteration
+    std::int32_t evaluations;
+    double f;
+    // infinity norm of the projected gradient
+    double projectedGradientNorm;
+    // step length relative to the search direction, and norm of the step
+    double step;
+    double stepNorm;
+    std::int32_t freeVariables;
+    std::int32_t activeVariables;
+    // breakpoints crossed by the search of the Cauchy point
+    std::int32_t breakpoints;
+    // backtracking steps of the line search
+    std::int32_t backtracks;
+    double cauchyTime;
+    double subspaceTime;
+    double lineSearchTime;
+    double objectiveTime;
+};
+
+namespace l_bfgs_b_utils {
+    // Column of a trace file: a field of l_bfgs_b_trace_record
+    struct trace_column {
+        char name[24];
+        // 0 for int32, 1 for double
+        std::int32_t type;
+        std::int32_t offset;
+    };
+
+    // Binary trace files start with this header, followed by noColumns
+    // trace_column descriptors and then by the columns, each one with noRecords
+    // values, in the native byte order.
+    struct trace_header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t noColumns;
+        std::uint64_t noRecords;
+
+        static const std::uint32_t current_version = 1;
+    };
+
+    inline const std::vector<trace_column> &trace_columns() {
+#define LBFGSB_TRACE_COLUMN(field, type) {#field, type, static_cast<std::int32_t>(offsetof(l_bfgs_b_trace_record, field))}
+        static const std::vector<trace_column> columns = {
+                LBFGSB_TRACE_COLUMN(iteration, 0),
+                LBFGSB_TRACE_COLUMN(evaluations, 0),
+                LBFGSB_TRACE_COLUMN(f, 1),
+                LBFGSB_TRACE_COLUMN(projectedGradientNorm, 1),
+                LBFGSB_TRACE_COLUMN(step, 1),
+                LBFGSB_TRACE_COLUMN(stepNorm, 1),
+                LBFGSB_TRACE_COLUMN(freeVariables, 0),
+                LBFGSB_TRACE_COLUMN(activeVariables, 0),
+                LBFGSB_TRACE_COLUMN(breakpoints, 0),
+                LBFGSB_TRACE_COLUMN(backtracks, 0),
+                LBFGSB_TRACE_COLUMN(cauchyTime, 1),
+                LBFGSB_TRACE_COLUMN(subspaceTime, 1),
+                LBFGSB_TRACE_COLUMN(lineSearchTime, 1),
+                LBFGSB_TRACE_COLUMN(objectiveTime, 1)
+        };
+#undef LBFGSB_TRACE_COLUMN
+        return columns;
+    }
+
+    inline std::size_t trace_column_size(const trace_column &column) {
+        return (column.type == 0) ? sizeof(std::int32_t) : sizeof(double);
+    }
+}
+
+// Ring buffer with the records of the last iterations of the solves that use
+// it (see l_bfgs_b::set_trace). Once full, each new record replaces the oldest
+// one. The records are stored as they are, so that tracing a solve does not
+// format or allocate anything; write exports them to a binary file with one
+// column per field of l_bfgs_b_trace_record, which load reads back.
+class l_bfgs_b_trace {
+public:
+    explicit l_bfgs_b_trace(int capacity) : mRecords((check_capacity(capacity), capacity)) {
+    }
+
+    int capacity() const {
+        return static_cast<int>(mRecords.size());
+    }
+
+    int size() const {
+        return mSize;
+    }
+
+    // records replaced by newer ones since the last call to clear
+    long long dropped() const {
+        return mDropped;
+    }
+
+    // i-th record, from the oldest (0) to the newest (size() - 1)
+    const l_bfgs_b_trace_record &operator[](int i) const {
+        int j = mFirst + i;
+        return mRecords[j < capacity() ? j : j - capacity()];
+    }
+
+    void push(const l_bfgs_b_trace_record &record) {
+        int j = mFirst + mSize;
+        mRecords[j < capacity() ? j : j - capacity()] = record;
+        if (mSize < capacity()) {
+            mSize++;
+        } else {
+            mFirst = (mFirst + 1 < capacity()) ? mFirst + 1 : 0;
+            mDropped++;
+        }
+    }
+
+    void clear() {
+        mFirst = 0;
+        mSize = 0;
+        mDropped = 0;
+    }
+
+    void write(const std::string &path) const {
+        std::ofstream stream(path.c_str(), std::ios::binary | std::ios::trunc);
+        if (!stream) {
+            throw std::runtime_error("Could not open " + path + " for writing");
+        }
+        const std::vector<l_bfgs_b_utils::trace_column> &columns = l_bfgs_b_utils::trace_columns();
+        l_bfgs_b_utils::trace_header header;
+        std::memcpy(header.magic, "LBFGSBTR", sizeof(header.magic));
+        header.version = l_bfgs_b_utils::trace_header::current_version;
+        header.noColumns = columns.size();
+        header.noRecords = mSize;
+        stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        stream.write(reinterpret_cast<const char *>(&columns[0]),
+                     columns.size() * sizeof(l_bfgs_b_utils::trace_column));
+        std::vector<char> buffer;
+        for (const auto &column : columns) {
+            std::size_t size = l_bfgs_b_utils::trace_column_size(column);
+            buffer.resize(mSize * size);
+            for (int i = 0; i < mSize; i++) {
+                std::memcpy(&buffer[i * size], reinterpret_cast<const char *>(&(*this)[i]) + column.offset, size);
+            }
+            stream.write(buffer.data(), buffer.size());
+        }
+        stream.close();
+        if (stream.fail()) {
+            throw std::runtime_error("Could not write the trace " + path);
+        }
+    }
+
+    // Reads a file written by write. The capacity of the trace is the number of
+    // records in the file (or 1 if there are none)
+    static l_bfgs_b_trace load(const std::string &path) {
+        std::ifstream stream(path.c_str(), std::ios::binary);
+        if (!stream) {
+            throw std::runtime_error("Could not open the trace " + path);
+        }
+        l_bfgs_b_utils::trace_header header;
+        stream.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (!stream || std::memcmp(header.magic, "LBFGSBTR", sizeof(header.magic)) != 0) {
+            throw std::runtime_error(path + " is not a trace");
+        }
+        const std::vector<l_bfgs_b_utils::trace_column> &columns = l_bfgs_b_utils::trace_columns();
+        // the counts are checked before they are used to allocate memory
+        if (header.version != l_bfgs_b_utils::trace_header::current_version ||
+            header.noColumns != columns.size()) {
+            throw std::runtime_error("Unsupported trace version or platform in " + path);
+        }
+        if (header.noRecords > static_cast<std::uint64_t>(std::numeric_limits<int>::max())) {
+            throw std::runtime_error("Unsupported trace size in " + path);
+        }
+        std::vector<l_bfgs_b_utils::trace_column> fileColumns(header.noColumns);
+        stream.read(reinterpret_cast<char *>(fileColumns.data()),
+                    fileColumns.size() * sizeof(l_bfgs_b_utils::trace_column));
+        if (!stream ||
+            std::memcmp(fileColumns.data(), columns.data(), columns.size() * sizeof(l_bfgs_b_utils::trace_column))) {
+            throw std::runtime_error("Unsupported trace version or platform in " + path);
+        }
+        int noRecords = static_cast<int>(header.noRecords);
+        l_bfgs_b_trace trace(noRecords > 0 ? noRecords : 1);
+        trace.mSize = noRecords;
+        std::vector<char> buffer;
+        for (const auto &column : columns) {
+            std::size_t size = l_bfgs_b_utils::trace_column_size(column);
+            buffer.resize(static_cast<std::size_t>(noRecords) * size);
+            stream.read(buffer.data(), buffer.size());
+            if (!stream) {
+                throw std::runtime_error("Truncated trace " + path);
+            }
+            for (int i = 0; i < noRecords; i++) {
+                std::memcpy(reinterpret_cast<char *>(&trace.mRecords[i]) + column.offset, &buffer[i * size], size);
+            }
+        }
+        return trace;
+    }
+
+private:
+    std::vector<l_bfgs_b_trace_record> mRecords;
+    // index of the oldest record
+    int mFirst = 0;
+    int mSize = 0;
+    long long mDropped = 0;
+
+    static void check_capacity(int capacity) {
+        if (capacity < 1) {
+            throw std::invalid_argument("capacity should be >= 1");
+        }
+    }
+};
+
+#endif //LBFGSB_CPP_TRACE_H
@@ -8,27 +8,38 @@
 #ifndef LBFGSB_CPP_UTILS_H
 #define LBFGSB_CPP_UTILS_H
 
+#include <algorithm>
 #include <initializer_list>
 #include <cassert>
+#include <cmath>
+#include <complex>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "parallel.h"
 
 namespace l_bfgs_b_utils {
-    template<class T, typename F>
-    T numerical_gradient(F &functor, const T &x, const T &lowerBound, const T &upperBound,
-                         double gridSpacing = 1e-6) {
-        // check consistency of the dimensions
-        int inputDimension = x.size();
-        if (inputDimension != lowerBound.size() || inputDimension != upperBound.size()) {
-            throw std::invalid_argument("The size of x does not match the bound's dimensions");
-        }
-        // check x is within bounds
-        for (int i = 0; i < inputDimension; i++) {
-            if (x[i] > upperBound[i] | x[i] < lowerBound[i]) {
-                throw std::runtime_error("x is not contained within [lowerBound, upperBound]");
+    namespace detail {
+        template<class T>
+        void check_gradient_arguments(const T &x, const T &lowerBound, const T &upperBound) {
+            // check consistency of the dimensions
+            int inputDimension = x.size();
+            if (inputDimension != lowerBound.size() || inputDimension != upperBound.size()) {
+                throw std::invalid_argument("The size of x does not match the bound's dimensions");
+            }
+            // check x is within bounds
+            for (int i = 0; i < inputDimension; i++) {
+                if (x[i] > upperBound[i] | x[i] < lowerBound[i]) {
+                    throw std::runtime_error("x is not contained within [lowerBound, upperBound]");
+                }
             }
         }
-        T gr(x);
-        T workX(x);
-        for (int i = 0; i < inputDimension; i++) {
+
+        // Central difference along coordinate i. workX should be equal to x on entry
+        // and it is restored before returning.
+        template<class T, typename F>
+        double central_difference(F &functor, const T &x, T &workX, int i, const T &lowerBound,
+                                  const T &upperBound, double gridSpacing) {
             double effectiveGridOver =
                     ((x[i] + gridSpacing) > upperBound[i]) ? upperBound[i] - x[i] : gridSpacing;
             workX[i] = x[i] + effectiveGridOver;
@@ -36,10 +47,169 @@ namespace l_bfgs_b_utils {
             double effectiveGridBelow =
                     ((x[i] - gridSpacing) < lowerBound[i]) ? x[i] - lowerBound[i] : gridSpacing;
             workX[i] = x[i] - effectiveGridBelow;
-            gr[i] = (valueOver - functor(workX)) / (effectiveGridOver + effectiveGridBelow);
+            double derivative = (valueOver - functor(workX)) / (effectiveGridOver + effectiveGridBelow);
             // restore original value
             workX[i] = x[i];
+            return derivative;
         }
+
+        // One-sided difference along coordinate i reusing fx = f(x). The step,
+        // gridSpacing * max(1, |x[i]|), goes forward if the upper bound allows it;
+        // otherwise, it goes backward or, if neither full step fits, towards the
+        // farthest bound.
+        template<class T, typename F>
+        double one_sided_difference(F &functor, const T &x, double fx, T &workX, int i,
+                                    const T &lowerBound, const T &upperBound, double gridSpacing) {
+            // relative to x[i], so that x[i] + step != x[i] for large |x[i]|
+            double h = gridSpacing * std::max(1.0, std::abs(x[i]));
+            double step = h;
+            if ((x[i] + h) > upperBound[i]) {
+                if ((x[i] - h) >= lowerBound[i]) {
+                    step = -h;
+                } else {
+                    double roomOver = upperBound[i] - x[i];
+                    double roomBelow = x[i] - lowerBound[i];
+                    step = (roomOver >= roomBelow) ? roomOver : -roomBelow;
+                }
+            }
+            if (step == 0) {
+                // fixed variable (lowerBound[i] == upperBound[i])
+                return 0;
+            }
+            workX[i] = x[i] + step;
+            double derivative = (functor(workX) - fx) / step;
+            workX[i] = x[i];
+            return derivative;
+        }
+
+        // Make the first noWorkers entries of workPoints equal to x, reusing their storage
+        template<class T>
+        void prepare_work_points(const T &x, int noWorkers, std::vector<T> &workPoints) {
+            if (static_cast<int>(workPoints.size()) < noWorkers) {
+                workPoints.resize(noWorkers);
+            }
+            for (int worker = 0; worker < noWorkers; worker++) {
+                workPoints[worker] = x;
+            }
+        }
+
+        typedef std::vector<std::complex<double> > complex_vector;
+
+        // Same as prepare_work_points, for the complex copies of x used by the
+        // complex-step scheme
+        template<class T>
+        void prepare_work_points(const T &x, int noWorkers, std::vector<complex_vector> &workPoints) {
+            int inputDimension = x.size();
+            if (static_cast<int>(workPoints.size()) < noWorkers) {
+                workPoints.resize(noWorkers);
+            }
+            for (int worker = 0; worker < noWorkers; worker++) {
+                complex_vector &z = workPoints[worker];
+                z.resize(inputDimension);
+                for (int i = 0; i < inputDimension; i++) {
+                    z[i] = x[i];
+                }
+            }
+        }
+
+        // Apply a difference kernel to every coordinate of x, using noThreads workers.
+        // The derivatives are written in gr, which must have the size of x, and each
+        // worker perturbs its own entry of workPoints.
+        template<class T, typename K>
+        void differentiate(const T &x, int noThreads, std::vector<T> &workPoints, T &gr, K kernel) {
+            int inputDimension = x.size();
+            int noWorkers = effective_thread_count(inputDimension, noThreads);
+            prepare_work_points(x, noWorkers, workPoints);
+            parallel_for(inputDimension, noWorkers, [&](int worker, int i) {
+                gr[i] = kernel(workPoints[worker], i);
+            });
+        }
+
+        // In-place versions of the gradients below. They do not allocate once gr and
+        // workPoints have been used with the same dimensions.
+        template<class T, typename F>
+        void central_gradient(F &functor, const T &x, const T &lowerBound, const T &upperBound,
+                              double gridSpacing, int noThreads, std::vector<T> &workPoints, T &gr) {
+            check_gradient_arguments(x, lowerBound, upperBound);
+            differentiate(x, noThreads, workPoints, gr, [&](T &workX, int i) {
+                return central_difference(functor, x, workX, i, lowerBound, upperBound, gridSpacing);
+            });
+        }
+
+        template<class T, typename F>
+        void forward_gradient(F &functor, const T &x, double fx, const T &lowerBound, const T &upperBound,
+                              double gridSpacing, int noThreads, std::vector<T> &workPoints, T &gr) {
+            check_gradient_arguments(x, lowerBound, upperBound);
+            differentiate(x, noThreads, workPoints, gr, [&](T &workX, int i) {
+                return one_sided_difference(functor, x, fx, workX, i, lowerBound, upperBound, gridSpacing);
+            });
+        }
+
+        template<class T, typename F>
+        void complex_step_gradient(F &functor, const T &x, double gridSpacing, int noThreads,
+                                   std::vector<complex_vector> &workZ, T &gr) {
+            int inputDimension = x.size();
+            int noWorkers = effective_thread_count(inputDimension, noThreads);
+            prepare_work_points(x, noWorkers, workZ);
+            parallel_for(inputDimension, noWorkers, [&](int worker, int i) {
+                complex_vector &zi = workZ[worker];
+                zi[i] = std::complex<double>(x[i], gridSpacing);
+                gr[i] = std::imag(functor(zi)) / gridSpacing;
+                zi[i] = x[i];
+            });
+        }
+    }
+
+    template<class T, typename F>
+    T numerical_gradient(F &functor, const T &x, const T &lowerBound, const T &upperBound,
+                         double gridSpacing = 1e-6) {
+        T gr(x);
+        std::vector<T> workPoints;
+        detail::central_gradient(functor, x, lowerBound, upperBound, gridSpacing, 1, workPoints, gr);
+        return gr;
+    }
+
+    // Same as numerical_gradient, but the coordinates are distributed among
+    // noThreads threads (<= 0 selects the number of hardware threads), each one
+    // perturbing its own copy of x. The functor is therefore called concurrently
+    // and must be safe to call from several threads at the same time: it should
+    // behave as a const function, not modifying any shared state. The result is
+    // identical to the one of the serial version.
+    template<class T, typename F>
+    T parallel_numerical_gradient(F &functor, const T &x, const T &lowerBound, const T &upperBound,
+                                  double gridSpacing = 1e-6, int noThreads = 0) {
+        T gr(x);
+        std::vector<T> workPoints;
+        detail::central_gradient(functor, x, lowerBound, upperBound, gridSpacing, noThreads, workPoints, gr);
+        return gr;
+    }
+
+    // Forward differences reusing the known value fx = f(x): n evaluations of the
+    // functor instead of the 2n of the central scheme, at the price of an O(gridSpacing)
+    // error. Near the upper bound, backward differences are used instead. The
+    // step along x[i] is gridSpacing * max(1, |x[i]|), so a gridSpacing close to
+    // sqrt(machine epsilon) is usually a good choice.
+    // See parallel_numerical_gradient for the meaning of noThreads.
+    template<class T, typename F>
+    T forward_numerical_gradient(F &functor, const T &x, double fx, const T &lowerBound,
+                                 const T &upperBound, double gridSpacing = 1e-8, int noThreads = 1) {
+        T gr(x);
+        std::vector<T> workPoints;
+        detail::forward_gradient(functor, x, fx, lowerBound, upperBound, gridSpacing, noThreads, workPoints, gr);
+        return gr;
+    }
+
+    // Complex-step derivative: gr[i] = Im(f(x + i * h * e_i)) / h. It requires a
+    // functor that accepts a std::vector<std::complex<double> > and returns a
+    // std::complex<double>, i.e., an objective templated on the scalar type. There
+    // is no subtractive cancellation, so tiny steps yield gradients exact to machine
+    // precision with n evaluations. The bounds play no role since x is not perturbed
+    // along the real axis. See parallel_numerical_gradient for the meaning of noThreads.
+    template<class T, typename F>
+    T complex_step_gradient(F &functor, const T &x, double gridSpacing = 1e-20, int noThreads = 1) {
+        T gr(x);
+        std::vector<detail::complex_vector> workZ;
+        detail::complex_step_gradient(functor, x, gridSpacing, noThreads, workZ, gr);
         return gr;
     }
 
@@ -0,0 +1,155 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef LBFGSB_CPP_WORKSPACE_H
+#define LBFGSB_CPP_WORKSPACE_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+template<class T>
+class l_bfgs_b;
+
+// Buffers required by the Fortran routine to solve a problem of dimension n
+// using m limited-memory corrections. The work arrays only grow: once a
+// workspace has been used for a given (n, m), solving problems of the same (or
+// smaller) shape does not allocate them again. The containers of type T (the
+// gradient, and the point and gradient used to estimate the scales) must have
+// the dimension of the problem, so they are resized whenever it changes; this
+// keeps the capacity of a std::vector but reallocates containers such as
+// arma::vec or Eigen::VectorXd.
+template<class T>
+class l_bfgs_b_workspace {
+public:
+    l_bfgs_b_workspace() : mDimension(0), mMemorySize(0), mPairsDimension(0), mPairsMemorySize(0) {
+    }
+
+    l_bfgs_b_workspace(int inputDimension, int memorySize) : l_bfgs_b_workspace() {
+        reserve(inputDimension, memorySize);
+    }
+
+    ~l_bfgs_b_workspace() = default;
+
+    int get_input_dimension() const {
+        return mDimension;
+    }
+
+    int get_memory_size() const {
+        return mMemorySize;
+    }
+
+    // size of the double precision work array required by setulb
+    static std::size_t work_array_size(int inputDimension, int memorySize) {
+        std::size_t n = inputDimension;
+        std::size_t m = memorySize;
+        return 2 * m * n + 5 * n + 11 * m * m + 8 * m;
+    }
+
+    // size of the integer work array required by setulb
+    static std::size_t int_work_array_size(int inputDimension) {
+        return 3 * static_cast<std::size_t>(inputDimension);
+    }
+
+    // Prepare the workspace for a problem of dimension inputDimension. Memory
+    // is only allocated if the current buffers are too small.
+    void reserve(int inputDimension, int memorySize) {
+        if (inputDimension < 1) {
+            throw std::invalid_argument("inputDimension should be >= 1");
+        }
+        if (memorySize < 1) {
+            throw std::invalid_argument("memorySize should be >= 1");
+        }
+        grow(mWorkArray, work_array_size(inputDimension, memorySize));
+        grow(mIntWorkArray, int_work_array_size(inputDimension));
+        mDimension = inputDimension;
+        mMemorySize = memorySize;
+    }
+
+    // The workspace holds the limited-memory corrections (pairs s, y and theta)
+    // left by a solve of dimension inputDimension using memorySize corrections,
+    // which can be reused by a warm start (see l_bfgs_b::set_warm_start).
+    bool has_curvature_pairs(int inputDimension, int memorySize) const {
+        return mPairsDimension > 0 && mPairsDimension == inputDimension && mPairsMemorySize == memorySize;
+    }
+
+    // number of corrections stored by the last solve
+    int get_number_of_curvature_pairs() const {
+        return (mPairsDimension > 0) ? mIntInformation[27] : 0;
+    }
+
+    // forget the corrections, so that the next solve starts from scratch
+    void clear_curvature_pairs() {
+        mPairsDimension = 0;
+        mPairsMemorySize = 0;
+    }
+
+    // scales of the variables used by the last solve (x = scales * y, where y
+    // are the variables seen by the Fortran routine); empty if it was not scaled
+    const std::vector<double> &get_variable_scales() const {
+        return mVariableScales;
+    }
+
+    // number of bytes currently held by the workspace
+    std::size_t allocated_bytes() const {
+        return (mLowerBound.capacity() + mUpperBound.capacity() + mWorkArray.capacity() +
+                mVariableScales.capacity() + mPairsScales.capacity() + mScaledPoint.capacity() + mScaledLowerBound.capacity() +
+                mScaledUpperBound.capacity()) * sizeof(double) +
+               (mNbd.capacity() + mIntWorkArray.capacity()) * sizeof(int) +
+               container_bytes(mGradient) + container_bytes(mScalingPoint) + container_bytes(mScalingGradient);
+    }
+
+private:
+    friend class l_bfgs_b<T>;
+
+    int mDimension;
+    int mMemorySize;
+    // shape of the solve that left the corrections in the work array (0 if none)
+    // and its variable scales, since the corrections are in scaled coordinates
+    int mPairsDimension;
+    int mPairsMemorySize;
+    std::vector<double> mPairsScales;
+    // copies of the bounds, only used if their container is not contiguous
+    std::vector<double> mLowerBound;
+    std::vector<double> mUpperBound;
+    // bound types, only used if the bounds are not given by a problem
+    std::vector<int> mNbd;
+    std::vector<double> mWorkArray;
+    std::vector<int> mIntWorkArray;
+    // gradient container, kept to avoid copying x0 on every solve
+    T mGradient;
+    // scaled iterate and bounds seen by the Fortran routine when the variables
+    // are scaled, and the point and gradient used to estimate the scales
+    std::vector<double> mVariableScales;
+    std::vector<double> mScaledPoint;
+    std::vector<double> mScaledLowerBound;
+    std::vector<double> mScaledUpperBound;
+    T mScalingPoint;
+    T mScalingGradient;
+    // state of the reverse-communication interface to Fortran code
+    bool mBoolInformation[4];
+    int mIntInformation[44];
+    double mDoubleInformation[29];
+
+    template<class C>
+    static std::size_t container_bytes(const C &container) {
+        return container.size() * sizeof(double);
+    }
+
+    static std::size_t container_bytes(const std::vector<double> &container) {
+        return container.capacity() * sizeof(double);
+    }
+
+    template<class U>
+    static void grow(std::vector<U> &buffer, std::size_t size) {
+        if (buffer.size() < size) {
+            buffer.resize(size);
+        }
+    }
+};
+
+#endif //LBFGSB_CPP_WORKSPACE_H
@@ -0,0 +1,399 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "blas_kernels.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define LBFGSB_CPP_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace {
+    // Longer vectors are split in chunks, processed by several threads in OpenMP
+    // builds (LBFGSB_OPENMP). The partial dot products are added in chunk order,
+    // so the results do not depend on the number of threads. Same value as
+    // lchunk in Lbfgsb.3.0/lbfgsb_parallel.inc.
+    const int chunkSize = 65536;
+    // chunks of a dot product whose partial sums are computed at a time
+    const int blockChunks = 64;
+
+    // -1 until the CPU has been inspected
+    std::atomic<int> selectedIsa(-1);
+
+    kernel_isa current_isa() {
+        int isa = selectedIsa.load(std::memory_order_relaxed);
+        if (isa < 0) {
+            isa = static_cast<int>(l_bfgs_b_blas::detect_isa());
+            selectedIsa.store(isa, std::memory_order_relaxed);
+        }
+        return static_cast<kernel_isa>(isa);
+    }
+
+    // Portable kernels. Several partial sums break the dependency chain of the
+    // reduction, like the unrolled loops of the reference BLAS.
+    double portable_dot(int n, const double *x, const double *y) {
+        double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            s0 += x[i] * y[i];
+            s1 += x[i + 1] * y[i + 1];
+            s2 += x[i + 2] * y[i + 2];
+            s3 += x[i + 3] * y[i + 3];
+        }
+        for (; i < n; i++) {
+            s0 += x[i] * y[i];
+        }
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    void portable_axpy(int n, double a, const double *x, double *y) {
+        for (int i = 0; i < n; i++) {
+            y[i] += a * x[i];
+        }
+    }
+
+    void portable_scal(int n, double a, double *x) {
+        for (int i = 0; i < n; i++) {
+            x[i] *= a;
+        }
+    }
+
+#ifdef LBFGSB_CPP_X86_KERNELS
+    __attribute__((target("avx2,fma")))
+    double avx2_dot(int n, const double *x, const double *y) {
+        __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+        __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+        int i = 0;
+        for (; i + 16 <= n; i += 16) {
+            s0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), s0);
+            s1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4), s1);
+            s2 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 8), _mm256_loadu_pd(y + i + 8), s2);
+            s3 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 12), _mm256_loadu_pd(y + i + 12), s3);
+        }
+        for (; i + 4 <= n; i += 4) {
+            s0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), s0);
+        }
+        __m256d s = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+        __m128d h = _mm_add_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s, 1));
+        double result = _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+        for (; i < n; i++) {
+            result += x[i] * y[i];
+        }
+        return result;
+    }
+
+    __attribute__((target("avx2,fma")))
+    void avx2_axpy(int n, double a, const double *x, double *y) {
+        __m256d va = _mm256_set1_pd(a);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_pd(y + i, _mm256_fmadd_pd(va, _mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+            _mm256_storeu_pd(y + i + 4,
+                             _mm256_fmadd_pd(va, _mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4)));
+        }
+        for (; i < n; i++) {
+            y[i] += a * x[i];
+        }
+    }
+
+    __attribute__((target("avx2")))
+    void avx2_scal(int n, double a, double *x) {
+        __m256d va = _mm256_set1_pd(a);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_pd(x + i, _mm256_mul_pd(va, _mm256_loadu_pd(x + i)));
+            _mm256_storeu_pd(x + i + 4, _mm256_mul_pd(va, _mm256_loadu_pd(x + i + 4)));
+        }
+        for (; i < n; i++) {
+            x[i] *= a;
+        }
+    }
+
+    // the tails are handled with masked loads and stores
+    __attribute__((target("avx512f")))
+    double avx512_dot(int n, const double *x, const double *y) {
+        __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+        __m512d s2 = _mm512_setzero_pd(), s3 = _mm512_setzero_pd();
+        int i = 0;
+        for (; i + 32 <= n; i += 32) {
+            s0 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i), s0);
+            s1 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i + 8), _mm512_loadu_pd(y + i + 8), s1);
+            s2 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i + 16), _mm512_loadu_pd(y + i + 16), s2);
+            s3 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i + 24), _mm512_loadu_pd(y + i + 24), s3);
+        }
+        for (; i + 8 <= n; i += 8) {
+            s0 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i), s0);
+        }
+        if (i < n) {
+            __mmask8 mask = static_cast<__mmask8>((1u << (n - i)) - 1);
+            s1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, x + i), _mm512_maskz_loadu_pd(mask, y + i), s1);
+        }
+        // reduced by hand: _mm512_reduce_add_pd and the unmasked extractions make
+        // GCC 12 warn about an uninitialized variable of avx512fintrin.h
+        __m512d v = _mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3));
+        __m256d s = _mm256_add_pd(_mm512_maskz_extractf64x4_pd(0xF, v, 0), _mm512_maskz_extractf64x4_pd(0xF, v, 1));
+        __m128d h = _mm_add_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+    }
+
+    __attribute__((target("avx512f")))
+    void avx512_axpy(int n, double a, const double *x, double *y) {
+        __m512d va = _mm512_set1_pd(a);
+        int i = 0;
+        for (; i + 16 <= n; i += 16) {
+            _mm512_storeu_pd(y + i, _mm512_fmadd_pd(va, _mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i)));
+            _mm512_storeu_pd(y + i + 8,
+                             _mm512_fmadd_pd(va, _mm512_loadu_pd(x + i + 8), _mm512_loadu_pd(y + i + 8)));
+        }
+        for (; i + 8 <= n; i += 8) {
+            _mm512_storeu_pd(y + i, _mm512_fmadd_pd(va, _mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i)));
+        }
+        if (i < n) {
+            __mmask8 mask = static_cast<__mmask8>((1u << (n - i)) - 1);
+            __m512d vy = _mm512_fmadd_pd(va, _mm512_maskz_loadu_pd(mask, x + i), _mm512_maskz_loadu_pd(mask, y + i));
+            _mm512_mask_storeu_pd(y + i, mask, vy);
+        }
+    }
+
+    __attribute__((target("avx512f")))
+    void avx512_scal(int n, double a, double *x) {
+        __m512d va = _mm512_set1_pd(a);
+        int i = 0;
+        for (; i + 16 <= n; i += 16) {
+            _mm512_storeu_pd(x + i, _mm512_mul_pd(va, _mm512_loadu_pd(x + i)));
+            _mm512_storeu_pd(x + i + 8, _mm512_mul_pd(va, _mm512_loadu_pd(x + i + 8)));
+        }
+        for (; i + 8 <= n; i += 8) {
+            _mm512_storeu_pd(x + i, _mm512_mul_pd(va, _mm512_loadu_pd(x + i)));
+        }
+        if (i < n) {
+            __mmask8 mask = static_cast<__mmask8>((1u << (n - i)) - 1);
+            _mm512_mask_storeu_pd(x + i, mask, _mm512_mul_pd(va, _mm512_maskz_loadu_pd(mask, x + i)));
+        }
+    }
+#endif
+
+    int number_of_chunks(int n) {
+        return (n + chunkSize - 1) / chunkSize;
+    }
+
+    double chunked_dot(kernel_isa isa, int n, const double *x, const double *y) {
+        int noChunks = number_of_chunks(n);
+        if (noChunks == 1) {
+            return l_bfgs_b_blas::dot(isa, n, x, y);
+        }
+        // the partial sums of up to blockChunks chunks are kept on the stack
+        double partialSums[blockChunks];
+        double result = 0;
+        for (int first = 0; first < noChunks; first += blockChunks) {
+            int last = std::min(first + blockChunks, noChunks);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+            for (int i = first; i < last; i++) {
+                int begin = i * chunkSize;
+                partialSums[i - first] = l_bfgs_b_blas::dot(isa, std::min(chunkSize, n - begin), x + begin,
+                                                            y + begin);
+            }
+            for (int i = first; i < last; i++) {
+                result += partialSums[i - first];
+            }
+        }
+        return result;
+    }
+
+    void chunked_axpy(kernel_isa isa, int n, double a, const double *x, double *y) {
+        int noChunks = number_of_chunks(n);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if(noChunks > 1)
+#endif
+        for (int i = 0; i < noChunks; i++) {
+            int begin = i * chunkSize;
+            l_bfgs_b_blas::axpy(isa, std::min(chunkSize, n - begin), a, x + begin, y + begin);
+        }
+    }
+
+    void chunked_scal(kernel_isa isa, int n, double a, double *x) {
+        int noChunks = number_of_chunks(n);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if(noChunks > 1)
+#endif
+        for (int i = 0; i < noChunks; i++) {
+            int begin = i * chunkSize;
+            l_bfgs_b_blas::scal(isa, std::min(chunkSize, n - begin), a, x + begin);
+        }
+    }
+
+    void chunked_copy(int n, const double *x, double *y) {
+        int noChunks = number_of_chunks(n);
+        // formk and matupd shift blocks within the same array
+        if (noChunks == 1 || (x < y + n && y < x + n)) {
+            std::memmove(y, x, n * sizeof(double));
+            return;
+        }
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+        for (int i = 0; i < noChunks; i++) {
+            int begin = i * chunkSize;
+            std::memcpy(y + begin, x + begin, std::min(chunkSize, n - begin) * sizeof(double));
+        }
+    }
+
+    // first element of a strided vector, following the reference BLAS for
+    // negative increments
+    int first_index(int n, int inc) {
+        return inc < 0 ? (1 - n) * inc : 0;
+    }
+}
+
+namespace l_bfgs_b_blas {
+    bool is_supported(kernel_isa isa) {
+        switch (isa) {
+            case kernel_isa::portable:
+                return true;
+#ifdef LBFGSB_CPP_X86_KERNELS
+            case kernel_isa::avx2:
+                return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+            case kernel_isa::avx512:
+                return __builtin_cpu_supports("avx512f");
+#endif
+            default:
+                return false;
+        }
+    }
+
+    kernel_isa detect_isa() {
+        if (is_supported(kernel_isa::avx512)) {
+            return kernel_isa::avx512;
+        }
+        if (is_supported(kernel_isa::avx2)) {
+            return kernel_isa::avx2;
+        }
+        return kernel_isa::portable;
+    }
+
+    kernel_isa get_isa() {
+        return current_isa();
+    }
+
+    void set_isa(kernel_isa isa) {
+        if (!is_supported(isa)) {
+            throw std::invalid_argument("The CPU does not support the requested BLAS kernels");
+        }
+        selectedIsa.store(static_cast<int>(isa), std::memory_order_relaxed);
+    }
+
+    double dot(kernel_isa isa, int n, const double *x, const double *y) {
+        switch (isa) {
+#ifdef LBFGSB_CPP_X86_KERNELS
+            case kernel_isa::avx512:
+                return avx512_dot(n, x, y);
+            case kernel_isa::avx2:
+                return avx2_dot(n, x, y);
+#endif
+            default:
+                return portable_dot(n, x, y);
+        }
+    }
+
+    void axpy(kernel_isa isa, int n, double a, const double *x, double *y) {
+        switch (isa) {
+#ifdef LBFGSB_CPP_X86_KERNELS
+            case kernel_isa::avx512:
+                avx512_axpy(n, a, x, y);
+                break;
+            case kernel_isa::avx2:
+                avx2_axpy(n, a, x, y);
+                break;
+#endif
+            default:
+                portable_axpy(n, a, x, y);
+        }
+    }
+
+    void scal(kernel_isa isa, int n, double a, double *x) {
+        switch (isa) {
+#ifdef LBFGSB_CPP_X86_KERNELS
+            case kernel_isa::avx512:
+                avx512_scal(n, a, x);
+                break;
+            case kernel_isa::avx2:
+                avx2_scal(n, a, x);
+                break;
+#endif
+            default:
+                portable_scal(n, a, x);
+        }
+    }
+}
+
+// The early returns and the strided loops follow Lbfgsb.3.0/blas.f
+extern "C" {
+double ddot_(const int *n, const double *dx, const int *incx, const double *dy, const int *incy) {
+    if (*n <= 0) {
+        return 0;
+    }
+    if (*incx == 1 && *incy == 1) {
+        return chunked_dot(current_isa(), *n, dx, dy);
+    }
+    double result = 0;
+    int ix = first_index(*n, *incx);
+    int iy = first_index(*n, *incy);
+    for (int i = 0; i < *n; i++, ix += *incx, iy += *incy) {
+        result += dx[ix] * dy[iy];
+    }
+    return result;
+}
+
+void daxpy_(const int *n, const double *da, const double *dx, const int *incx, double *dy, const int *incy) {
+    if (*n <= 0 || *da == 0) {
+        return;
+    }
+    if (*incx == 1 && *incy == 1) {
+        chunked_axpy(current_isa(), *n, *da, dx, dy);
+        return;
+    }
+    int ix = first_index(*n, *incx);
+    int iy = first_index(*n, *incy);
+    for (int i = 0; i < *n; i++, ix += *incx, iy += *incy) {
+        dy[iy] += *da * dx[ix];
+    }
+}
+
+void dcopy_(const int *n, const double *dx, const int *incx, double *dy, const int *incy) {
+    if (*n <= 0) {
+        return;
+    }
+    if (*incx == 1 && *incy == 1) {
+        chunked_copy(*n, dx, dy);
+        return;
+    }
+    int ix = first_index(*n, *incx);
+    int iy = first_index(*n, *incy);
+    for (int i = 0; i < *n; i++, ix += *incx, iy += *incy) {
+        dy[iy] = dx[ix];
+    }
+}
+
+void dscal_(const int *n, const double *da, double *dx, const int *incx) {
+    if (*n <= 0 || *incx <= 0) {
+        return;
+    }
+    if (*incx == 1) {
+        chunked_scal(current_isa(), *n, *da, dx);
+        return;
+    }
+    for (int i = 0; i < *n * *incx; i += *incx) {
+        dx[i] *= *da;
+    }
+}
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef LBFGSB_CPP_BLAS_KERNELS_H
+#define LBFGSB_CPP_BLAS_KERNELS_H
+
+// Level-1 BLAS routines called by the Fortran engine (ddot, daxpy, dcopy and
+// dscal), implemented with SIMD kernels selected once at run time from the
+// instruction sets supported by the CPU. They replace Lbfgsb.3.0/blas.f when the
+// library is configured with LBFGSB_BLAS=vectorized (the default).
+
+enum class kernel_isa : int {
+    // plain C++, compiled for the baseline architecture
+    portable = 0,
+    // 256-bit kernels (AVX2 and FMA)
+    avx2 = 1,
+    // 512-bit kernels (AVX-512F)
+    avx512 = 2
+};
+
+namespace l_bfgs_b_blas {
+    bool is_supported(kernel_isa isa);
+
+    // the widest instruction set supported by the CPU
+    kernel_isa detect_isa();
+
+    // the kernels currently called by the Fortran engine
+    kernel_isa get_isa();
+
+    // selects the kernels called by the Fortran engine, e.g., to compare them in
+    // benchmarks. Not meant to be changed while a solve is running.
+    void set_isa(kernel_isa isa);
+
+    // contiguous kernels of a given instruction set
+    double dot(kernel_isa isa, int n, const double *x, const double *y);
+
+    // y = y + a * x
+    void axpy(kernel_isa isa, int n, double a, const double *x, double *y);
+
+    // x = a * x
+    void scal(kernel_isa isa, int n, double a, double *x);
+}
+
+// Fortran interface (gfortran calling convention, all arguments by reference)
+extern "C" {
+double ddot_(const int *n, const double *dx, const int *incx, const double *dy, const int *incy);
+void daxpy_(const int *n, const double *da, const double *dx, const int *incx, double *dy, const int *incy);
+void dcopy_(const int *n, const double *dx, const int *incx, double *dy, const int *incy);
+void dscal_(const int *n, const double *da, double *dx, const int *incx);
+}
+
+#endif //LBFGSB_CPP_BLAS_KERNELS_H
@@ -0,0 +1,162 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "test_functions.h"
+#include "test_utils.h"
+#include "problem_fixture.h"
+#include <lbfgsb_cpp/autodiff.h>
+#include <lbfgsb_cpp/l_bfgs_b.h>
+#include <vector>
+#include <armadillo>
+#include <Eigen/Dense>
+#include <array>
+
+template<class T>
+class autodiff_test : public problem_fixture<T> {
+protected:
+    autodiff_test() = default;
+
+    ~autodiff_test() = default;
+
+    // compare the automatic gradient of functor with the analytical gradient of
+    // the problem set up in the fixture at several random points
+    template<class F>
+    void test_gradient(const F &functor) {
+        autodiff_problem<T, F> adPb(this->mPb->get_input_dimension(), functor);
+        T x, gr, adGr;
+        for (int i = 0; i < mNoTests; i++) {
+            this->random_gradient(x, gr);
+            adGr = gr;
+            double f = adPb.value_and_gradient(x, adGr);
+            EXPECT_NEAR(f, (*(this->mPb))(x), 1e-9 * std::max(1.0, std::abs(f)));
+            EXPECT_RELATIVE_NEAR_VECTORS(gr, adGr, 1e-9);
+        }
+    }
+
+    int mNoTests = 20;
+};
+
+
+using testing::Types;
+typedef Types<std::vector<double>, arma::vec, arma::colvec, Eigen::RowVectorXd,
+        Eigen::VectorXd, std::array<double, 2> > Implementations;
+TYPED_TEST_CASE(autodiff_test, Implementations);
+
+TYPED_TEST(autodiff_test, rosenbrock) {
+    this->set_up(std::shared_ptr<problem<TypeParam> >(new rosenbrock_function<TypeParam>(2)));
+    this->test_gradient(rosenbrock_objective());
+}
+
+TYPED_TEST(autodiff_test, beale) {
+    this->set_up(std::shared_ptr<problem<TypeParam> >(new beale_function<TypeParam>()));
+    this->test_gradient(beale_objective());
+}
+
+TYPED_TEST(autodiff_test, booth) {
+    this->set_up(std::shared_ptr<problem<TypeParam> >(new booth_function<TypeParam>()));
+    this->test_gradient(booth_objective());
+}
+
+TYPED_TEST(autodiff_test, matyas) {
+    this->set_up(std::shared_ptr<problem<TypeParam> >(new matyas_function<TypeParam>()));
+    this->test_gradient(matyas_objective());
+}
+
+TYPED_TEST(autodiff_test, goldstein) {
+    std::shared_ptr<problem<TypeParam> > ptr(new goldstein_price_function<TypeParam>());
+    ptr->set_lower_bound({-2, -2});
+    ptr->set_upper_bound({2, 2});
+    this->set_up(ptr);
+    this->test_gradient(goldstein_price_objective());
+}
+
+TYPED_TEST(autodiff_test, optimization) {
+    TypeParam lb, ub, x, sol;
+    l_bfgs_b_utils::fill_container(lb, {-10, -10});
+    l_bfgs_b_utils::fill_container(ub, {10, 10});
+    l_bfgs_b_utils::fill_container(sol, {1, 1});
+    std::shared_ptr<problem<TypeParam> > ptr(
+            new autodiff_problem<TypeParam, rosenbrock_objective>(2, lb, ub));
+    this->set_up(ptr);
+    l_bfgs_b<TypeParam> solver;
+    solver.set_machine_precision_factor(10);
+    solver.set_projected_gradient_tolerance(0);
+    for (int i = 0; i < this->mNoTests; i++) {
+        this->random_point(x);
+        solver.optimize(*ptr, x);
+        EXPECT_NEAR_VECTORS(sol, x, 1e-4);
+    }
+}
+
+TEST(ad_tape_test, large_rosenbrock) {
+    int n = 1000;
+    rosenbrock_function<std::vector<double> > pb(n);
+    autodiff_problem<std::vector<double>, rosenbrock_objective> adPb(n);
+    std::vector<double> x(n), gr(n), adGr(n);
+    for (int i = 0; i < n; i++) {
+        x[i] = std::cos(0.1 * i);
+    }
+    pb.gradient(x, gr);
+    adPb.gradient(x, adGr);
+    EXPECT_RELATIVE_NEAR_VECTORS(gr, adGr, 1e-9);
+}
+
+TEST(ad_tape_test, tape_is_reused) {
+    int n = 50;
+    autodiff_problem<std::vector<double>, rosenbrock_objective> adPb(n);
+    std::vector<double> x(n, 0.5), gr(n);
+    adPb.gradient(x, gr);
+    std::size_t tapeSize = adPb.get_tape_size();
+    EXPECT_GT(tapeSize, static_cast<std::size_t>(n));
+    for (int i = 0; i < 3; i++) {
+        x[i] += 0.1;
+        adPb.gradient(x, gr);
+        EXPECT_EQ(tapeSize, adPb.get_tape_size());
+    }
+}
+
+TEST(ad_tape_test, elementary_functions) {
+    ad_tape tape;
+    ad_tape::scope scope(tape);
+    double value = 0.7;
+    ad_var x = tape.variable(value);
+    ad_var y = exp(x) + log(x) + sqrt(x) + sin(x) * cos(x) + tanh(x) + abs(-x) +
+               pow(x, 3.0) + pow(2.0, x) + pow(x, x) / (1.0 + x);
+    tape.backward(y);
+    double expected = std::exp(value) + 1 / value + 0.5 / std::sqrt(value) +
+                      std::cos(2 * value) + 1 - std::pow(std::tanh(value), 2) + 1 +
+                      3 * value * value + std::pow(2.0, value) * std::log(2.0) +
+                      (std::pow(value, value) * (std::log(value) + 1) * (1 + value) - std::pow(value, value)) /
+                      std::pow(1 + value, 2);
+    EXPECT_NEAR(expected, tape.adjoint(x), 1e-12);
+}
+
+TEST(ad_tape_test, constants_are_not_recorded) {
+    ad_tape tape;
+    ad_tape::scope scope(tape);
+    ad_var x = tape.variable(2.0);
+    ad_var c = ad_var(3.0) * 4.0 + 1.0;
+    EXPECT_TRUE(c.is_constant());
+    EXPECT_EQ(1u, tape.size());
+    ad_var y = x;
+    y *= c;
+    y -= x;
+    tape.backward(y);
+    EXPECT_DOUBLE_EQ(12, tape.adjoint(x));
+    EXPECT_DOUBLE_EQ(0, tape.adjoint(c));
+}
+
+TEST(ad_tape_test, no_active_tape) {
+    ad_tape tape;
+    ad_var x;
+    {
+        ad_tape::scope scope(tape);
+        x = tape.variable(1.0);
+    }
+    EXPECT_THROW(x * x, std::logic_error);
+}
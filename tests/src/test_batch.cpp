@@ -0,0 +1,253 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "test_functions.h"
+#include "test_utils.h"
+#include "random_vector_generator.h"
+#include <lbfgsb_cpp/l_bfgs_b.h>
+#include <lbfgsb_cpp/parallel.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <armadillo>
+#include <Eigen/Dense>
+
+template<class T>
+class batch_test : public testing::Test {
+protected:
+    typedef std::pair<std::shared_ptr<problem<T> >, T> batch_entry;
+
+    batch_test() = default;
+
+    ~batch_test() = default;
+
+    // mix of bounded and unbounded problems of different dimensions
+    std::vector<batch_entry> make_batch(int noProblems) {
+        std::vector<batch_entry> batch;
+        for (int i = 0; i < noProblems; i++) {
+            int n = 2 + i % 7;
+            std::shared_ptr<problem<T> > pb;
+            switch (i % 3) {
+                case 0:
+                    pb.reset(new rosenbrock_function<T>(n));
+                    break;
+                case 1:
+                    pb.reset(new rosenbrock_function_base<T>(n));
+                    break;
+                default:
+                    pb.reset(new rosenbrock_function<T>(n));
+                    T lb(n), ub(n);
+                    for (int j = 0; j < n; j++) {
+                        lb[j] = -2;
+                        ub[j] = 0.5 + 0.1 * j;
+                    }
+                    pb->set_lower_bound(lb);
+                    pb->set_upper_bound(ub);
+            }
+            random_vector_generator<T> rvg(n, -1.5, 0.5, i);
+            batch.push_back(batch_entry(pb, rvg()));
+        }
+        return batch;
+    }
+};
+
+using testing::Types;
+typedef Types<std::vector<double>, arma::vec, Eigen::VectorXd> Implementations;
+TYPED_TEST_CASE(batch_test, Implementations);
+
+TYPED_TEST(batch_test, parallel_for_runs_every_task_once) {
+    for (int noThreads : {1, 2, 3, 8}) {
+        int noTasks = 1000;
+        std::vector<std::atomic<int> > counts(noTasks);
+        for (auto &count : counts) {
+            count = 0;
+        }
+        l_bfgs_b_utils::parallel_for(noTasks, noThreads, [&](int, int i) {
+            counts[i]++;
+        });
+        for (auto &count : counts) {
+            EXPECT_EQ(1, count.load());
+        }
+    }
+}
+
+TYPED_TEST(batch_test, parallel_for_rethrows) {
+    EXPECT_THROW(l_bfgs_b_utils::parallel_for(100, 4, [](int, int i) {
+        if (i == 57) {
+            throw std::runtime_error("task failed");
+        }
+    }), std::runtime_error);
+}
+
+TYPED_TEST(batch_test, matches_sequential_solves) {
+    int noProblems = 300;
+    l_bfgs_b<TypeParam> solver;
+    auto sequentialBatch = this->make_batch(noProblems);
+    std::vector<l_bfgs_b_result> sequentialResults;
+    for (auto &entry : sequentialBatch) {
+        sequentialResults.push_back(solver.optimize(*entry.first, entry.second));
+    }
+
+    for (int noThreads : {1, 2, 8}) {
+        auto batch = this->make_batch(noProblems);
+        auto results = solver.optimize_batch(batch.begin(), batch.end(), noThreads);
+        ASSERT_EQ(noProblems, results.size());
+        for (int i = 0; i < noProblems; i++) {
+            // the Fortran routine must be reentrant: results should be identical
+            EXPECT_EQ_VECTORS(sequentialBatch[i].second, batch[i].second);
+            EXPECT_EQ(sequentialResults[i].f, results[i].f);
+            EXPECT_EQ(sequentialResults[i].iterations, results[i].iterations);
+            EXPECT_EQ(sequentialResults[i].evaluations, results[i].evaluations);
+        }
+    }
+}
+
+TYPED_TEST(batch_test, stress_concurrent_solves) {
+    int noProblems = 2000;
+    l_bfgs_b<TypeParam> solver;
+    auto expected = this->make_batch(noProblems);
+    l_bfgs_b_workspace<TypeParam> workspace;
+    for (auto &entry : expected) {
+        solver.optimize(*entry.first, entry.second, workspace);
+    }
+    // use more threads than cores to force preemption in the middle of the solves
+    for (int repetition = 0; repetition < 3; repetition++) {
+        auto batch = this->make_batch(noProblems);
+        solver.optimize_batch(batch.begin(), batch.end(), 16);
+        for (int i = 0; i < noProblems; i++) {
+            EXPECT_EQ_VECTORS(expected[i].second, batch[i].second);
+        }
+    }
+}
+
+TYPED_TEST(batch_test, raw_pointers) {
+    booth_function<TypeParam> booth;
+    matyas_function<TypeParam> matyas;
+    TypeParam x0(2), x1(2);
+    x0[0] = x1[0] = 3;
+    x0[1] = x1[1] = -4;
+    std::vector<std::pair<problem<TypeParam> *, TypeParam> > batch = {
+            std::make_pair(&booth, x0), std::make_pair(&matyas, x1)};
+    l_bfgs_b<TypeParam> solver;
+    solver.optimize_batch(batch.begin(), batch.end());
+    EXPECT_NEAR(1, batch[0].second[0], 1e-4);
+    EXPECT_NEAR(3, batch[0].second[1], 1e-4);
+    EXPECT_NEAR(0, batch[1].second[0], 1e-4);
+    EXPECT_NEAR(0, batch[1].second[1], 1e-4);
+}
+
+TYPED_TEST(batch_test, cancellation) {
+    int noProblems = 2000;
+    l_bfgs_b<TypeParam> solver;
+    cancellation_token token;
+    solver.set_cancellation_token(token);
+    token.cancel();
+    auto batch = this->make_batch(noProblems);
+    auto initialBatch = this->make_batch(noProblems);
+    auto results = solver.optimize_batch(batch.begin(), batch.end(), 4);
+    for (int i = 0; i < noProblems; i++) {
+        EXPECT_EQ(l_bfgs_b_status::cancelled, results[i].status);
+        EXPECT_EQ_VECTORS(initialBatch[i].second, batch[i].second);
+    }
+
+    // cancelled while the batch is being solved
+    token.reset();
+    std::thread canceller([&token]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        token.cancel();
+    });
+    // the solves running or pending when the token is cancelled stop early
+    int noCancelled = 0;
+    for (int repetition = 0; repetition < 100 && noCancelled == 0; repetition++) {
+        batch = this->make_batch(noProblems);
+        results = solver.optimize_batch(batch.begin(), batch.end(), 4);
+        for (int i = 0; i < noProblems; i++) {
+            const l_bfgs_b_result &result = results[i];
+            EXPECT_TRUE(result.status == l_bfgs_b_status::converged ||
+                        result.status == l_bfgs_b_status::cancelled);
+            if (result.status == l_bfgs_b_status::cancelled) {
+                noCancelled++;
+                if (result.evaluations > 0) {
+                    EXPECT_LE(result.f, (*initialBatch[i].first)(initialBatch[i].second));
+                }
+            }
+        }
+    }
+    canceller.join();
+    EXPECT_GT(noCancelled, 0);
+}
+
+TYPED_TEST(batch_test, warm_start_is_ignored) {
+    int noProblems = 300;
+    l_bfgs_b<TypeParam> solver;
+    auto expected = this->make_batch(noProblems);
+    auto expectedResults = solver.optimize_batch(expected.begin(), expected.end(), 1);
+
+    // the workspaces of the workers hold the corrections of unrelated problems
+    solver.set_warm_start(true);
+    for (int noThreads : {1, 4}) {
+        auto batch = this->make_batch(noProblems);
+        auto results = solver.optimize_batch(batch.begin(), batch.end(), noThreads);
+        for (int i = 0; i < noProblems; i++) {
+            EXPECT_EQ_VECTORS(expected[i].second, batch[i].second);
+            EXPECT_EQ(expectedResults[i].evaluations, results[i].evaluations);
+        }
+    }
+}
+
+TYPED_TEST(batch_test, checkpoints_are_rejected) {
+    l_bfgs_b<TypeParam> solver;
+    solver.set_checkpoint("batch_test.ckpt", 1);
+    auto batch = this->make_batch(10);
+    auto initialBatch = this->make_batch(10);
+    EXPECT_THROW(solver.optimize_batch(batch.begin(), batch.end(), 4), std::invalid_argument);
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ_VECTORS(initialBatch[i].second, batch[i].second);
+    }
+    std::ifstream file("batch_test.ckpt");
+    EXPECT_FALSE(file.good());
+}
+
+TYPED_TEST(batch_test, traces_are_rejected) {
+    l_bfgs_b<TypeParam> solver;
+    l_bfgs_b_trace trace(100);
+    solver.set_trace(&trace);
+    auto batch = this->make_batch(10);
+    auto initialBatch = this->make_batch(10);
+    EXPECT_THROW(solver.optimize_batch(batch.begin(), batch.end(), 4), std::invalid_argument);
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ_VECTORS(initialBatch[i].second, batch[i].second);
+    }
+    EXPECT_EQ(0, trace.size());
+}
+
+TYPED_TEST(batch_test, shared_problems_are_rejected) {
+    l_bfgs_b<TypeParam> solver;
+    auto batch = this->make_batch(10);
+    batch[7].first = batch[2].first;
+    auto initialBatch = this->make_batch(10);
+    EXPECT_THROW(solver.optimize_batch(batch.begin(), batch.end(), 4), std::invalid_argument);
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ_VECTORS(initialBatch[i].second, batch[i].second);
+    }
+}
+
+TYPED_TEST(batch_test, verbose_output_is_rejected) {
+    l_bfgs_b<TypeParam> solver;
+    auto batch = this->make_batch(10);
+    for (int verboseLevel : {0, 1, 99}) {
+        solver.set_verbose_level(verboseLevel);
+        EXPECT_THROW(solver.optimize_batch(batch.begin(), batch.end(), 4), std::invalid_argument);
+    }
+    solver.set_verbose_level(-1);
+    EXPECT_NO_THROW(solver.optimize_batch(batch.begin(), batch.end(), 4));
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "test_functions.h"
+#include "test_utils.h"
+#include "blas_kernels.h"
+#include <lbfgsb_cpp/l_bfgs_b.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+extern "C" {
+void wtprd_(int *n, int *m, double *ws, double *wy, int *ncol, int *head, double *v, double *py, int *incpy,
+            double *ps, int *incps);
+void wtzprd_(int *n, int *m, double *ws, double *wy, int *ncol, int *head, int *nsub, int *ind, double *v,
+             double *py, double *ps);
+}
+
+class blas_kernels_test : public testing::Test {
+protected:
+    blas_kernels_test() : mIsa(l_bfgs_b_blas::get_isa()) {
+        for (int isa = 0; isa <= static_cast<int>(kernel_isa::avx512); isa++) {
+            if (l_bfgs_b_blas::is_supported(static_cast<kernel_isa>(isa))) {
+                mSupported.push_back(static_cast<kernel_isa>(isa));
+            }
+        }
+    }
+
+    ~blas_kernels_test() {
+        l_bfgs_b_blas::set_isa(mIsa);
+    }
+
+    std::vector<double> make_vector(int n, double seed) {
+        std::vector<double> x(n);
+        for (int i = 0; i < n; i++) {
+            x[i] = std::sin(seed + 0.7 * i);
+        }
+        return x;
+    }
+
+    kernel_isa mIsa;
+    std::vector<kernel_isa> mSupported;
+};
+
+TEST_F(blas_kernels_test, isa_selection) {
+    EXPECT_TRUE(l_bfgs_b_blas::is_supported(kernel_isa::portable));
+    EXPECT_TRUE(l_bfgs_b_blas::is_supported(l_bfgs_b_blas::detect_isa()));
+    for (kernel_isa isa : mSupported) {
+        l_bfgs_b_blas::set_isa(isa);
+        EXPECT_EQ(isa, l_bfgs_b_blas::get_isa());
+    }
+    for (int isa = 0; isa <= static_cast<int>(kernel_isa::avx512); isa++) {
+        if (!l_bfgs_b_blas::is_supported(static_cast<kernel_isa>(isa))) {
+            EXPECT_THROW(l_bfgs_b_blas::set_isa(static_cast<kernel_isa>(isa)), std::invalid_argument);
+        }
+    }
+}
+
+TEST_F(blas_kernels_test, contiguous_kernels) {
+    // all the lengths up to several unrolled blocks, to exercise every tail
+    for (kernel_isa isa : mSupported) {
+        for (int n = 0; n < 70; n++) {
+            std::vector<double> x = make_vector(n, 1), y = make_vector(n, 2);
+            double expectedDot = 0;
+            std::vector<double> expectedAxpy(y), expectedScal(x);
+            for (int i = 0; i < n; i++) {
+                expectedDot += x[i] * y[i];
+                expectedAxpy[i] += 0.3 * x[i];
+                expectedScal[i] *= -1.5;
+            }
+            EXPECT_NEAR(expectedDot, l_bfgs_b_blas::dot(isa, n, x.data(), y.data()), 1e-12);
+            l_bfgs_b_blas::axpy(isa, n, 0.3, x.data(), y.data());
+            EXPECT_NEAR_VECTORS(expectedAxpy, y, 1e-15);
+            l_bfgs_b_blas::scal(isa, n, -1.5, x.data());
+            EXPECT_EQ_VECTORS(expectedScal, x);
+        }
+    }
+}
+
+TEST_F(blas_kernels_test, strided_fortran_routines) {
+    int n = 5, incx = 2, incy = -3, one = 1;
+    double a = 2;
+    std::vector<double> x = make_vector(n * incx, 1), y = make_vector(-n * incy, 2);
+    // a negative increment walks the vector backwards from its last element
+    double expectedDot = 0;
+    for (int i = 0; i < n; i++) {
+        expectedDot += x[i * incx] * y[(n - 1 - i) * -incy];
+    }
+    EXPECT_NEAR(expectedDot, ddot_(&n, x.data(), &incx, y.data(), &incy), 1e-14);
+
+    std::vector<double> z(y);
+    daxpy_(&n, &a, x.data(), &incx, z.data(), &incy);
+    for (int i = 0; i < n; i++) {
+        EXPECT_DOUBLE_EQ(y[(n - 1 - i) * -incy] + a * x[i * incx], z[(n - 1 - i) * -incy]);
+    }
+
+    std::vector<double> w(n);
+    dcopy_(&n, x.data(), &incx, w.data(), &one);
+    dscal_(&n, &a, x.data(), &incx);
+    for (int i = 0; i < n; i++) {
+        EXPECT_EQ(a * w[i], x[i * incx]);
+    }
+
+    // a zero multiplier leaves y untouched, even if x holds NaNs
+    std::vector<double> nan(n, std::nan("")), v(w);
+    a = 0;
+    daxpy_(&n, &a, nan.data(), &one, v.data(), &one);
+    EXPECT_EQ_VECTORS(w, v);
+}
+
+TEST_F(blas_kernels_test, long_vectors_are_reduced_in_chunks) {
+    // the partial sums of chunks of 65536 elements are added in order, whatever
+    // the number of OpenMP threads and also beyond the chunks summed at a time
+    int one = 1, chunk = 65536;
+    for (int n : {3 * 65536 + 17, 70 * 65536 + 17}) {
+        std::vector<double> x = make_vector(n, 1), y = make_vector(n, 2);
+        kernel_isa isa = l_bfgs_b_blas::get_isa();
+        double expected = 0;
+        for (int begin = 0; begin < n; begin += chunk) {
+            expected += l_bfgs_b_blas::dot(isa, std::min(chunk, n - begin), &x[begin], &y[begin]);
+        }
+        EXPECT_EQ(expected, ddot_(&n, x.data(), &one, y.data(), &one));
+    }
+}
+
+TEST_F(blas_kernels_test, products_with_many_corrections) {
+    // more corrections than the partial products kept at a time, on two chunks
+    int n = 2 * 65536 + 17, m = 34, head = 5, one = 1;
+    std::vector<double> ws = make_vector(n * m, 1), wy = make_vector(n * m, 2), v = make_vector(n, 3);
+    std::vector<double> py(m), ps(m), zy(m), zs(m);
+    std::vector<int> ind(n);
+    for (int i = 0; i < n; i++) {
+        ind[i] = i + 1;
+    }
+    wtprd_(&n, &m, ws.data(), wy.data(), &m, &head, v.data(), py.data(), &one, ps.data(), &one);
+    wtzprd_(&n, &m, ws.data(), wy.data(), &m, &head, &n, ind.data(), v.data(), zy.data(), zs.data());
+    for (int j = 0; j < m; j++) {
+        int pointr = (head - 1 + j) % m;
+        double expectedY = 0, expectedS = 0;
+        for (int i = 0; i < n; i++) {
+            expectedY += wy[pointr * n + i] * v[i];
+            expectedS += ws[pointr * n + i] * v[i];
+        }
+        EXPECT_NEAR(expectedY, py[j], 1e-12 * n);
+        EXPECT_NEAR(expectedS, ps[j], 1e-12 * n);
+        EXPECT_NEAR(expectedY, zy[j], 1e-12 * n);
+        EXPECT_NEAR(expectedS, zs[j], 1e-12 * n);
+    }
+}
+
+TEST_F(blas_kernels_test, solutions_do_not_depend_on_the_kernels) {
+    int n = 40;
+    rosenbrock_function<std::vector<double> > pb(n);
+    std::vector<double> expected(n, 1.0);
+    for (kernel_isa isa : mSupported) {
+        l_bfgs_b_blas::set_isa(isa);
+        l_bfgs_b<std::vector<double> > solver;
+        std::vector<double> x(n, -1.2);
+        solver.optimize(pb, x);
+        EXPECT_NEAR_VECTORS(expected, x, 1e-3);
+    }
+}
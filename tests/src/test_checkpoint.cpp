@@ -0,0 +1,143 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "test_functions.h"
+#include "test_utils.h"
+#include <lbfgsb_cpp/l_bfgs_b.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <armadillo>
+#include <Eigen/Dense>
+
+template<class T>
+class checkpoint_test : public testing::Test {
+protected:
+    checkpoint_test() = default;
+
+    ~checkpoint_test() {
+        std::remove(mFile.c_str());
+    }
+
+    std::string mFile = "checkpoint_test.bin";
+};
+
+using testing::Types;
+typedef Types<std::vector<double>, arma::vec, Eigen::VectorXd> Implementations;
+TYPED_TEST_CASE(checkpoint_test, Implementations);
+
+TYPED_TEST(checkpoint_test, resume_is_exact) {
+    int n = 6;
+    rosenbrock_function<TypeParam> pb(n);
+    pb.set_lower_bound(make_point<TypeParam>(n, -2));
+    l_bfgs_b<TypeParam> solver;
+    TypeParam x = make_point<TypeParam>(n, -1);
+    l_bfgs_b_result uninterrupted = solver.optimize(pb, x);
+    ASSERT_GT(uninterrupted.iterations, 12);
+
+    // a solve killed after 12 iterations leaves the checkpoint of iteration 10
+    l_bfgs_b<TypeParam> interruptedSolver;
+    interruptedSolver.set_checkpoint(this->mFile, 5);
+    interruptedSolver.set_max_iterations(12);
+    TypeParam y = make_point<TypeParam>(n, -1);
+    interruptedSolver.optimize(pb, y);
+
+    l_bfgs_b<TypeParam> resumedSolver;
+    resumedSolver.set_checkpoint(this->mFile, 5);
+    TypeParam z = make_point<TypeParam>(n, 0);
+    l_bfgs_b_result resumed = resumedSolver.resume(pb, z);
+    EXPECT_EQ_VECTORS(x, z);
+    EXPECT_EQ(uninterrupted.f, resumed.f);
+    EXPECT_EQ(uninterrupted.iterations, resumed.iterations);
+    EXPECT_EQ(uninterrupted.evaluations, resumed.evaluations);
+    EXPECT_EQ(uninterrupted.task, resumed.task);
+}
+
+TYPED_TEST(checkpoint_test, invalid_checkpoints) {
+    int n = 4;
+    rosenbrock_function<TypeParam> pb(n), otherPb(n + 2);
+    l_bfgs_b<TypeParam> solver;
+    TypeParam x = make_point<TypeParam>(n, -1);
+    EXPECT_THROW(solver.resume(pb, x), std::invalid_argument);
+    EXPECT_THROW(solver.set_checkpoint(this->mFile, 0), std::invalid_argument);
+
+    solver.set_checkpoint(this->mFile, 1);
+    std::remove(this->mFile.c_str());
+    EXPECT_THROW(solver.resume(pb, x), std::runtime_error);
+
+    solver.optimize(pb, x);
+    TypeParam y = make_point<TypeParam>(n + 2, -1);
+    EXPECT_THROW(solver.resume(otherPb, y), std::invalid_argument);
+    EXPECT_THROW(solver.resume(pb, y), std::invalid_argument);
+
+    {
+        std::ofstream file(this->mFile.c_str(), std::ios::binary | std::ios::trunc);
+        file << "not a checkpoint at all, just some text";
+    }
+    EXPECT_THROW(solver.resume(pb, x), std::runtime_error);
+}
+
+TYPED_TEST(checkpoint_test, resume_with_other_options) {
+    int n = 6;
+    rosenbrock_function<TypeParam> pb(n);
+    l_bfgs_b<TypeParam> interruptedSolver;
+    interruptedSolver.set_checkpoint(this->mFile, 5);
+    interruptedSolver.set_max_iterations(12);
+    TypeParam x = make_point<TypeParam>(n, -1);
+    interruptedSolver.optimize(pb, x);
+
+    // the engine options are part of the saved state
+    l_bfgs_b<TypeParam> backtrackingSolver = interruptedSolver;
+    backtrackingSolver.set_line_search_policy(line_search_policy::backtracking);
+    EXPECT_THROW(backtrackingSolver.resume(pb, x), std::invalid_argument);
+    l_bfgs_b<TypeParam> selectionSolver = interruptedSolver;
+    selectionSolver.set_breakpoint_ordering(breakpoint_ordering::selection);
+    EXPECT_THROW(selectionSolver.resume(pb, x), std::invalid_argument);
+    l_bfgs_b<TypeParam> curvatureSolver = interruptedSolver;
+    curvatureSolver.set_curvature_tolerance(0.5);
+    EXPECT_THROW(curvatureSolver.resume(pb, x), std::invalid_argument);
+    l_bfgs_b<TypeParam> maxStepSolver = interruptedSolver;
+    maxStepSolver.set_max_step(10);
+    EXPECT_THROW(maxStepSolver.resume(pb, x), std::invalid_argument);
+
+    l_bfgs_b<TypeParam> resumedSolver;
+    resumedSolver.set_checkpoint(this->mFile, 5);
+    EXPECT_NO_THROW(resumedSolver.resume(pb, x));
+}
+
+TYPED_TEST(checkpoint_test, resume_scaled_solve) {
+    int n = 6;
+    rosenbrock_function<TypeParam> pb(n);
+    l_bfgs_b<TypeParam> solver;
+    solver.set_variable_scaling(variable_scaling::automatic);
+    TypeParam x = make_point<TypeParam>(n, -1);
+    l_bfgs_b_result uninterrupted = solver.optimize(pb, x);
+    ASSERT_GT(uninterrupted.iterations, 12);
+
+    l_bfgs_b<TypeParam> interruptedSolver;
+    interruptedSolver.set_variable_scaling(variable_scaling::automatic);
+    interruptedSolver.set_checkpoint(this->mFile, 5);
+    interruptedSolver.set_max_iterations(12);
+    TypeParam y = make_point<TypeParam>(n, -1);
+    interruptedSolver.optimize(pb, y);
+
+    // the checkpoint keeps the scales estimated at the initial point
+    l_bfgs_b<TypeParam> unscaledSolver;
+    unscaledSolver.set_checkpoint(this->mFile, 5);
+    TypeParam z = make_point<TypeParam>(n, 0);
+    EXPECT_THROW(unscaledSolver.resume(pb, z), std::invalid_argument);
+    l_bfgs_b<TypeParam> resumedSolver;
+    resumedSolver.set_variable_scaling(variable_scaling::automatic);
+    resumedSolver.set_checkpoint(this->mFile, 5);
+    l_bfgs_b_result resumed = resumedSolver.resume(pb, z);
+    EXPECT_EQ_VECTORS(x, z);
+    EXPECT_EQ(uninterrupted.f, resumed.f);
+    EXPECT_EQ(uninterrupted.iterations, resumed.iterations);
+    EXPECT_EQ(uninterrupted.evaluations, resumed.evaluations);
+}
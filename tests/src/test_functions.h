@@ -10,6 +10,9 @@
 
 #include <lbfgsb_cpp/problem.h>
 #include <algorithm>
+#include <complex>
+#include <numeric>
+#include <vector>
 
 
 // See https://en.wikipedia.org/wiki/Test_functions_for_optimization for a complete list of numerical optimization tests
@@ -28,6 +31,20 @@ public:
         return result;
     }
 
+    // the function is a chain of elements, each one depending on (x[i], x[i + 1])
+    void element_values(const T &x, std::vector<double> &values) {
+        for (int i = 0; i < (this->mInputDimension - 1); ++i) {
+            values[i] = (100 * std::pow(x[i + 1] - std::pow(x[i], 2), 2.0) + std::pow(1 - x[i], 2.0));
+        }
+    }
+
+    std::vector<std::vector<int> > element_variables() const {
+        std::vector<std::vector<int> > variables;
+        for (int i = 0; i < (this->mInputDimension - 1); ++i) {
+            variables.push_back({i, i + 1});
+        }
+        return variables;
+    }
 
 };
 
@@ -52,6 +69,133 @@ public:
         gr[this->mInputDimension - 1] =
                 (200 * (x[this->mInputDimension - 1] - std::pow(x[this->mInputDimension - 2], 2.0)));
     }
+
+    // each term of the sum contributes to the gradient of two coordinates: compute
+    // the value and the gradient in a single pass over the terms
+    double value_and_gradient(const T &x, T &gr) {
+        if (gr.size() != this->mInputDimension) {
+            throw std::invalid_argument("gradient size does not match input dimension");
+        }
+        double result = 0.0;
+        gr[0] = 0.0;
+        for (int i = 0; i < (this->mInputDimension - 1); ++i) {
+            double a = x[i + 1] - x[i] * x[i];
+            double b = 1 - x[i];
+            result += 100 * a * a + b * b;
+            gr[i] += -400 * x[i] * a - 2 * b;
+            gr[i + 1] = 200 * a;
+        }
+        return result;
+    }
+};
+
+// Rosenbrock function that counts the calls to each of its evaluation methods
+template<class T>
+class counted_rosenbrock_function : public rosenbrock_function<T> {
+public:
+    counted_rosenbrock_function(int inputDimension) : rosenbrock_function<T>(inputDimension) {}
+
+    ~counted_rosenbrock_function() = default;
+
+    double operator()(const T &x) {
+        mValueCalls++;
+        return rosenbrock_function<T>::operator()(x);
+    }
+
+    void gradient(const T &x, T &gr) {
+        mGradientCalls++;
+        rosenbrock_function<T>::gradient(x, gr);
+    }
+
+    double value_and_gradient(const T &x, T &gr) {
+        mFusedCalls++;
+        return rosenbrock_function<T>::value_and_gradient(x, gr);
+    }
+
+    int get_value_calls() const {
+        return mValueCalls;
+    }
+
+    int get_gradient_calls() const {
+        return mGradientCalls;
+    }
+
+    int get_fused_calls() const {
+        return mFusedCalls;
+    }
+
+protected:
+    int mValueCalls = 0;
+    int mGradientCalls = 0;
+    int mFusedCalls = 0;
+};
+
+// Rosenbrock function written once for any scalar type, as required by the
+// complex-step scheme
+template<class T>
+class generic_rosenbrock_function : public problem<T> {
+public:
+    generic_rosenbrock_function(int inputDimension) : problem<T>(inputDimension) {}
+
+    ~generic_rosenbrock_function() = default;
+
+    double operator()(const T &x) {
+        return evaluate<double>(x);
+    }
+
+    std::complex<double> complex_value(const std::vector<std::complex<double> > &x) {
+        return evaluate<std::complex<double> >(x);
+    }
+
+private:
+    template<class S, class V>
+    S evaluate(const V &x) {
+        S result = 0.0;
+        for (int i = 0; i < (this->mInputDimension - 1); ++i) {
+            S xi = x[i];
+            S a = S(x[i + 1]) - xi * xi;
+            S b = 1.0 - xi;
+            result += 100.0 * a * a + b * b;
+        }
+        return result;
+    }
+};
+
+// Rosenbrock function without analytical gradient that counts the evaluations
+// of the objective
+template<class T>
+class counted_rosenbrock_function_base : public rosenbrock_function_base<T> {
+public:
+    counted_rosenbrock_function_base(int inputDimension) : rosenbrock_function_base<T>(inputDimension) {}
+
+    ~counted_rosenbrock_function_base() = default;
+
+    double operator()(const T &x) {
+        mValueCalls++;
+        return rosenbrock_function_base<T>::operator()(x);
+    }
+
+    void element_values(const T &x, std::vector<double> &values) {
+        mElementCalls++;
+        rosenbrock_function_base<T>::element_values(x, values);
+    }
+
+    int get_value_calls() const {
+        return mValueCalls;
+    }
+
+    int get_element_calls() const {
+        return mElementCalls;
+    }
+
+    void reset_value_calls() {
+        mValueCalls = 0;
+        mElementCalls = 0;
+    }
+
+protected:
+    int mValueCalls = 0;
+    int mElementCalls = 0;
 };
 
 template<class T>
@@ -191,6 +335,61 @@ public:
     }
 };
 
+// Objectives written once for any scalar type (double or ad_var), to be used
+// with autodiff_problem. Mathematical functions are called unqualified so that
+// the ad_var overloads are found.
+struct rosenbrock_objective {
+    template<class S>
+    S operator()(const std::vector<S> &x) const {
+        S result = 0.0;
+        for (std::size_t i = 0; i + 1 < x.size(); ++i) {
+            S a = x[i + 1] - x[i] * x[i];
+            S b = 1.0 - x[i];
+            result += 100.0 * a * a + b * b;
+        }
+        return result;
+    }
+};
+
+struct beale_objective {
+    template<class S>
+    S operator()(const std::vector<S> &x) const {
+        using std::pow;
+        return pow(1.5 - x[0] + x[0] * x[1], 2.0) +
+               pow(2.25 - x[0] + x[0] * pow(x[1], 2.0), 2.0) +
+               pow(2.625 - x[0] + x[0] * pow(x[1], 3.0), 2.0);
+    }
+};
+
+struct goldstein_price_objective {
+    template<class S>
+    S operator()(const std::vector<S> &x) const {
+        using std::pow;
+        return (1.0 + pow(x[0] + x[1] + 1.0, 2.0) *
+                      (19.0 - 14.0 * x[0] + 3.0 * x[0] * x[0] - 14.0 * x[1] + 6.0 * x[0] * x[1] +
+                       3.0 * x[1] * x[1])) *
+               (30.0 + pow(2.0 * x[0] - 3.0 * x[1], 2.0) *
+                       (18.0 - 32.0 * x[0] + 12.0 * x[0] * x[0] + 48.0 * x[1] - 36.0 * x[0] * x[1] +
+                        27.0 * x[1] * x[1]));
+    }
+};
+
+struct booth_objective {
+    template<class S>
+    S operator()(const std::vector<S> &x) const {
+        S a = x[0] + 2.0 * x[1] - 7.0;
+        S b = 2.0 * x[0] + x[1] - 5.0;
+        return a * a + b * b;
+    }
+};
+
+struct matyas_objective {
+    template<class S>
+    S operator()(const std::vector<S> &x) const {
+        return 0.26 * (x[0] * x[0] + x[1] * x[1]) - 0.48 * x[0] * x[1];
+    }
+};
+
 template<class T>
 class simple_quadratic_problem_base : public problem<T> {
 public:
@@ -11,6 +11,11 @@
 #include "problem_fixture.h"
 #include <lbfgsb_cpp/l_bfgs_b.h>
 #include <lbfgsb_cpp/utils.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <limits>
+#include <thread>
 #include <vector>
 #include <armadillo>
 #include <Eigen/Dense>
@@ -137,3 +142,776 @@ TYPED_TEST(l_bfgs_b_num_gradient_test, goldstein_numerical_gradient) {
     this->test_optimization({0, -1});
 }
 
+
+// the solver should only use the fused evaluation, computing the value and the gradient
+// once per evaluation
+TYPED_TEST(l_bfgs_b_num_gradient_test, fused_evaluation) {
+    TypeParam x;
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    counted_rosenbrock_function<TypeParam> pb(2);
+    l_bfgs_b_result result = this->mSolver.optimize(pb, x);
+    EXPECT_EQ(0, pb.get_value_calls());
+    EXPECT_EQ(0, pb.get_gradient_calls());
+    EXPECT_EQ(result.evaluations, pb.get_fused_calls());
+    EXPECT_NEAR(1, x[0], 1e-4);
+    EXPECT_NEAR(1, x[1], 1e-4);
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, rosenbrock_forward_differences) {
+    int n = 2;
+    std::shared_ptr<problem<TypeParam> > ptr(new rosenbrock_function_base<TypeParam>(n));
+    ptr->set_lower_bound({-10, -10});
+    ptr->set_upper_bound({10, 10});
+    ptr->set_finite_difference_scheme(finite_difference_scheme::forward);
+    this->set_up(ptr);
+    this->test_optimization({1, 1});
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, rosenbrock_complex_step) {
+    int n = 2;
+    std::shared_ptr<problem<TypeParam> > ptr(new generic_rosenbrock_function<TypeParam>(n));
+    ptr->set_lower_bound({-10, -10});
+    ptr->set_upper_bound({10, 10});
+    ptr->set_finite_difference_scheme(finite_difference_scheme::complex_step);
+    this->set_up(ptr);
+    this->test_optimization({1, 1});
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, rosenbrock_grouped_differences) {
+    int n = 2;
+    std::shared_ptr<rosenbrock_function_base<TypeParam> > ptr(new rosenbrock_function_base<TypeParam>(n));
+    ptr->set_lower_bound({-10, -10});
+    ptr->set_upper_bound({10, 10});
+    ptr->set_coupling_structure(ptr->element_variables());
+    this->set_up(ptr);
+    this->test_optimization({1, 1});
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, static_dispatch) {
+    TypeParam x, y;
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    l_bfgs_b_utils::fill_container(y, {-1.2, 1});
+    rosenbrock_function<TypeParam> pb(2);
+    // the concrete type selects the statically dispatched overload
+    l_bfgs_b_result staticResult = this->mSolver.optimize(pb, x);
+    l_bfgs_b_result virtualResult = this->mSolver.optimize(static_cast<problem<TypeParam> &>(pb), y);
+    EXPECT_EQ_VECTORS(x, y);
+    EXPECT_EQ(virtualResult.evaluations, staticResult.evaluations);
+    EXPECT_EQ(virtualResult.f, staticResult.f);
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, static_dispatch_respects_overriders) {
+    TypeParam x;
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    counted_rosenbrock_function<TypeParam> pb(2);
+    // the dynamic type differs from the static one: the overriders must be called
+    rosenbrock_function<TypeParam> &base = pb;
+    l_bfgs_b_result result = this->mSolver.optimize(base, x);
+    EXPECT_EQ(result.evaluations, pb.get_fused_calls());
+
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    counted_rosenbrock_function_base<TypeParam> numericalPb(2);
+    result = this->mSolver.optimize(numericalPb, x);
+    // one evaluation for the value and four for the central differences
+    EXPECT_EQ(5 * result.evaluations, numericalPb.get_value_calls());
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, callables) {
+    TypeParam x, lb, ub;
+    l_bfgs_b_utils::fill_container(lb, {-10, -10});
+    l_bfgs_b_utils::fill_container(ub, {10, 10});
+    rosenbrock_function<TypeParam> pb(2);
+    auto value = [&pb](const TypeParam &z) { return pb(z); };
+    auto gradient = [&pb](const TypeParam &z, TypeParam &gr) { pb.gradient(z, gr); };
+
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    this->mSolver.optimize(value, gradient, lb, ub, x);
+    EXPECT_NEAR(1, x[0], 1e-4);
+    EXPECT_NEAR(1, x[1], 1e-4);
+
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    std::vector<double> lowerBound(2, 2), upperBound(2, 10);
+    this->mSolver.optimize([&pb](const TypeParam &z, TypeParam &gr) { return pb.value_and_gradient(z, gr); },
+                           lowerBound, upperBound, x);
+    EXPECT_NEAR(2, x[0], 1e-4);
+    EXPECT_NEAR(4, x[1], 1e-4);
+
+    // bounds without contiguous storage are copied
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    std::deque<double> lowerDeque(2, -10), upperDeque(2, 0.5);
+    this->mSolver.optimize(value, gradient, lowerDeque, upperDeque, x);
+    EXPECT_NEAR(0.5, x[0], 1e-4);
+    EXPECT_NEAR(0.25, x[1], 1e-4);
+
+    std::vector<double> wrongSize(3, 0);
+    EXPECT_THROW(this->mSolver.optimize(value, gradient, wrongSize, wrongSize, x), std::invalid_argument);
+    EXPECT_THROW(this->mSolver.optimize(value, gradient, ub, lb, x), std::invalid_argument);
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, coordinate_bounds) {
+    TypeParam x, y, lb, ub;
+    rosenbrock_function<TypeParam> pb(2), otherPb(2);
+    pb.set_lower_bound({-10, -10});
+    pb.set_upper_bound({10, 10});
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    this->mSolver.optimize(pb, x);
+    // re-bound a single coordinate between solves
+    pb.set_bounds(0, 2, 10);
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    this->mSolver.optimize(pb, x);
+    // same problem with its bounds set at once
+    l_bfgs_b_utils::fill_container(lb, {2, -10});
+    l_bfgs_b_utils::fill_container(ub, {10, 10});
+    otherPb.set_lower_bound(lb);
+    otherPb.set_upper_bound(ub);
+    l_bfgs_b_utils::fill_container(y, {-1.2, 1});
+    this->mSolver.optimize(otherPb, y);
+    EXPECT_EQ_VECTORS(y, x);
+    EXPECT_NEAR(2, x[0], 1e-4);
+    EXPECT_NEAR(4, x[1], 1e-4);
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, warm_start) {
+    TypeParam x, y, lb, ub;
+    l_bfgs_b_utils::fill_container(lb, {-10, -10});
+    l_bfgs_b_utils::fill_container(ub, {10, 10});
+    // Rosenbrock function with minimizer (a, a^2)
+    double a = 1;
+    auto objective = [&a](const TypeParam &z, TypeParam &gr) {
+        double t1 = z[1] - z[0] * z[0];
+        double t2 = a - z[0];
+        gr[0] = -400 * z[0] * t1 - 2 * t2;
+        gr[1] = 200 * t1;
+        return 100 * t1 * t1 + t2 * t2;
+    };
+    l_bfgs_b<TypeParam> coldSolver = this->mSolver;
+    this->mSolver.set_warm_start(true);
+    EXPECT_TRUE(this->mSolver.get_warm_start());
+
+    // without previous corrections, a warm start is a cold start
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    l_bfgs_b_utils::fill_container(y, {-1.2, 1});
+    l_bfgs_b_result warmResult = this->mSolver.optimize(objective, lb, ub, x);
+    l_bfgs_b_result coldResult = coldSolver.optimize(objective, lb, ub, y);
+    EXPECT_EQ_VECTORS(y, x);
+    EXPECT_EQ(coldResult.evaluations, warmResult.evaluations);
+    EXPECT_GT(this->mSolver.get_workspace().get_number_of_curvature_pairs(), 0);
+
+    for (int i = 1; i <= 5; i++) {
+        a = 1 + 0.1 * i;
+        this->mSolver.optimize(objective, lb, ub, x);
+        EXPECT_NEAR(a, x[0], 1e-4);
+        EXPECT_NEAR(a * a, x[1], 1e-4);
+    }
+}
+
+TEST(warm_start_test, homotopy_saves_evaluations) {
+    int n = 100;
+    int noSteps = 10;
+    double t = 0;
+    // extended Rosenbrock function with minimizer (1 + t, (1 + t)^2, ...)
+    auto objective = [n, &t](const std::vector<double> &x, std::vector<double> &gr) {
+        double result = 0;
+        for (int i = 0; i < n; i += 2) {
+            double t1 = x[i + 1] - x[i] * x[i];
+            double t2 = 1 + t - x[i];
+            result += 100 * t1 * t1 + t2 * t2;
+            gr[i] = -400 * x[i] * t1 - 2 * t2;
+            gr[i + 1] = 200 * t1;
+        }
+        return result;
+    };
+    std::vector<double> lb(n, -10), ub(n, 10);
+    int evaluations[2] = {0, 0};
+    for (int warmStart = 0; warmStart < 2; warmStart++) {
+        l_bfgs_b<std::vector<double> > solver(10, 1000, 1e7, 1e-6);
+        solver.set_warm_start(warmStart == 1);
+        std::vector<double> x(n, 0.5);
+        for (int step = 0; step <= noSteps; step++) {
+            t = static_cast<double>(step) / noSteps;
+            evaluations[warmStart] += solver.optimize(objective, lb, ub, x).evaluations;
+            EXPECT_NEAR(1 + t, x[0], 1e-3);
+            EXPECT_NEAR(1 + t, x[n - 2], 1e-3);
+        }
+    }
+    EXPECT_LT(evaluations[1], evaluations[0]);
+}
+
+TEST(warm_start_test, other_shapes_start_from_scratch) {
+    rosenbrock_function<std::vector<double> > pb(2);
+    rosenbrock_function<std::vector<double> > otherPb(4);
+    l_bfgs_b<std::vector<double> > solver, coldSolver;
+    solver.set_warm_start(true);
+    std::vector<double> x = {-1.2, 1};
+    solver.optimize(pb, x);
+    EXPECT_TRUE(solver.get_workspace().has_curvature_pairs(2, solver.get_memory_size()));
+    // the corrections of a problem of dimension 2 can not be reused for dimension 4
+    std::vector<double> y(4, 2), z(4, 2);
+    l_bfgs_b_result warmResult = solver.optimize(otherPb, y);
+    l_bfgs_b_result coldResult = coldSolver.optimize(otherPb, z);
+    EXPECT_EQ_VECTORS(z, y);
+    EXPECT_EQ(coldResult.evaluations, warmResult.evaluations);
+    EXPECT_FALSE(solver.get_workspace().has_curvature_pairs(2, solver.get_memory_size()));
+    EXPECT_TRUE(solver.get_workspace().has_curvature_pairs(4, solver.get_memory_size()));
+}
+
+TEST(warm_start_test, other_scales_start_from_scratch) {
+    rosenbrock_function<std::vector<double> > pb(2);
+    l_bfgs_b<std::vector<double> > solver, coldSolver;
+    solver.set_warm_start(true);
+    solver.set_variable_scales({1, 2});
+    std::vector<double> x = {-1.2, 1};
+    solver.optimize(pb, x);
+    EXPECT_TRUE(solver.get_workspace().has_curvature_pairs(2, solver.get_memory_size()));
+    // the corrections are expressed in the previous scaled coordinates
+    solver.set_variable_scales({2, 0.5});
+    coldSolver.set_variable_scales({2, 0.5});
+    std::vector<double> y = {-1.2, 1}, z = {-1.2, 1};
+    l_bfgs_b_result warmResult = solver.optimize(pb, y);
+    l_bfgs_b_result coldResult = coldSolver.optimize(pb, z);
+    EXPECT_EQ_VECTORS(z, y);
+    EXPECT_EQ(coldResult.evaluations, warmResult.evaluations);
+    // the same scales warm start from the new corrections
+    std::vector<double> w = {-1.2, 1};
+    l_bfgs_b_result reusedResult = solver.optimize(pb, w);
+    EXPECT_NE(coldResult.evaluations, reusedResult.evaluations);
+}
+
+TEST(warm_start_test, same_automatic_scales_warm_start) {
+    // separable objective whose variables have magnitudes 1, 100 and 0.01
+    std::vector<double> c = {1, 100, 0.01};
+    auto objective = [&c](const std::vector<double> &z, std::vector<double> &gr) {
+        double result = 0;
+        for (std::size_t i = 0; i < c.size(); i++) {
+            double t = z[i] / c[i] - 1;
+            result += t * t + t * t * t * t;
+            gr[i] = (2 * t + 4 * t * t * t) / c[i];
+        }
+        return result;
+    };
+    std::vector<double> lb(3, -1e3), ub(3, 1e3);
+    l_bfgs_b<std::vector<double> > solver, coldSolver;
+    solver.set_warm_start(true);
+    solver.set_variable_scaling(variable_scaling::automatic);
+    coldSolver.set_variable_scaling(variable_scaling::automatic);
+    std::vector<double> x = {3, 300, 0.03};
+    solver.optimize(objective, lb, ub, x);
+    std::vector<double> scales = solver.get_workspace().get_variable_scales();
+    // the scales estimated at a nearby point round to the same powers of two,
+    // so the corrections of the previous solve are reused
+    std::vector<double> y = {3.1, 310, 0.031}, z = {3.1, 310, 0.031};
+    l_bfgs_b_result warmResult = solver.optimize(objective, lb, ub, y);
+    l_bfgs_b_result coldResult = coldSolver.optimize(objective, lb, ub, z);
+    EXPECT_EQ_VECTORS(scales, solver.get_workspace().get_variable_scales());
+    EXPECT_EQ_VECTORS(scales, coldSolver.get_workspace().get_variable_scales());
+    EXPECT_NE(coldResult.evaluations, warmResult.evaluations);
+    EXPECT_NEAR_VECTORS(z, y, 1e-3);
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, stats) {
+    TypeParam x;
+    rosenbrock_function<TypeParam> pb(2);
+    pb.set_lower_bound({-10, 1.5});
+    pb.set_upper_bound({10, 10});
+    l_bfgs_b_utils::fill_container(x, {-1.2, 2});
+    l_bfgs_b_result result = this->mSolver.optimize(pb, x);
+    const l_bfgs_b_stats &stats = result.stats;
+    EXPECT_GT(stats.updates, 0);
+    EXPECT_LE(stats.updates + stats.skippedUpdates, result.iterations);
+    EXPECT_GT(stats.cauchyIntervals, 0);
+    EXPECT_EQ(2, stats.freeVariables + stats.activeVariables);
+    // the lower bound of the second coordinate is active at the solution
+    EXPECT_EQ(1, stats.activeVariables);
+    EXPECT_GE(stats.cauchyTime, 0);
+    EXPECT_GE(stats.subspaceTime, 0);
+    EXPECT_GE(stats.lineSearchTime, 0);
+    EXPECT_GE(stats.objectiveTime, 0);
+    EXPECT_LE(stats.objectiveTime, stats.totalTime);
+    EXPECT_GE(stats.solver_time(), 0);
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, tasks) {
+    TypeParam x;
+    rosenbrock_function<TypeParam> pb(2);
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    l_bfgs_b_result result = this->mSolver.optimize(pb, x);
+    EXPECT_TRUE(result.task == l_bfgs_b_task::convergence_projected_gradient ||
+                result.task == l_bfgs_b_task::convergence_relative_reduction);
+    EXPECT_FALSE(l_bfgs_b_utils::is_running(result.task));
+
+    // the iteration limit interrupts the solve at a new iterate
+    this->mSolver.set_max_iterations(3);
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    result = this->mSolver.optimize(pb, x);
+    EXPECT_EQ(l_bfgs_b_task::new_x, result.task);
+    EXPECT_EQ(3, result.iterations);
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, backtracking_line_search) {
+    this->mSolver.set_line_search_policy(line_search_policy::backtracking);
+    std::shared_ptr<problem<TypeParam> > ptr(new rosenbrock_function<TypeParam>(2));
+    ptr->set_lower_bound({-10, -10});
+    ptr->set_upper_bound({10, 10});
+    this->set_up(ptr);
+    this->test_optimization({1, 1});
+
+    ptr.reset(new booth_function<TypeParam>());
+    ptr->set_lower_bound({-10, -10});
+    ptr->set_upper_bound({10, 10});
+    this->set_up(ptr);
+    this->test_optimization({1, 3});
+
+    // without bounds and with a tighter sufficient decrease condition
+    this->mSolver.set_sufficient_decrease_tolerance(0.25);
+    ptr.reset(new matyas_function<TypeParam>());
+    this->set_up(ptr);
+    this->test_optimization({0, 0});
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, line_search_parameters) {
+    l_bfgs_b<TypeParam> solver;
+    EXPECT_EQ(line_search_policy::more_thuente, solver.get_line_search_policy());
+    EXPECT_THROW(solver.set_sufficient_decrease_tolerance(0), std::invalid_argument);
+    EXPECT_THROW(solver.set_curvature_tolerance(1), std::invalid_argument);
+    EXPECT_THROW(solver.set_step_tolerance(-0.1), std::invalid_argument);
+    EXPECT_THROW(solver.set_max_step(0), std::invalid_argument);
+
+    TypeParam x, y;
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    l_bfgs_b_utils::fill_container(y, {-1.2, 1});
+    rosenbrock_function<TypeParam> pb(2);
+    // the tolerances may be set in any order...
+    solver.set_sufficient_decrease_tolerance(0.92);
+    solver.set_curvature_tolerance(0.95);
+    // ...but More-Thuente requires a curvature condition weaker than the
+    // sufficient decrease one when the solve starts
+    solver.set_curvature_tolerance(0.9);
+    EXPECT_THROW(solver.optimize(pb, x), std::invalid_argument);
+    EXPECT_EQ(-1.2, x[0]);
+    // backtracking only uses the curvature tolerance heuristically
+    solver.set_line_search_policy(line_search_policy::backtracking);
+    EXPECT_NO_THROW(solver.optimize(pb, x));
+    solver.set_line_search_policy(line_search_policy::more_thuente);
+    solver.set_sufficient_decrease_tolerance(1e-3);
+
+    // the default values are those of the original routine
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    l_bfgs_b_result defaultResult = solver.optimize(pb, x);
+    solver.set_sufficient_decrease_tolerance(1e-3);
+    solver.set_curvature_tolerance(0.9);
+    solver.set_step_tolerance(0.1);
+    solver.set_max_step(1e10);
+    l_bfgs_b_result explicitResult = solver.optimize(pb, y);
+    EXPECT_EQ_VECTORS(x, y);
+    EXPECT_EQ(defaultResult.evaluations, explicitResult.evaluations);
+
+    // a more exact line search and a short maximum step still converge
+    solver.set_curvature_tolerance(0.1);
+    solver.set_max_step(0.5);
+    l_bfgs_b_utils::fill_container(y, {-1.2, 1});
+    l_bfgs_b_result exactResult = solver.optimize(pb, y);
+    EXPECT_NEAR_VECTORS(x, y, 1e-4);
+    EXPECT_NE(defaultResult.evaluations, exactResult.evaluations);
+
+    // the maximum step also limits the first step of problems with bounds
+    pb.set_lower_bound({-2, -2});
+    pb.set_upper_bound({2, 2});
+    l_bfgs_b_trace trace(10);
+    solver.set_trace(&trace);
+    solver.set_max_step(0.01);
+    solver.set_max_iterations(5);
+    l_bfgs_b_utils::fill_container(y, {-1.2, 1});
+    solver.optimize(pb, y);
+    ASSERT_EQ(5, trace.size());
+    for (int i = 0; i < trace.size(); i++) {
+        EXPECT_LE(trace[i].step, 0.01);
+    }
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, two_loop_recursion) {
+    std::vector<std::shared_ptr<problem<TypeParam> > > problems = {
+            std::make_shared<rosenbrock_function<TypeParam> >(2), std::make_shared<beale_function<TypeParam> >(),
+            std::make_shared<booth_function<TypeParam> >(), std::make_shared<matyas_function<TypeParam> >(),
+            std::make_shared<goldstein_price_function<TypeParam> >()};
+    std::vector<std::array<double, 2> > initialPoints = {{{-1.2, 1}}, {{1, 1}}, {{0, 0}}, {{1, -2}}, {{0.5, -0.5}}};
+    for (std::size_t i = 0; i < problems.size(); i++) {
+        SCOPED_TRACE(i);
+        TypeParam x, y;
+        l_bfgs_b_utils::fill_container(x, {initialPoints[i][0], initialPoints[i][1]});
+        l_bfgs_b_utils::fill_container(y, {initialPoints[i][0], initialPoints[i][1]});
+        // without bounds both paths compute the same directions up to rounding
+        l_bfgs_b<TypeParam> compactSolver, twoLoopSolver;
+        compactSolver.set_two_loop_recursion(false);
+        l_bfgs_b_trace trace(1000);
+        twoLoopSolver.set_trace(&trace);
+        l_bfgs_b_result compactResult = compactSolver.optimize(*problems[i], x);
+        l_bfgs_b_result twoLoopResult = twoLoopSolver.optimize(*problems[i], y);
+        EXPECT_NEAR_VECTORS(x, y, 1e-6);
+        EXPECT_NEAR(compactResult.evaluations, twoLoopResult.evaluations, 2);
+        EXPECT_NEAR(compactResult.iterations, twoLoopResult.iterations, 2);
+        // only the first iteration, without corrections, searches a Cauchy point
+        for (int j = 1; j < trace.size(); j++) {
+            EXPECT_EQ(0, trace[j].breakpoints);
+        }
+        twoLoopSolver.set_trace(nullptr);
+
+        // problems with bounds always use the compact representation
+        problems[i]->set_lower_bound({-10, -10});
+        problems[i]->set_upper_bound({10, 10});
+        l_bfgs_b_utils::fill_container(x, {initialPoints[i][0], initialPoints[i][1]});
+        l_bfgs_b_utils::fill_container(y, {initialPoints[i][0], initialPoints[i][1]});
+        compactResult = compactSolver.optimize(*problems[i], x);
+        twoLoopResult = twoLoopSolver.optimize(*problems[i], y);
+        EXPECT_EQ_VECTORS(x, y);
+        EXPECT_EQ(compactResult.evaluations, twoLoopResult.evaluations);
+    }
+}
+
+TEST(two_loop_recursion_test, large_problem) {
+    int n = 20;
+    rosenbrock_function<std::vector<double> > pb(n);
+    std::vector<double> x(n, -1.2), y(n, -1.2), solution(n, 1.0);
+    l_bfgs_b<std::vector<double> > compactSolver(10), twoLoopSolver(10);
+    compactSolver.set_two_loop_recursion(false);
+    l_bfgs_b_result compactResult = compactSolver.optimize(pb, x);
+    l_bfgs_b_result twoLoopResult = twoLoopSolver.optimize(pb, y);
+    EXPECT_NEAR_VECTORS(solution, x, 1e-3);
+    EXPECT_NEAR_VECTORS(solution, y, 1e-3);
+    EXPECT_LE(std::abs(compactResult.evaluations - twoLoopResult.evaluations), 0.1 * compactResult.evaluations);
+}
+
+// separable quadratic whose minimizer lies outside of the box for most
+// coordinates, so that each Cauchy search crosses thousands of breakpoints
+struct bound_heavy_quadratic {
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double result = 0;
+        for (std::size_t i = 0; i < x.size(); i++) {
+            double a = 1 + i % 7;
+            double c = -1 + 3 * ((i * 37) % 100) / 100.0;
+            result += 0.5 * a * (x[i] - c) * (x[i] - c);
+            gr[i] = a * (x[i] - c);
+        }
+        return result;
+    }
+};
+
+TEST(breakpoint_ordering_test, large_problem) {
+    int n = 20000;
+    bound_heavy_quadratic objective;
+    std::vector<double> lb(n, 0), ub(n, 1), x(n, 0.5), y(n, 0.5);
+    l_bfgs_b<std::vector<double> > heapSolver, selectionSolver;
+    EXPECT_EQ(breakpoint_ordering::heap, heapSolver.get_breakpoint_ordering());
+    selectionSolver.set_breakpoint_ordering(breakpoint_ordering::selection);
+    l_bfgs_b_result heapResult = heapSolver.optimize(objective, lb, ub, x);
+    l_bfgs_b_result selectionResult = selectionSolver.optimize(objective, lb, ub, y);
+    ASSERT_GT(heapResult.stats.cauchyIntervals, 2000);
+    for (int i = 0; i < n; i++) {
+        double c = -1 + 3 * ((i * 37) % 100) / 100.0;
+        ASSERT_NEAR(std::min(std::max(c, 0.0), 1.0), y[i], 1e-4);
+    }
+    EXPECT_NEAR_VECTORS(x, y, 1e-8);
+    EXPECT_NEAR(heapResult.f, selectionResult.f, 1e-8);
+    EXPECT_EQ(heapResult.iterations, selectionResult.iterations);
+    EXPECT_EQ(heapResult.stats.cauchyIntervals, selectionResult.stats.cauchyIntervals);
+
+    // with fewer breakpoints than a batch both orderings are the same
+    n = 500;
+    std::vector<double> smallLb(n, 0), smallUb(n, 1), z(n, 0.5), w(n, 0.5);
+    heapResult = heapSolver.optimize(objective, smallLb, smallUb, z);
+    selectionResult = selectionSolver.optimize(objective, smallLb, smallUb, w);
+    EXPECT_EQ_VECTORS(z, w);
+    EXPECT_EQ(heapResult.evaluations, selectionResult.evaluations);
+}
+
+// strongly coupled chain whose variables enter and leave the free set many
+// times before the active set settles: more than n variables change, so the
+// engine both updates and reforms the middle matrix of the subspace step
+struct churning_chain {
+    double operator()(const std::vector<double> &x, std::vector<double> &gr) const {
+        double result = 0;
+        std::size_t n = x.size();
+        for (std::size_t i = 0; i < n; i++) {
+            double c = 2 * std::sin(0.05 * i) + 0.5 * std::cos(0.37 * i);
+            result += 0.5 * (x[i] - c) * (x[i] - c);
+            gr[i] = x[i] - c;
+        }
+        for (std::size_t i = 0; i + 1 < n; i++) {
+            double t = x[i + 1] - x[i];
+            result += 5 * t * t;
+            gr[i] -= 10 * t;
+            gr[i + 1] += 10 * t;
+        }
+        return result;
+    }
+};
+
+TEST(active_set_test, solution_with_churning_free_set) {
+    int n = 300;
+    churning_chain objective;
+    std::vector<double> lb(n, -1), ub(n, 1), x(n), gr(n);
+    // start with the variables alternately at opposite bounds
+    for (int i = 0; i < n; i++) {
+        x[i] = i % 2 == 0 ? -1 : 1;
+    }
+    l_bfgs_b<std::vector<double> > solver(10);
+    solver.set_projected_gradient_tolerance(1e-8);
+    solver.set_machine_precision_factor(1);
+    solver.set_max_iterations(2000);
+    l_bfgs_b_result result = solver.optimize(objective, lb, ub, x);
+    EXPECT_FALSE(l_bfgs_b_utils::is_error(result.task));
+    ASSERT_GT(result.stats.activeVariables, n / 10);
+    // first-order optimality of the box-constrained problem
+    objective(x, gr);
+    for (int i = 0; i < n; i++) {
+        SCOPED_TRACE(i);
+        if (x[i] == lb[i]) {
+            EXPECT_GE(gr[i], -1e-6);
+        } else if (x[i] == ub[i]) {
+            EXPECT_LE(gr[i], 1e-6);
+        } else {
+            EXPECT_NEAR(0, gr[i], 1e-6);
+        }
+    }
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, variable_scaling) {
+    l_bfgs_b<TypeParam> solver;
+    EXPECT_EQ(variable_scaling::none, solver.get_variable_scaling());
+    EXPECT_THROW(solver.set_variable_scaling(variable_scaling::manual), std::invalid_argument);
+    EXPECT_THROW(solver.set_variable_scales({}), std::invalid_argument);
+    EXPECT_THROW(solver.set_variable_scales({1, 0}), std::invalid_argument);
+    TypeParam x;
+    l_bfgs_b_utils::fill_container(x, {-1.2, 1});
+    rosenbrock_function<TypeParam> pb(2);
+    solver.set_variable_scales({1, 2, 4});
+    EXPECT_THROW(solver.optimize(pb, x), std::invalid_argument);
+
+    // unit scales do not change the iterates
+    TypeParam y;
+    l_bfgs_b_utils::fill_container(y, {-1.2, 1});
+    l_bfgs_b<TypeParam> unscaledSolver;
+    l_bfgs_b_result unscaled = unscaledSolver.optimize(pb, y);
+    solver.set_variable_scales({1, 1});
+    l_bfgs_b_result scaled = solver.optimize(pb, x);
+    EXPECT_EQ_VECTORS(y, x);
+    EXPECT_EQ(unscaled.evaluations, scaled.evaluations);
+    EXPECT_TRUE(unscaledSolver.get_workspace().get_variable_scales().empty());
+
+    this->mSolver.set_variable_scales({0.5, 8});
+    std::shared_ptr<problem<TypeParam> > ptr(new rosenbrock_function<TypeParam>(2));
+    ptr->set_lower_bound({-10, -10});
+    ptr->set_upper_bound({10, 10});
+    this->set_up(ptr);
+    this->test_optimization({1, 1});
+
+    // with an active bound
+    this->mSolver.set_variable_scaling(variable_scaling::automatic);
+    ptr.reset(new booth_function<TypeParam>());
+    ptr->set_lower_bound({-10, 3.5});
+    ptr->set_upper_bound({10, 10});
+    this->set_up(ptr);
+    this->test_optimization({0.6, 3.5});
+    for (double scale : this->mSolver.get_workspace().get_variable_scales()) {
+        int exponent;
+        EXPECT_EQ(0.5, std::frexp(scale, &exponent));
+    }
+}
+
+// the chained Rosenbrock function of z / c, where the magnitudes c of the
+// parameters z span 1e-6 to 1e4
+TEST(variable_scaling_test, ill_scaled_rosenbrock) {
+    int n = 20;
+    std::vector<double> c(n), lb(n), ub(n), x0(n);
+    for (int i = 0; i < n; i++) {
+        c[i] = std::pow(10.0, -6 + 10.0 * ((7 * i) % n) / (n - 1));
+        lb[i] = -2 * c[i];
+        ub[i] = 2 * c[i];
+        x0[i] = (i % 2 == 0 ? -1.2 : 1) * c[i];
+    }
+    auto objective = [n, &c](const std::vector<double> &z, std::vector<double> &gr) {
+        double result = 0;
+        std::fill(gr.begin(), gr.end(), 0.0);
+        for (int i = 0; i + 1 < n; i++) {
+            double x = z[i] / c[i];
+            double t1 = z[i + 1] / c[i + 1] - x * x;
+            double t2 = 1 - x;
+            result += 100 * t1 * t1 + t2 * t2;
+            gr[i] += (-400 * x * t1 - 2 * t2) / c[i];
+            gr[i + 1] += 200 * t1 / c[i + 1];
+        }
+        return result;
+    };
+    l_bfgs_b<std::vector<double> > solver(5, 20000, 1e7, 1e-12);
+    std::vector<double> z = x0;
+    l_bfgs_b_result unscaled = solver.optimize(objective, lb, ub, z);
+
+    for (int automatic = 0; automatic < 2; automatic++) {
+        if (automatic) {
+            solver.set_variable_scaling(variable_scaling::automatic);
+        } else {
+            solver.set_variable_scales(c);
+        }
+        z = x0;
+        l_bfgs_b_result scaled = solver.optimize(objective, lb, ub, z);
+        for (int i = 0; i < n; i++) {
+            EXPECT_NEAR(1, z[i] / c[i], 1e-2);
+        }
+        EXPECT_LT(5 * scaled.evaluations, unscaled.evaluations);
+    }
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, limits) {
+    l_bfgs_b<TypeParam> solver;
+    EXPECT_THROW(solver.set_max_evaluations(0), std::invalid_argument);
+    EXPECT_THROW(solver.set_time_limit(0), std::invalid_argument);
+    EXPECT_THROW(solver.set_time_limit(std::numeric_limits<double>::quiet_NaN()), std::invalid_argument);
+
+    TypeParam x, x0;
+    l_bfgs_b_utils::fill_container(x0, {-1.2, 1});
+    rosenbrock_function<TypeParam> pb(2);
+    x = x0;
+    l_bfgs_b_result result = this->mSolver.optimize(pb, x);
+    EXPECT_EQ(l_bfgs_b_status::converged, result.status);
+    int noEvaluations = result.evaluations;
+
+    // every budget stops the solve at a point no worse than the initial one,
+    // whose objective value is the returned one
+    double f0 = pb(x0);
+    for (int maxEvaluations = 1; maxEvaluations < noEvaluations; maxEvaluations++) {
+        this->mSolver.set_max_evaluations(maxEvaluations);
+        x = x0;
+        result = this->mSolver.optimize(pb, x);
+        EXPECT_EQ(l_bfgs_b_status::max_evaluations, result.status);
+        EXPECT_EQ(maxEvaluations, result.evaluations);
+        EXPECT_LE(result.f, f0);
+        EXPECT_DOUBLE_EQ(pb(x), result.f);
+    }
+    // the last evaluation has to be checked for convergence
+    this->mSolver.set_max_evaluations(noEvaluations + 1);
+    x = x0;
+    result = this->mSolver.optimize(pb, x);
+    EXPECT_EQ(l_bfgs_b_status::converged, result.status);
+
+    this->mSolver.set_max_iterations(3);
+    x = x0;
+    result = this->mSolver.optimize(pb, x);
+    EXPECT_EQ(l_bfgs_b_status::max_iterations, result.status);
+
+    // a cancelled token stops the solves before any evaluation
+    cancellation_token token;
+    this->mSolver.set_cancellation_token(token);
+    token.cancel();
+    x = x0;
+    result = this->mSolver.optimize(pb, x);
+    EXPECT_EQ(l_bfgs_b_status::cancelled, result.status);
+    EXPECT_EQ(0, result.evaluations);
+    EXPECT_EQ_VECTORS(x0, x);
+    token.reset();
+    result = this->mSolver.optimize(pb, x);
+    EXPECT_EQ(l_bfgs_b_status::max_iterations, result.status);
+}
+
+// slow objective that needs many more evaluations than those allowed by the
+// limits
+TEST(cancellation_test, time_limit_and_cancellation) {
+    int n = 50;
+    std::vector<double> lb(n, -std::numeric_limits<double>::infinity());
+    std::vector<double> ub(n, std::numeric_limits<double>::infinity());
+    std::atomic<int> noEvaluations(0);
+    auto objective = [&noEvaluations](const std::vector<double> &x, std::vector<double> &gr) {
+        noEvaluations++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        double result = 0;
+        for (std::size_t i = 0; i < x.size(); i++) {
+            double c = (i + 1) * (i + 1);
+            result += c * x[i] * x[i];
+            gr[i] = 2 * c * x[i];
+        }
+        return result;
+    };
+    l_bfgs_b<std::vector<double> > solver(5, 1000000, 1, 0);
+    solver.set_time_limit(0.05);
+    std::vector<double> x(n, 1);
+    auto start = std::chrono::steady_clock::now();
+    l_bfgs_b_result result = solver.optimize(objective, lb, ub, x);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    EXPECT_EQ(l_bfgs_b_status::time_limit, result.status);
+    EXPECT_GE(elapsed, 0.05);
+    EXPECT_LT(elapsed, 1);
+    EXPECT_EQ(noEvaluations.load(), result.evaluations);
+
+    // cancelled from another thread
+    solver.set_time_limit(std::numeric_limits<double>::infinity());
+    cancellation_token token;
+    solver.set_cancellation_token(token);
+    std::thread canceller([&token]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        token.cancel();
+    });
+    x.assign(n, 1);
+    start = std::chrono::steady_clock::now();
+    result = solver.optimize(objective, lb, ub, x);
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    canceller.join();
+    EXPECT_EQ(l_bfgs_b_status::cancelled, result.status);
+    EXPECT_LT(elapsed, 1);
+    EXPECT_LT(result.f, n * (n + 1) * (2 * n + 1) / 6.0);
+}
+
+TYPED_TEST(l_bfgs_b_num_gradient_test, observer) {
+    TypeParam x, x0, y;
+    l_bfgs_b_utils::fill_container(x0, {-1.2, 1});
+    rosenbrock_function<TypeParam> pb(2);
+    y = x0;
+    l_bfgs_b_result unobserved = this->mSolver.optimize(pb, y);
+
+    std::vector<TypeParam> iterates;
+    std::vector<double> values;
+    int lastIteration = 0;
+    int lastEvaluations = 0;
+    this->mSolver.set_observer([&](const l_bfgs_b_iteration<TypeParam> &iteration) {
+        EXPECT_EQ(lastIteration + 1, iteration.iterations);
+        EXPECT_GT(iteration.evaluations, lastEvaluations);
+        EXPECT_GE(iteration.projectedGradientNorm, 0);
+        lastIteration = iteration.iterations;
+        lastEvaluations = iteration.evaluations;
+        iterates.push_back(iteration.x);
+        values.push_back(iteration.f);
+        return true;
+    });
+    x = x0;
+    l_bfgs_b_result result = this->mSolver.optimize(pb, x);
+    // observing does not change the iterates
+    EXPECT_EQ_VECTORS(y, x);
+    EXPECT_EQ(unobserved.evaluations, result.evaluations);
+    EXPECT_EQ(result.iterations, static_cast<int>(iterates.size()));
+    EXPECT_EQ_VECTORS(x, iterates.back());
+    EXPECT_EQ(result.f, values.back());
+    for (std::size_t j = 1; j < values.size(); j++) {
+        EXPECT_LE(values[j], values[j - 1]);
+    }
+
+    // early stop, keeping the iterate
+    this->mSolver.set_observer([](const l_bfgs_b_iteration<TypeParam> &iteration) {
+        return iteration.iterations < 3;
+    });
+    x = x0;
+    result = this->mSolver.optimize(pb, x);
+    EXPECT_EQ(l_bfgs_b_status::stopped_by_observer, result.status);
+    EXPECT_EQ(3, result.iterations);
+    EXPECT_EQ_VECTORS(iterates[2], x);
+    EXPECT_EQ(values[2], result.f);
+
+    // the observer sees the original variables
+    iterates.clear();
+    this->mSolver.set_variable_scales({0.5, 8});
+    this->mSolver.set_observer([&](const l_bfgs_b_iteration<TypeParam> &iteration) {
+        iterates.push_back(iteration.x);
+        return true;
+    });
+    x = x0;
+    result = this->mSolver.optimize(pb, x);
+    EXPECT_EQ(result.iterations, static_cast<int>(iterates.size()));
+    EXPECT_EQ_VECTORS(x, iterates.back());
+    EXPECT_DOUBLE_EQ(pb(iterates.back()), result.f);
+}
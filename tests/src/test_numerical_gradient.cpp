@@ -75,4 +75,199 @@ TYPED_TEST(numerical_gradient_test, goldstein) {
     EXPECT_RELATIVE_NEAR_VECTORS(gr, ngr);
 }
 
+TYPED_TEST(numerical_gradient_test, parallel_matches_serial) {
+    TypeParam x;
+    this->set_up(std::shared_ptr<problem<TypeParam> >(new beale_function<TypeParam>()));
+    this->random_point(x);
+    TypeParam serialGr = l_bfgs_b_utils::numerical_gradient(*(this->mPb), x);
+    for (int noThreads : {1, 2, 4}) {
+        TypeParam parallelGr = l_bfgs_b_utils::parallel_numerical_gradient(*(this->mPb), x,
+                                                                           this->mPb->get_lower_bound(),
+                                                                           this->mPb->get_upper_bound(),
+                                                                           1e-6, noThreads);
+        EXPECT_EQ_VECTORS(serialGr, parallelGr);
+    }
+}
+
+TYPED_TEST(numerical_gradient_test, parallel_differencing_mode) {
+    TypeParam x, serialGr, parallelGr;
+    this->set_up(std::shared_ptr<problem<TypeParam> >(new goldstein_price_function_base<TypeParam>()));
+    this->random_gradient(x, serialGr);
+    parallelGr = serialGr;
+    this->mPb->set_differencing_mode(differencing_mode::parallel, 3);
+    EXPECT_EQ(differencing_mode::parallel, this->mPb->get_differencing_mode());
+    EXPECT_EQ(3, this->mPb->get_differencing_threads());
+    this->mPb->gradient(x, parallelGr);
+    EXPECT_EQ_VECTORS(serialGr, parallelGr);
+}
+
+// larger problem, so that the coordinates are actually spread over several threads
+TEST(parallel_numerical_gradient_test, rosenbrock) {
+    int n = 200;
+    rosenbrock_function<std::vector<double> > pb(n);
+    random_vector_generator<std::vector<double> > rvg(n, -2, 2, 1234);
+    std::vector<double> x = rvg();
+    std::vector<double> gr(n), ngr(n);
+    pb.gradient(x, gr);
+    pb.set_differencing_mode(differencing_mode::parallel, 8);
+    pb.numerical_gradient(x, ngr, 1e-6);
+    EXPECT_RELATIVE_NEAR_VECTORS(gr, ngr);
+}
+
+TYPED_TEST(numerical_gradient_test, forward_scheme) {
+    int n = 2;
+    TypeParam x, gr, ngr;
+    std::shared_ptr<counted_rosenbrock_function_base<TypeParam> > ptr(
+            new counted_rosenbrock_function_base<TypeParam>(n));
+    this->set_up(std::shared_ptr<problem<TypeParam> >(new rosenbrock_function<TypeParam>(n)));
+    this->random_gradient(x, gr);
+    ngr = gr;
+    ptr->set_finite_difference_scheme(finite_difference_scheme::forward);
+    double f = ptr->value_and_gradient(x, ngr);
+    EXPECT_DOUBLE_EQ((*(this->mPb))(x), f);
+    // f(x) is reused: only n additional evaluations
+    EXPECT_EQ(n + 1, ptr->get_value_calls());
+    EXPECT_RELATIVE_NEAR_VECTORS(gr, ngr);
+
+    // central differences require 2n evaluations
+    ptr->reset_value_calls();
+    ptr->set_finite_difference_scheme(finite_difference_scheme::central);
+    ptr->value_and_gradient(x, ngr);
+    EXPECT_EQ(2 * n + 1, ptr->get_value_calls());
+}
 
+TYPED_TEST(numerical_gradient_test, forward_scheme_at_bounds) {
+    TypeParam x, lb, ub;
+    l_bfgs_b_utils::fill_container(x, {1.5, -0.5});
+    l_bfgs_b_utils::fill_container(lb, {-2, -0.5});
+    l_bfgs_b_utils::fill_container(ub, {1.5, 2});
+    rosenbrock_function<TypeParam> pb(2);
+    TypeParam gr(x);
+    pb.gradient(x, gr);
+    // x lies on the upper bound of the first coordinate and on the lower bound of the
+    // second one
+    TypeParam ngr = l_bfgs_b_utils::forward_numerical_gradient(pb, x, pb(x), lb, ub, 1e-7);
+    EXPECT_RELATIVE_NEAR_VECTORS(gr, ngr);
+    // a fixed variable has a null derivative
+    l_bfgs_b_utils::fill_container(lb, {1.5, -0.5});
+    ngr = l_bfgs_b_utils::forward_numerical_gradient(pb, x, pb(x), lb, ub, 1e-7);
+    EXPECT_EQ(0, ngr[0]);
+}
+
+// an absolute step of 1e-8 would be below the resolution of x
+TYPED_TEST(numerical_gradient_test, forward_scheme_large_magnitudes) {
+    TypeParam x, lb, ub;
+    l_bfgs_b_utils::fill_container(x, {1e9, -3e9});
+    l_bfgs_b_utils::fill_container(lb, {-1e10, -1e10});
+    l_bfgs_b_utils::fill_container(ub, {1e10, 1e10});
+    auto halfSquaredNorm = [](const TypeParam &z) {
+        return 0.5 * (z[0] * z[0] + z[1] * z[1]);
+    };
+    TypeParam ngr = l_bfgs_b_utils::forward_numerical_gradient(halfSquaredNorm, x, halfSquaredNorm(x), lb, ub,
+                                                               1.5e-8);
+    EXPECT_RELATIVE_NEAR_VECTORS(x, ngr, 1e-6);
+}
+
+TYPED_TEST(numerical_gradient_test, complex_step_scheme) {
+    int n = 2;
+    TypeParam x, gr, ngr;
+    this->set_up(std::shared_ptr<problem<TypeParam> >(new rosenbrock_function<TypeParam>(n)));
+    this->random_gradient(x, gr);
+    ngr = gr;
+    generic_rosenbrock_function<TypeParam> pb(n);
+    pb.set_finite_difference_scheme(finite_difference_scheme::complex_step);
+    pb.gradient(x, ngr);
+    // no cancellation errors
+    EXPECT_RELATIVE_NEAR_VECTORS(gr, ngr, 1e-12);
+    // the complex overload is mandatory
+    rosenbrock_function_base<TypeParam> noComplexPb(n);
+    noComplexPb.set_finite_difference_scheme(finite_difference_scheme::complex_step);
+    EXPECT_THROW(noComplexPb.gradient(x, ngr), std::logic_error);
+}
+
+TEST(coupling_structure_test, invalid_variables) {
+    EXPECT_THROW(coupling_structure(0, {}), std::invalid_argument);
+    EXPECT_THROW(coupling_structure(3, {{0, 3}}), std::invalid_argument);
+    EXPECT_THROW(coupling_structure(3, {{-1, 2}}), std::invalid_argument);
+}
+
+TEST(coupling_structure_test, coloring) {
+    // elements sharing a variable must not share colors
+    std::vector<std::vector<int> > elements = {{0, 1, 2}, {2, 3}, {3, 4, 5}, {0, 5}, {6}};
+    coupling_structure structure(8, elements);
+    const std::vector<int> &colors = structure.get_colors();
+    for (const auto &element : elements) {
+        for (int i : element) {
+            for (int j : element) {
+                if (i != j) {
+                    EXPECT_NE(colors[i], colors[j]);
+                }
+            }
+        }
+    }
+    EXPECT_EQ(3, structure.get_number_of_colors());
+    int noMembers = 0;
+    for (int color = 0; color < structure.get_number_of_colors(); color++) {
+        noMembers += structure.get_color_members(color).size();
+    }
+    EXPECT_EQ(8, noMembers);
+}
+
+// a chain of elements requires 2 colors, regardless of the dimension
+TEST(grouped_numerical_gradient_test, rosenbrock_chain) {
+    for (int n : {2, 10, 1000}) {
+        counted_rosenbrock_function_base<std::vector<double> > pb(n);
+        pb.set_coupling_structure(pb.element_variables());
+        EXPECT_EQ(2, pb.get_coupling_structure()->get_number_of_colors());
+        rosenbrock_function<std::vector<double> > analytical(n);
+        random_vector_generator<std::vector<double> > rvg(n, -2, 2, n);
+        std::vector<double> x = rvg();
+        std::vector<double> gr(n), ngr(n);
+        analytical.gradient(x, gr);
+
+        pb.gradient(x, ngr);
+        EXPECT_EQ(0, pb.get_value_calls());
+        EXPECT_EQ(4, pb.get_element_calls());
+        EXPECT_RELATIVE_NEAR_VECTORS(gr, ngr);
+
+        pb.reset_value_calls();
+        pb.set_finite_difference_scheme(finite_difference_scheme::forward);
+        pb.set_differencing_mode(differencing_mode::parallel, 2);
+        pb.gradient(x, ngr);
+        EXPECT_EQ(3, pb.get_element_calls());
+        EXPECT_RELATIVE_NEAR_VECTORS(gr, ngr);
+    }
+}
+
+TEST(grouped_numerical_gradient_test, steps_limited_by_bounds) {
+    int n = 5;
+    rosenbrock_function<std::vector<double> > pb(n);
+    std::vector<double> x = {1.5, -0.5, 0.3, 2, -1};
+    std::vector<double> lb = {-2, -0.5, -2, -2, -1};
+    std::vector<double> ub = {1.5, 2, 2, 2, 2};
+    std::vector<double> gr(n);
+    pb.gradient(x, gr);
+    coupling_structure structure(n, pb.element_variables());
+    auto elements = [&](const std::vector<double> &z, std::vector<double> &values) {
+        pb.element_values(z, values);
+    };
+    std::vector<double> central = l_bfgs_b_utils::grouped_numerical_gradient(elements, x, structure, lb, ub, 1e-6);
+    std::vector<double> forward = l_bfgs_b_utils::grouped_numerical_gradient(elements, x, structure, lb, ub, 1e-7,
+                                                                             false);
+    EXPECT_RELATIVE_NEAR_VECTORS(gr, central);
+    EXPECT_RELATIVE_NEAR_VECTORS(gr, forward);
+}
+
+TEST(grouped_numerical_gradient_test, forward_steps_relative_to_x) {
+    std::vector<double> x = {1e9, -3e9, 2e10};
+    std::vector<double> lb(3, -1e11), ub(3, 1e11);
+    coupling_structure structure(3, {{0}, {1}, {2}});
+    auto elements = [](const std::vector<double> &z, std::vector<double> &values) {
+        for (int k = 0; k < 3; k++) {
+            values[k] = 0.5 * z[k] * z[k];
+        }
+    };
+    std::vector<double> forward = l_bfgs_b_utils::grouped_numerical_gradient(elements, x, structure, lb, ub, 1.5e-8,
+                                                                             false);
+    EXPECT_RELATIVE_NEAR_VECTORS(x, forward, 1e-6);
+}
@@ -8,9 +8,11 @@
 #include "gtest/gtest.h"
 #include "test_functions.h"
 #include "test_utils.h"
+#include <lbfgsb_cpp/container_traits.h>
 #include <armadillo>
 #include <Eigen/Dense>
 #include <initializer_list>
+#include <limits>
 #include <array>
 #include <vector>
 
@@ -141,6 +143,108 @@ TYPED_TEST(problem_test, setter_invalid_bounds) {
 }
 
 
+TYPED_TEST(problem_test, default_value_and_gradient) {
+    simple_quadratic_problem<TypeParam> pb = this->get_problem(3);
+    TypeParam x = {1, -2, 3};
+    TypeParam gr = {0, 0, 0};
+    TypeParam expectedGr = {0, 0, 0};
+    pb.gradient(x, expectedGr);
+    EXPECT_EQ(pb(x), pb.value_and_gradient(x, gr));
+    EXPECT_EQ_VECTORS(expectedGr, gr);
+}
+
+
+TYPED_TEST(problem_test, fused_value_and_gradient) {
+    rosenbrock_function<TypeParam> pb(3);
+    TypeParam x = {0.5, -1.5, 2};
+    TypeParam gr = {0, 0, 0};
+    TypeParam expectedGr = {0, 0, 0};
+    pb.gradient(x, expectedGr);
+    EXPECT_NEAR(pb(x), pb.value_and_gradient(x, gr), 1e-10);
+    EXPECT_NEAR_VECTORS(expectedGr, gr, 1e-10);
+}
+
+
+TYPED_TEST(problem_test, bounds_are_not_copied) {
+    simple_quadratic_problem<TypeParam> pb = this->get_problem(3);
+    const TypeParam &lb = pb.get_lower_bound();
+    const TypeParam &ub = pb.get_upper_bound();
+    EXPECT_EQ(&lb, &pb.get_lower_bound());
+    EXPECT_EQ(&ub, &pb.get_upper_bound());
+    EXPECT_TRUE(l_bfgs_b_utils::is_contiguous_container<TypeParam>::value);
+    EXPECT_EQ(&lb[0], l_bfgs_b_utils::data_pointer(lb));
+    EXPECT_EQ(&ub[2], l_bfgs_b_utils::data_pointer(ub) + 2);
+}
+
+
+TYPED_TEST(problem_test, in_place_numerical_gradient) {
+    rosenbrock_function_base<TypeParam> pb(3);
+    TypeParam x = {0.5, -1.5, 2};
+    TypeParam gr = {0, 0, 0};
+    TypeParam expectedGr = {0, 0, 0};
+    rosenbrock_function<TypeParam>(3).gradient(x, expectedGr);
+    const double *storage = l_bfgs_b_utils::data_pointer(gr);
+    for (auto scheme : {finite_difference_scheme::central, finite_difference_scheme::forward}) {
+        pb.set_finite_difference_scheme(scheme);
+        pb.gradient(x, gr);
+        EXPECT_EQ(storage, l_bfgs_b_utils::data_pointer(gr));
+        EXPECT_RELATIVE_NEAR_VECTORS(expectedGr, gr, 1e-4);
+    }
+}
+
+
+TYPED_TEST(problem_test, coordinate_bounds) {
+    simple_quadratic_problem<TypeParam> pb = this->get_problem(3, {1, 2, 3}, {4, 5, 6});
+    const int *nbd = pb.get_bounds().get_nbd();
+    EXPECT_EQ(2, nbd[0]);
+    pb.set_lower_bound(0, -std::numeric_limits<double>::infinity());
+    pb.set_upper_bound(2, std::numeric_limits<double>::infinity());
+    pb.set_bounds(1, 0, 0);
+    pb.set_upper_bound(0, 7);
+    // the classification is updated with the bounds
+    EXPECT_EQ(nbd, pb.get_bounds().get_nbd());
+    EXPECT_EQ(3, nbd[0]);
+    EXPECT_EQ(2, nbd[1]);
+    EXPECT_EQ(1, nbd[2]);
+    EXPECT_EQ(7, pb.get_upper_bound()[0]);
+    EXPECT_EQ(0, pb.get_lower_bound()[1]);
+
+    EXPECT_THROW(pb.set_lower_bound(1, 1), std::invalid_argument);
+    EXPECT_THROW(pb.set_upper_bound(2, 2), std::invalid_argument);
+    EXPECT_THROW(pb.set_bounds(3, 0, 1), std::invalid_argument);
+    EXPECT_THROW(pb.set_bounds(-1, 0, 1), std::invalid_argument);
+    EXPECT_EQ(0, pb.get_lower_bound()[1]);
+}
+
+
+TYPED_TEST(problem_test, nbd_follows_bound_updates) {
+    simple_quadratic_problem<TypeParam> pb = this->get_problem(3, {1, 2, 3}, {4, 5, 6});
+    pb.set_lower_bound({1, -std::numeric_limits<double>::infinity(), 3});
+    const int *nbd = pb.get_bounds().get_nbd();
+    EXPECT_EQ(2, nbd[0]);
+    EXPECT_EQ(3, nbd[1]);
+    EXPECT_EQ(2, nbd[2]);
+    pb.set_upper_bound({4, std::numeric_limits<double>::infinity(), 6});
+    EXPECT_EQ(2, nbd[0]);
+    EXPECT_EQ(0, nbd[1]);
+    EXPECT_EQ(2, nbd[2]);
+
+    // a coordinate update followed by the assignment of identical bounds keeps
+    // the classification, while a differing coordinate is reclassified
+    pb.set_bounds(0, -std::numeric_limits<double>::infinity(), 4);
+    EXPECT_EQ(3, nbd[0]);
+    pb.set_lower_bound(pb.get_lower_bound());
+    EXPECT_EQ(nbd, pb.get_bounds().get_nbd());
+    EXPECT_EQ(3, nbd[0]);
+    EXPECT_EQ(0, nbd[1]);
+    EXPECT_EQ(2, nbd[2]);
+    pb.set_upper_bound({4, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()});
+    EXPECT_EQ(3, nbd[0]);
+    EXPECT_EQ(0, nbd[1]);
+    EXPECT_EQ(1, nbd[2]);
+}
+
+
 // these tests are not applicable for the std::array-based problems, since the
 // consistency of the arrays are check in compilation time
 typedef Types<std::vector<double>, arma::vec > dynImplementations;
@@ -0,0 +1,168 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "test_functions.h"
+#include "test_utils.h"
+#include <lbfgsb_cpp/l_bfgs_b.h>
+#include <lbfgsb_cpp/trace.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <armadillo>
+#include <Eigen/Dense>
+
+template<class T>
+class trace_test : public testing::Test {
+protected:
+    trace_test() = default;
+
+    ~trace_test() {
+        std::remove(mFile.c_str());
+    }
+
+    std::string mFile = "trace_test.bin";
+};
+
+using testing::Types;
+typedef Types<std::vector<double>, arma::vec, Eigen::VectorXd> Implementations;
+TYPED_TEST_CASE(trace_test, Implementations);
+
+TYPED_TEST(trace_test, ring_buffer) {
+    EXPECT_THROW(l_bfgs_b_trace(0), std::invalid_argument);
+    l_bfgs_b_trace trace(4);
+    l_bfgs_b_trace_record record = l_bfgs_b_trace_record();
+    for (int i = 1; i <= 10; i++) {
+        record.iteration = i;
+        trace.push(record);
+        EXPECT_EQ(std::min(i, 4), trace.size());
+    }
+    EXPECT_EQ(4, trace.capacity());
+    EXPECT_EQ(6, trace.dropped());
+    // the oldest records were replaced
+    for (int i = 0; i < trace.size(); i++) {
+        EXPECT_EQ(7 + i, trace[i].iteration);
+    }
+    trace.clear();
+    EXPECT_EQ(0, trace.size());
+    EXPECT_EQ(0, trace.dropped());
+}
+
+TYPED_TEST(trace_test, records_every_iteration) {
+    int n = 6;
+    rosenbrock_function<TypeParam> pb(n);
+    pb.set_lower_bound(make_point<TypeParam>(n, -2));
+    pb.set_upper_bound(make_point<TypeParam>(n, 0.8));
+    l_bfgs_b<TypeParam> solver;
+    TypeParam x = make_point<TypeParam>(n, -1);
+    l_bfgs_b_result untraced = solver.optimize(pb, x);
+
+    l_bfgs_b_trace trace(1000);
+    solver.set_trace(&trace);
+    TypeParam y = make_point<TypeParam>(n, -1);
+    l_bfgs_b_result result = solver.optimize(pb, y);
+    EXPECT_EQ_VECTORS(x, y);
+    EXPECT_EQ(untraced.evaluations, result.evaluations);
+    ASSERT_EQ(result.iterations, trace.size());
+    int evaluations = 1;
+    for (int i = 0; i < trace.size(); i++) {
+        const l_bfgs_b_trace_record &record = trace[i];
+        EXPECT_EQ(i + 1, record.iteration);
+        EXPECT_GE(record.evaluations, 1);
+        evaluations += record.evaluations;
+        if (i > 0) {
+            EXPECT_LE(record.f, trace[i - 1].f);
+        }
+        EXPECT_GT(record.step, 0);
+        EXPECT_GE(record.stepNorm, 0);
+        EXPECT_EQ(n, record.freeVariables + record.activeVariables);
+        EXPECT_GE(record.breakpoints, 0);
+        EXPECT_GE(record.backtracks, 0);
+        EXPECT_GE(record.cauchyTime, 0);
+        EXPECT_GE(record.subspaceTime, 0);
+        EXPECT_GE(record.lineSearchTime, 0);
+        EXPECT_GE(record.objectiveTime, 0);
+    }
+    EXPECT_EQ(result.evaluations, evaluations);
+    EXPECT_EQ(result.f, trace[trace.size() - 1].f);
+    EXPECT_EQ(result.stats.activeVariables, trace[trace.size() - 1].activeVariables);
+
+    // a small trace keeps the last iterations
+    l_bfgs_b_trace lastIterations(3);
+    solver.set_trace(&lastIterations);
+    y = make_point<TypeParam>(n, -1);
+    solver.optimize(pb, y);
+    ASSERT_EQ(3, lastIterations.size());
+    EXPECT_EQ(trace.size() - 3, lastIterations.dropped());
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(trace[trace.size() - 3 + i].f, lastIterations[i].f);
+    }
+}
+
+TYPED_TEST(trace_test, write_and_load) {
+    int n = 4;
+    rosenbrock_function<TypeParam> pb(n);
+    l_bfgs_b<TypeParam> solver;
+    l_bfgs_b_trace trace(10);
+    solver.set_trace(&trace);
+    TypeParam x = make_point<TypeParam>(n, -1);
+    solver.optimize(pb, x);
+    ASSERT_EQ(10, trace.size());
+    trace.write(this->mFile);
+
+    // header, column descriptors and columns
+    const std::vector<l_bfgs_b_utils::trace_column> &columns = l_bfgs_b_utils::trace_columns();
+    std::size_t expectedSize = sizeof(l_bfgs_b_utils::trace_header) +
+                               columns.size() * sizeof(l_bfgs_b_utils::trace_column);
+    for (const auto &column : columns) {
+        expectedSize += trace.size() * l_bfgs_b_utils::trace_column_size(column);
+    }
+    std::ifstream file(this->mFile.c_str(), std::ios::binary | std::ios::ate);
+    EXPECT_EQ(expectedSize, static_cast<std::size_t>(file.tellg()));
+    file.close();
+
+    l_bfgs_b_trace loaded = l_bfgs_b_trace::load(this->mFile);
+    ASSERT_EQ(trace.size(), loaded.size());
+    for (int i = 0; i < trace.size(); i++) {
+        EXPECT_EQ(trace[i].iteration, loaded[i].iteration);
+        EXPECT_EQ(trace[i].evaluations, loaded[i].evaluations);
+        EXPECT_EQ(trace[i].f, loaded[i].f);
+        EXPECT_EQ(trace[i].projectedGradientNorm, loaded[i].projectedGradientNorm);
+        EXPECT_EQ(trace[i].step, loaded[i].step);
+        EXPECT_EQ(trace[i].stepNorm, loaded[i].stepNorm);
+        EXPECT_EQ(trace[i].freeVariables, loaded[i].freeVariables);
+        EXPECT_EQ(trace[i].activeVariables, loaded[i].activeVariables);
+        EXPECT_EQ(trace[i].breakpoints, loaded[i].breakpoints);
+        EXPECT_EQ(trace[i].backtracks, loaded[i].backtracks);
+        EXPECT_EQ(trace[i].cauchyTime, loaded[i].cauchyTime);
+        EXPECT_EQ(trace[i].subspaceTime, loaded[i].subspaceTime);
+        EXPECT_EQ(trace[i].lineSearchTime, loaded[i].lineSearchTime);
+        EXPECT_EQ(trace[i].objectiveTime, loaded[i].objectiveTime);
+    }
+
+    // an empty trace
+    trace.clear();
+    trace.write(this->mFile);
+    EXPECT_EQ(0, l_bfgs_b_trace::load(this->mFile).size());
+
+    // a corrupt record count is rejected before allocating the trace
+    std::fstream corrupt(this->mFile.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+    std::uint64_t noRecords = std::uint64_t(1) << 40;
+    corrupt.seekp(offsetof(l_bfgs_b_utils::trace_header, noRecords));
+    corrupt.write(reinterpret_cast<const char *>(&noRecords), sizeof(noRecords));
+    corrupt.close();
+    EXPECT_THROW(l_bfgs_b_trace::load(this->mFile), std::runtime_error);
+
+    std::ofstream other(this->mFile.c_str(), std::ios::binary | std::ios::trunc);
+    other << "not a trace";
+    other.close();
+    EXPECT_THROW(l_bfgs_b_trace::load(this->mFile), std::runtime_error);
+    EXPECT_THROW(l_bfgs_b_trace::load("missing_trace.bin"), std::runtime_error);
+}
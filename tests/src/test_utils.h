@@ -37,6 +37,16 @@ inline void EXPECT_EQ_VECTORS(const T &x, const T &y) {
     }
 }
 
+// Point of size n with entries value, value + 0.1, value + 0.2, ...
+template<class T>
+T make_point(int n, double value) {
+    T x(n);
+    for (int i = 0; i < n; i++) {
+        x[i] = value + 0.1 * i;
+    }
+    return x;
+}
+
 
 // Need this function due to that Eigen does not accept init-list (to the best of my knowledge)
 // The size of x should match the size of initializer_list
@@ -0,0 +1,88 @@
+/*
+ * Copyright Constantino Antonio Garcia 2017
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "test_functions.h"
+#include "test_utils.h"
+#include <lbfgsb_cpp/l_bfgs_b.h>
+#include <lbfgsb_cpp/workspace.h>
+#include <vector>
+#include <armadillo>
+#include <Eigen/Dense>
+
+template<class T>
+class workspace_test : public testing::Test {
+protected:
+    workspace_test() = default;
+
+    ~workspace_test() = default;
+};
+
+using testing::Types;
+typedef Types<std::vector<double>, arma::vec, Eigen::VectorXd> Implementations;
+TYPED_TEST_CASE(workspace_test, Implementations);
+
+TYPED_TEST(workspace_test, invalid_shape) {
+    l_bfgs_b_workspace<TypeParam> workspace;
+    EXPECT_THROW(workspace.reserve(0, 5), std::invalid_argument);
+    EXPECT_THROW(workspace.reserve(3, 0), std::invalid_argument);
+}
+
+TYPED_TEST(workspace_test, reserve_only_grows) {
+    l_bfgs_b_workspace<TypeParam> workspace(10, 5);
+    std::size_t bytes = workspace.allocated_bytes();
+    workspace.reserve(3, 2);
+    EXPECT_EQ(3, workspace.get_input_dimension());
+    EXPECT_EQ(2, workspace.get_memory_size());
+    EXPECT_EQ(bytes, workspace.allocated_bytes());
+    workspace.reserve(20, 5);
+    EXPECT_GT(workspace.allocated_bytes(), bytes);
+}
+
+TYPED_TEST(workspace_test, reused_workspace_gives_same_solution) {
+    int n = 6;
+    rosenbrock_function<TypeParam> pb(n);
+    l_bfgs_b<TypeParam> solver;
+    l_bfgs_b_workspace<TypeParam> workspace;
+
+    TypeParam x = make_point<TypeParam>(n, -1);
+    solver.optimize(pb, x, workspace);
+    std::size_t bytes = workspace.allocated_bytes();
+    // the gradient kept by the workspace is counted too
+    l_bfgs_b_workspace<TypeParam> reserved(n, solver.get_memory_size());
+    EXPECT_GE(bytes, reserved.allocated_bytes() + n * sizeof(double));
+    for (int i = 0; i < 10; i++) {
+        TypeParam reusedX = make_point<TypeParam>(n, -1);
+        TypeParam freshX = make_point<TypeParam>(n, -1);
+        l_bfgs_b_workspace<TypeParam> freshWorkspace;
+        solver.optimize(pb, reusedX, workspace);
+        solver.optimize(pb, freshX, freshWorkspace);
+        EXPECT_EQ_VECTORS(freshX, reusedX);
+        EXPECT_EQ_VECTORS(x, reusedX);
+    }
+    EXPECT_EQ(bytes, workspace.allocated_bytes());
+}
+
+TYPED_TEST(workspace_test, solver_owned_workspace) {
+    l_bfgs_b<TypeParam> solver;
+    booth_function<TypeParam> booth;
+    rosenbrock_function<TypeParam> rosenbrock(4);
+
+    TypeParam x = make_point<TypeParam>(4, 0);
+    solver.optimize(rosenbrock, x);
+    EXPECT_EQ(4, solver.get_workspace().get_input_dimension());
+    std::size_t bytes = solver.get_workspace().allocated_bytes();
+    // smaller problems reuse the work arrays; only the gradient container is
+    // resized to the new dimension
+    x = make_point<TypeParam>(2, 0);
+    solver.optimize(booth, x);
+    EXPECT_EQ(2, solver.get_workspace().get_input_dimension());
+    EXPECT_LE(solver.get_workspace().allocated_bytes(), bytes);
+    EXPECT_GE(solver.get_workspace().allocated_bytes(), bytes - 2 * sizeof(double));
+    EXPECT_NEAR(1, x[0], 1e-4);
+    EXPECT_NEAR(3, x[1], 1e-4);
+}